@@ -164,6 +164,8 @@ mips_trap(struct trapframe *tf)
 
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
+		/* For thread_tick's user/system time sampling. */
+		curthread->t_intr_user = !iskern;
 
 		/*
 		 * The processor has turned interrupts off; if the
@@ -203,6 +205,17 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If another thread of our process has exited it,
+		 * leave instead of going back to user mode. This
+		 * needs the interrupt state set up as for a syscall.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			proc_checkexit();
+		}
 		goto done2;
 	}
 
@@ -323,6 +336,14 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/*
+	 * Don't go back to user mode if another thread of our process
+	 * has exited it meanwhile.
+	 */
+	if (!iskern) {
+		proc_checkexit();
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
@@ -113,6 +113,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -126,6 +131,15 @@ syscall(struct trapframe *tf)
 			(userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_spawnv:
+		err = sys_spawnv(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			tf->tf_a3,
+			&retval);
+		break;
+
 	    case SYS__exit:
 		sys__exit(tf->tf_a0);
 		panic("Returning from exit\n");
@@ -142,6 +156,54 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS_getrusage:
+		err = sys_getrusage(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_getrlimit:
+		err = sys_getrlimit(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_setrlimit:
+		err = sys_setrlimit(tf->tf_a0, (const_userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_sched_setaffinity:
+		err = sys_sched_setaffinity(tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_sched_getaffinity:
+		err = sys_sched_getaffinity(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+
+	    /* user thread calls */
+
+	    case SYS___thread_create:
+		err = sys___thread_create(tf,
+					  (userptr_t)tf->tf_a0,
+					  (userptr_t)tf->tf_a1,
+					  (userptr_t)tf->tf_a2,
+					  &retval);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit((userptr_t)tf->tf_a0);
+		panic("Returning from thread_exit\n");
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_futex_wait:
+		err = sys_futex_wait((userptr_t)tf->tf_a0, tf->tf_a1);
+		break;
+
+	    case SYS_futex_wake:
+		err = sys_futex_wake((userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+
 
 	    /* file calls */
 
@@ -164,6 +226,18 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll(
+			(userptr_t)tf->tf_a0,
+			tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +252,62 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(const_userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+	    case SYS_preadv:
+	    case SYS_pwritev:
+		{
+			/*
+			 * The 64-bit offset would go in an aligned
+			 * register pair, but a2 is taken, so it goes
+			 * on the stack instead (leaving a3 unused).
+			 */
+			off_t offset;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &offset, sizeof(offset));
+			if (err) {
+				break;
+			}
+
+			switch (callno) {
+			    case SYS_pread:
+				err = sys_pread(tf->tf_a0,
+						(userptr_t)tf->tf_a1,
+						tf->tf_a2, offset, &retval);
+				break;
+			    case SYS_pwrite:
+				err = sys_pwrite(tf->tf_a0,
+						 (userptr_t)tf->tf_a1,
+						 tf->tf_a2, offset, &retval);
+				break;
+			    case SYS_preadv:
+				err = sys_preadv(tf->tf_a0,
+						 (const_userptr_t)tf->tf_a1,
+						 tf->tf_a2, offset, &retval);
+				break;
+			    case SYS_pwritev:
+				err = sys_pwritev(tf->tf_a0,
+						  (const_userptr_t)tf->tf_a1,
+						  tf->tf_a2, offset, &retval);
+				break;
+			}
+		}
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -281,3 +411,24 @@ enter_forked_process(struct trapframe *tf)
 
 	mips_usermode(tf);
 }
+
+/*
+ * Enter user mode in a new thread of the current process.
+ *
+ * TF is a copy of the creating thread's trapframe, for the register
+ * state that isn't set here (notably gp); the thread starts at
+ * ENTRYPOINT as if called with ARG0 and ARG1, on the stack at
+ * STACKPTR. It must not return, so the return address is 0.
+ */
+void
+enter_new_thread(struct trapframe *tf, vaddr_t entrypoint,
+		 userptr_t arg0, userptr_t arg1, vaddr_t stackptr)
+{
+	tf->tf_epc = entrypoint;
+	tf->tf_a0 = (vaddr_t)arg0;
+	tf->tf_a1 = (vaddr_t)arg1;
+	tf->tf_sp = stackptr;
+	tf->tf_ra = 0;
+
+	mips_usermode(tf);
+}
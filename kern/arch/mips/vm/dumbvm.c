@@ -103,6 +103,15 @@ free_kpages(vaddr_t addr)
 	(void)addr;
 }
 
+void
+vm_splitkpages(vaddr_t addr, unsigned npages)
+{
+	/* nothing - free_kpages doesn't care. */
+
+	(void)addr;
+	(void)npages;
+}
+
 void
 vm_tlbshootdown_all(void)
 {
@@ -352,14 +361,37 @@ as_complete_load(struct addrspace *as)
 }
 
 int
-as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+as_define_stack(struct addrspace *as, vaddr_t argpages, unsigned nargpages,
+		vaddr_t *stackptr)
 {
+	vaddr_t top;
+	unsigned i;
+
 	KASSERT(as->as_stackpbase != 0);
+	KASSERT(nargpages < DUMBVM_STACKPAGES);
+
+	/* The stack is one block; copy the argument pages into its top. */
+	top = PADDR_TO_KVADDR(as->as_stackpbase) + DUMBVM_STACKPAGES * PAGE_SIZE;
+	memmove((void *)(top - nargpages * PAGE_SIZE), (void *)argpages,
+		nargpages * PAGE_SIZE);
+	for (i=0; i<nargpages; i++) {
+		free_kpages(argpages + i * PAGE_SIZE);
+	}
 
-	*stackptr = USERSTACK;
+	*stackptr = USERSTACK - nargpages * PAGE_SIZE;
 	return 0;
 }
 
+int
+as_define_tstack(struct addrspace *as, int tid, vaddr_t *stackptr)
+{
+	/* dumbvm has room for only the one stack. */
+	(void)as;
+	(void)tid;
+	(void)stackptr;
+	return ENOSYS;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -75,6 +75,53 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read and write c0_count ($9), and read c0_cause ($13). On sys161
+ * c0_count restarts from 0 when it matches c0_compare, which is why
+ * the interrupt handler can just keep setting the same compare value.
+ */
+static
+uint32_t
+mips_timer_getcount(void)
+{
+	uint32_t count;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
+static
+void
+mips_timer_setcount(uint32_t count)
+{
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		:: "r" (count));
+}
+
+static
+uint32_t
+mips_getcause(void)
+{
+	uint32_t cause;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $13;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (cause));
+	return cause;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -332,3 +379,48 @@ mainbus_interrupt(struct trapframe *tf)
 		}
 	}
 }
+
+/*
+ * Tickless idle support (see clock.c).
+ *
+ * mainbus_timer_stretch makes the next timer interrupt come TICKS
+ * hardclock periods after the last one rather than one. Since
+ * c0_count is counting up from the last interrupt, that's just a
+ * matter of setting c0_compare further out.
+ *
+ * mainbus_timer_unstretch goes back to the normal rate and returns
+ * how many whole periods have passed since the last interrupt that
+ * was taken. If the stretched interrupt has gone off but we haven't
+ * taken it (we're called with interrupts off) the count has restarted
+ * from 0, so add in the TICKS periods; setting c0_compare clears the
+ * interrupt, so it's up to the caller to account for them. The
+ * leftover part of a period is put back in c0_count so the next
+ * interrupt comes on schedule.
+ */
+void
+mainbus_timer_stretch(unsigned ticks)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(ticks > 0 && ticks <= 0xffffffffU / (CPU_FREQUENCY / HZ));
+
+	mips_timer_set(ticks * (CPU_FREQUENCY / HZ));
+}
+
+unsigned
+mainbus_timer_unstretch(unsigned ticks)
+{
+	uint32_t count;
+	unsigned elapsed;
+
+	KASSERT(curthread->t_curspl > 0);
+
+	count = mips_timer_getcount();
+	elapsed = count / (CPU_FREQUENCY / HZ);
+	if (mips_getcause() & MIPS_TIMER_BIT) {
+		elapsed += ticks;
+	}
+	mips_timer_setcount(count % (CPU_FREQUENCY / HZ));
+	mips_timer_set(CPU_FREQUENCY / HZ);
+
+	return elapsed;
+}
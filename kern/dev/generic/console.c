@@ -57,6 +57,7 @@
 #include <synch.h>
 #include <generic/console.h>
 #include <vfs.h>
+#include <poll.h>
 #include <device.h>
 #include "autoconf.h"
 
@@ -72,6 +73,11 @@ static struct con_softc *the_console = NULL;
 static struct lock *con_userlock_read = NULL;
 static struct lock *con_userlock_write = NULL;
 
+/*
+ * Threads in poll() waiting for a line of input.
+ */
+static struct pollqueue con_pollq;
+
 //////////////////////////////////////////////////
 
 /*
@@ -135,18 +141,23 @@ putch_intr(struct con_softc *cs, int ch)
 
 /*
  * Read a character, using interrupts to wait for I/O completion.
+ * Fails with EINTR if the reader is a user process that starts
+ * exiting meanwhile.
  */
 static
 int
-getch_intr(struct con_softc *cs)
+getch_intr(struct con_softc *cs, int *ret)
 {
-	unsigned char ret;
+	int result;
 
-	P(cs->cs_rsem);
-	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
+	result = P_intr(cs->cs_rsem);
+	if (result) {
+		return result;
+	}
+	*ret = (unsigned char)cs->cs_gotchars[cs->cs_gotchars_tail];
 	cs->cs_gotchars_tail =
 		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
-	return ret;
+	return 0;
 }
 
 /*
@@ -174,6 +185,12 @@ con_input(void *vcs, int ch)
 	cs->cs_gotchars_head = nexthead;
 
 	V(cs->cs_rsem);
+
+	/* wake poll() only when a read would now return (see con_poll) */
+	nexthead = (nexthead + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	if (ch == '\r' || ch == '\n' || nexthead == cs->cs_gotchars_tail) {
+		pollqueue_wakeup(&con_pollq);
+	}
 }
 
 /*
@@ -219,10 +236,15 @@ int
 getch(void)
 {
 	struct con_softc *cs = the_console;
+	int ch, result;
+
 	KASSERT(cs != NULL);
 	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
 
-	return getch_intr(cs);
+	result = getch_intr(cs, &ch);
+	/* only user processes get interrupted */
+	KASSERT(result == 0);
+	return ch;
 }
 
 ////////////////////////////////////////////////////////////
@@ -244,7 +266,7 @@ static
 int
 con_io(struct device *dev, struct uio *uio)
 {
-	int result;
+	int result, c;
 	char ch;
 	struct lock *lk;
 
@@ -262,7 +284,13 @@ con_io(struct device *dev, struct uio *uio)
 
 	while (uio->uio_resid > 0) {
 		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
+			KASSERT(the_console != NULL);
+			result = getch_intr(the_console, &c);
+			if (result) {
+				lock_release(lk);
+				return result;
+			}
+			ch = c;
 			if (ch=='\r') {
 				ch = '\n';
 			}
@@ -291,6 +319,55 @@ con_io(struct device *dev, struct uio *uio)
 	return 0;
 }
 
+/*
+ * Check if there's a whole line of input waiting, or the input buffer
+ * is full (so there can't be one until some is read).
+ */
+static
+bool
+con_haveline(struct con_softc *cs)
+{
+	unsigned head, i;
+
+	head = cs->cs_gotchars_head;
+	i = cs->cs_gotchars_tail;
+	if ((head + 1) % CONSOLE_INPUT_BUFFER_SIZE == i) {
+		return true;
+	}
+	for (; i != head; i = (i + 1) % CONSOLE_INPUT_BUFFER_SIZE) {
+		if (cs->cs_gotchars[i] == '\r' || cs->cs_gotchars[i] == '\n') {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * For poll(). A read returns at the end of a line (see con_io), so
+ * the console is readable once a whole line has been typed. Output
+ * never waits long enough to count.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct pollwaiter *pw, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+
+	*revents = events & POLLOUT;
+	if (events & POLLIN) {
+		/*
+		 * Register before looking, so a line that comes in
+		 * meanwhile wakes us. (con_input runs in an interrupt
+		 * handler and doesn't take a lock we could hold.)
+		 */
+		pollwaiter_add(pw, &con_pollq);
+		if (con_haveline(cs)) {
+			*revents |= POLLIN;
+		}
+	}
+	return 0;
+}
+
 static
 int
 con_ioctl(struct device *dev, int op, userptr_t data)
@@ -306,6 +383,7 @@ static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -386,6 +464,7 @@ config_con(struct con_softc *cs, int unit)
 	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	pollqueue_init(&con_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
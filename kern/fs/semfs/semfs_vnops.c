@@ -151,6 +151,34 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollqueue_wakeup(&sem->sems_pollq);
+}
+
+/*
+ * poll() for semaphore vnodes. Reading (P) waits for the count to be
+ * nonzero; writing (V) never waits.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct pollwaiter *pw, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+
+	sem = semfs_getsem(semv);
+
+	*revents = events & POLLOUT;
+	if (events & POLLIN) {
+		lock_acquire(sem->sems_lock);
+		if (sem->sems_count > 0) {
+			*revents |= POLLIN;
+		}
+		else {
+			pollwaiter_add(pw, &sem->sems_pollq);
+		}
+		lock_release(sem->sems_lock);
+	}
+	return 0;
 }
 
 /*
@@ -191,6 +219,7 @@ semfs_read(struct vnode *vn, struct uio *uio)
 	struct semfs_vnode *semv = vn->vn_data;
 	struct semfs_sem *sem;
 	size_t consume;
+	int result;
 
 	sem = semfs_getsem(semv);
 
@@ -214,7 +243,11 @@ semfs_read(struct vnode *vn, struct uio *uio)
 		if (sem->sems_count == 0) {
 			DEBUG(DB_SEMFS, "semfs: sem%u: blocking\n",
 			      semv->semv_semnum);
-			cv_wait(sem->sems_cv, sem->sems_lock);
+			result = cv_wait_intr(sem->sems_cv, sem->sems_lock);
+			if (result) {
+				lock_release(sem->sems_lock);
+				return result;
+			}
 		}
 	}
 	lock_release(sem->sems_lock);
@@ -657,6 +690,7 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_getdirentry = semfs_getdirentry,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = vopready_poll,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -690,6 +724,7 @@ static const struct vnode_ops semfs_semops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = semfs_write,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = semfs_poll,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
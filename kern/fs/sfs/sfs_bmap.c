@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
@@ -56,18 +57,23 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	 * you would get space from the disk buffer cache for this,
 	 * not use a static area.
 	 */
-	static uint32_t idbuf[SFS_DBPERIDB];
+	static uint32_t staticidbuf[SFS_DBPERIDB];
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t *idbuf;
 	daddr_t block;
 	daddr_t idblock;
 	uint32_t idnum, idoff;
 	int result;
 
-	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
+	KASSERT(sizeof(staticidbuf)==SFS_BLOCKSIZE);
 
-	/* Since we're using a static buffer, we'd better be locked. */
-	KASSERT(vfs_biglock_do_i_hold());
+	/*
+	 * The static buffer is covered by the big lock. Reads come
+	 * through here without it (see sfs_read) and only ever read
+	 * the indirect block, so they use a buffer of their own.
+	 */
+	KASSERT(vfs_biglock_do_i_hold() || !doalloc);
 
 	/*
 	 * If the block we want is one of the direct blocks...
@@ -135,7 +141,18 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		*diskblock = 0;
 		return 0;
 	}
-	else if (idblock==0) {
+
+	if (vfs_biglock_do_i_hold()) {
+		idbuf = staticidbuf;
+	}
+	else {
+		idbuf = kmalloc(SFS_BLOCKSIZE);
+		if (idbuf == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	if (idblock==0) {
 		/*
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
@@ -154,20 +171,29 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		sv->sv_dirty = true;
 
 		/* Clear the indirect block buffer */
-		bzero(idbuf, sizeof(idbuf));
+		bzero(idbuf, SFS_BLOCKSIZE);
 	}
 	else {
 		/*
 		 * We already have an indirect block allocated; load it.
 		 */
-		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_readblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
+			if (idbuf != staticidbuf) {
+				kfree(idbuf);
+			}
 			return result;
 		}
 	}
 
 	/* Get the block out of the indirect block buffer */
 	block = idbuf[idoff];
+	if (idbuf != staticidbuf) {
+		/* Not allocating, so we're done with it. */
+		KASSERT(!doalloc);
+		kfree(idbuf);
+		idbuf = NULL;
+	}
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
@@ -180,7 +206,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		idbuf[idoff] = block;
 
 		/* The indirect block is now dirty; write it back */
-		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
+		result = sfs_writeblock(sfs, idblock, idbuf, SFS_BLOCKSIZE);
 		if (result) {
 			return result;
 		}
@@ -224,6 +250,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
 
 	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
 
 	/*
 	 * Go through the direct blocks. Discard any that are
@@ -253,6 +280,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 		/* Read the indirect block */
 		result = sfs_readblock(sfs, idblock, idbuf, sizeof(idbuf));
 		if (result) {
+			rwlock_release_write(sv->sv_rwlock);
 			vfs_biglock_release();
 			return result;
 		}
@@ -283,6 +311,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 			result = sfs_writeblock(sfs, idblock, idbuf,
 						sizeof(idbuf));
 			if (result) {
+				rwlock_release_write(sv->sv_rwlock);
 				vfs_biglock_release();
 				return result;
 			}
@@ -295,6 +324,7 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 	/* Mark the inode dirty */
 	sv->sv_dirty = true;
 
+	rwlock_release_write(sv->sv_rwlock);
 	vfs_biglock_release();
 	return 0;
 }
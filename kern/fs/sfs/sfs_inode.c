@@ -35,6 +35,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <lib.h>
+#include <synch.h>
 #include <vfs.h>
 #include <sfs.h>
 #include "sfsprivate.h"
@@ -132,6 +133,7 @@ sfs_reclaim(struct vnode *v)
 	vnodearray_remove(sfs->sfs_vnodes, ix);
 
 	vnode_cleanup(&sv->sv_absvn);
+	rwlock_destroy(sv->sv_rwlock);
 
 	vfs_biglock_release();
 
@@ -189,6 +191,12 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		return ENOMEM;
 	}
 
+	sv->sv_rwlock = rwlock_create("sfs vnode");
+	if (sv->sv_rwlock == NULL) {
+		kfree(sv);
+		return ENOMEM;
+	}
+
 	/* Must be in an allocated block */
 	if (!sfs_bused(sfs, ino)) {
 		panic("sfs: Tried to load inode %u from unallocated block\n",
@@ -198,6 +206,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Read the block the inode is in */
 	result = sfs_readblock(sfs, ino, &sv->sv_i, sizeof(sv->sv_i));
 	if (result) {
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
 		return result;
 	}
@@ -235,6 +244,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	/* Call the common vnode initializer */
 	result = vnode_init(&sv->sv_absvn, ops, &sfs->sfs_absfs, sv);
 	if (result) {
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
 		return result;
 	}
@@ -246,6 +256,7 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
 	if (result) {
 		vnode_cleanup(&sv->sv_absvn);
+		rwlock_destroy(sv->sv_rwlock);
 		kfree(sv);
 		return result;
 	}
@@ -36,6 +36,8 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <thread.h>
+#include <current.h>
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
@@ -62,7 +64,8 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 	int result;
 	int tries=0;
 
-	KASSERT(vfs_biglock_do_i_hold());
+	/* Reads of file data come through without the big lock. */
+	KASSERT(uio->uio_rw == UIO_READ || vfs_biglock_do_i_hold());
 
 	DEBUG(DB_SFS, "sfs: %s %llu\n",
 	      uio->uio_rw == UIO_READ ? "read" : "write",
@@ -95,6 +98,15 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 				uio->uio_offset / SFS_BLOCKSIZE, tries);
 		}
 	}
+	if (result == 0) {
+		/* Count it against whoever asked, for getrusage. */
+		if (uio->uio_rw == UIO_READ) {
+			curthread->t_usage.tu_inblock++;
+		}
+		else {
+			curthread->t_usage.tu_oublock++;
+		}
+	}
 	return result;
 }
 
@@ -154,9 +166,10 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	 * you would get space from the disk buffer cache for this,
 	 * not use a static area.
 	 */
-	static char iobuf[SFS_BLOCKSIZE];
+	static char staticiobuf[SFS_BLOCKSIZE];
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	char *iobuf;
 	daddr_t diskblock;
 	uint32_t fileblock;
 	int result;
@@ -166,8 +179,20 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
-	/* We're using a global static buffer; it had better be locked */
-	KASSERT(vfs_biglock_do_i_hold());
+	/*
+	 * The global static buffer is covered by the big lock. Reads
+	 * don't hold it (see sfs_read), so they get their own.
+	 */
+	if (vfs_biglock_do_i_hold()) {
+		iobuf = staticiobuf;
+	}
+	else {
+		KASSERT(uio->uio_rw == UIO_READ);
+		iobuf = kmalloc(SFS_BLOCKSIZE);
+		if (iobuf == NULL) {
+			return ENOMEM;
+		}
+	}
 
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
@@ -175,7 +200,7 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	/* Get the disk block number */
 	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
 	if (result) {
-		return result;
+		goto out;
 	}
 
 	if (diskblock == 0) {
@@ -184,15 +209,15 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 		 * Zero the buffer.
 		 */
 		KASSERT(uio->uio_rw == UIO_READ);
-		bzero(iobuf, sizeof(iobuf));
+		bzero(iobuf, SFS_BLOCKSIZE);
 	}
 	else {
 		/*
 		 * Read the block.
 		 */
-		result = sfs_readblock(sfs, diskblock, iobuf, sizeof(iobuf));
+		result = sfs_readblock(sfs, diskblock, iobuf, SFS_BLOCKSIZE);
 		if (result) {
-			return result;
+			goto out;
 		}
 	}
 
@@ -201,20 +226,24 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	 */
 	result = uiomove(iobuf+skipstart, len, uio);
 	if (result) {
-		return result;
+		goto out;
 	}
 
 	/*
 	 * If it was a write, write back the modified block.
 	 */
 	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
+		result = sfs_writeblock(sfs, diskblock, iobuf, SFS_BLOCKSIZE);
 		if (result) {
-			return result;
+			goto out;
 		}
 	}
 
-	return 0;
+ out:
+	if (iobuf != staticiobuf) {
+		kfree(iobuf);
+	}
+	return result;
 }
 
 /*
@@ -38,7 +38,9 @@
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
+#include <synch.h>
 #include <vfs.h>
+#include <poll.h>
 #include <sfs.h>
 #include "sfsprivate.h"
 
@@ -92,6 +94,11 @@ sfs_eachopendir(struct vnode *v, int openflags)
 
 /*
  * Called for read(). sfs_io() does the work.
+ *
+ * Reads don't take the big lock, only a read hold on the vnode's
+ * rwlock, so reads of the same or different files can proceed in
+ * parallel. Everything that changes a file's size or block map
+ * holds the rwlock for writing.
  */
 static
 int
@@ -102,9 +109,9 @@ sfs_read(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_READ);
 
-	vfs_biglock_acquire();
+	rwlock_acquire_read(sv->sv_rwlock);
 	result = sfs_io(sv, uio);
-	vfs_biglock_release();
+	rwlock_release_read(sv->sv_rwlock);
 
 	return result;
 }
@@ -121,8 +128,11 @@ sfs_write(struct vnode *v, struct uio *uio)
 
 	KASSERT(uio->uio_rw==UIO_WRITE);
 
+	/* Lock order: big lock, then the vnode. */
 	vfs_biglock_acquire();
+	rwlock_acquire_write(sv->sv_rwlock);
 	result = sfs_io(sv, uio);
+	rwlock_release_write(sv->sv_rwlock);
 	vfs_biglock_release();
 
 	return result;
@@ -591,6 +601,7 @@ const struct vnode_ops sfs_fileops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopready_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -625,6 +636,7 @@ const struct vnode_ops sfs_dirops = {
 	.vop_getdirentry = vopfail_uio_nosys,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vopready_poll,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
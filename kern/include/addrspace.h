@@ -35,12 +35,35 @@
  */
 
 
+#include <limits.h>
+#include <spinlock.h>
 #include <vm.h>
 #include "opt-dumbvm.h"
 
 struct vnode;
 
 
+/*
+ * User stacks.
+ *
+ * The main stack is a fixed VM_STACKPAGES pages just below USERSTACK.
+ * Each further thread of a multithreaded process (thread ids 1 and
+ * up, THREADS_MAX in all) gets AS_TSTACKPAGES pages below that, in
+ * order, with an unmapped guard page under each one so overflowing a
+ * stack faults instead of running into the next. Thread stack pages
+ * are allocated when first touched. The heap must stay below
+ * AS_TSTACKBASE, the bottom of the lowest one.
+ */
+#define VM_STACKPAGES    18
+#define AS_TSTACKPAGES   16
+#define AS_TSTACKSLOTS   (THREADS_MAX - 1)
+#define AS_TSTACKTOP(tid) \
+	(USERSTACK - VM_STACKPAGES * PAGE_SIZE - \
+	 ((tid) - 1) * (AS_TSTACKPAGES + 1) * PAGE_SIZE)
+#define AS_TSTACKBASE \
+	(AS_TSTACKTOP(AS_TSTACKSLOTS) - AS_TSTACKPAGES * PAGE_SIZE)
+
+
 /*
  * Address space - data structure associated with the virtual memory
  * space of a process.
@@ -72,7 +95,15 @@ struct addrspace {
         
         paddr_t *as_stackbase;
 
+        // thread stack pages, AS_TSTACKSLOTS * AS_TSTACKPAGES of them,
+        // 0 until touched; NULL until the first thread is created
+        paddr_t *as_tstacks;
+
         bool elf_loaded;        // indicate whether ELF is loaded or not
+
+        // for threads sharing the address space: protects the heap
+        // break and fault-time allocation of heap and thread stack pages
+        struct spinlock as_lock;
 #endif
 };
 
@@ -112,6 +143,15 @@ struct addrspace {
  *    as_define_stack - set up the stack region in the address space.
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
+ *                The top NARGPAGES pages of the stack are the pages
+ *                at ARGPAGES (from alloc_kpages, split with
+ *                vm_splitkpages), which on success belong to the
+ *                address space; the stack pointer is just below them.
+ *
+ *    as_define_tstack - set up the stack for thread TID (1 and up) of
+ *                a multithreaded process. Hands back its initial
+ *                stack pointer. May be called again for the same TID
+ *                when the id is reused; the stack is not cleared.
  *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
@@ -130,7 +170,10 @@ int               as_define_region(struct addrspace *as,
                                    int executable);
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
-int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_stack(struct addrspace *as, vaddr_t argpages,
+                                  unsigned nargpages, vaddr_t *initstackptr);
+int               as_define_tstack(struct addrspace *as, int tid,
+                                   vaddr_t *initstackptr);
 
 
 /*
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _CALLOUT_H_
+#define _CALLOUT_H_
+
+/*
+ * Callouts: functions to be called after a given number of hardclock
+ * ticks.
+ *
+ * The caller supplies the storage for a callout, sets it up once with
+ * callout_init, and then may schedule and cancel it as often as it
+ * likes. The function is called from the timer interrupt handler, so
+ * it must not sleep; it is called with no spinlocks held.
+ *
+ * Pending callouts are kept in a hierarchical timer wheel, so
+ * scheduling, cancelling, and the per-tick work are all constant time
+ * regardless of how many callouts are pending. Delays of more than
+ * CALLOUT_MAXTICKS are silently shortened to CALLOUT_MAXTICKS.
+ */
+
+struct callout {
+	void (*co_func)(void *);	/* function to call */
+	void *co_arg;			/* argument to pass it */
+	unsigned co_expire;		/* tick at which to call it */
+	bool co_pending;		/* true if on the wheel */
+	struct callout *co_next;	/* next in wheel slot */
+	struct callout **co_prevp;	/* pointer to us in wheel slot */
+};
+
+/* 4 levels of 64 slots each: 2^24 ticks, about 46 hours at HZ=100 */
+#define CALLOUT_MAXTICKS  ((1U << 24) - 1)
+
+/* Call once during system startup. */
+void callout_bootstrap(void);
+
+/* Set up a callout to call FUNC(ARG). */
+void callout_init(struct callout *co, void (*func)(void *), void *arg);
+
+/*
+ * Arrange for the callout to be called on the TICKS-th hardclock from
+ * now (a TICKS of 0 is taken as 1). If it was already pending, it is
+ * rescheduled.
+ */
+void callout_schedule(struct callout *co, unsigned ticks);
+
+/*
+ * Cancel a callout. Returns true if it was pending and now won't be
+ * called. If the function is running on another cpu, waits for it to
+ * finish, so that when this returns the callout can be freed.
+ * Consequently this must not be called from the callout's own
+ * function, or while holding a spinlock that function takes.
+ */
+bool callout_cancel(struct callout *co);
+
+/* Called from hardclock() to run expired callouts. */
+void callout_hardclock(void);
+
+/*
+ * Tickless idle: callout_idle(maxticks) returns how many ticks (at
+ * most MAXTICKS) the clock may stop for; callout_wake(n) is called
+ * when it starts again to process the N ticks skipped. (For clock.c.)
+ */
+unsigned callout_idle(unsigned maxticks);
+void callout_wake(unsigned skipped);
+
+
+#endif /* _CALLOUT_H_ */
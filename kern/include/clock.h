@@ -48,6 +48,16 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle: an idle cpu calls hardclock_idle_begin() before
+ * waiting for an interrupt and hardclock_idle_end() after, which may
+ * stop its hardclocks meanwhile. Set hardclock_tickless to 0 to
+ * disable.
+ */
+void hardclock_idle_begin(void);
+void hardclock_idle_end(void);
+extern unsigned hardclock_tickless;
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
@@ -79,5 +89,12 @@ void timespec_sub(const struct timespec *t1,
  */
 void clocksleep(int seconds);
 
+/*
+ * ticksleep() suspends execution for the requested number of
+ * hardclocks, that is, in units of 1/HZ seconds. It returns 0, or
+ * EINTR if it's cut short because the current process is exiting.
+ */
+int ticksleep(unsigned ticks);
+
 
 #endif /* _CLOCK_H_ */
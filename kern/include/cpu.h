@@ -59,8 +59,18 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
+	struct workqueue *c_workqueue;	/* This cpu's work queue */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	unsigned c_steals;		/* Threads pulled from other cpus */
+	unsigned c_pushes;		/* Threads pushed to other cpus */
+	unsigned c_stretch;		/* Length of tickless period, or 0 */
+	unsigned c_timerints;		/* Timer interrupts taken */
+	unsigned c_skippedticks;	/* Hardclocks skipped while tickless */
+	unsigned c_lockspins;		/* Locks got by spinning (synch.c) */
+	unsigned c_lockspinfails;	/* ...spun, but had to sleep anyway */
+	unsigned c_locksleeps;		/* ...slept without spinning */
 
 	/*
 	 * Accessed by other cpus.
@@ -69,6 +79,16 @@ struct cpu {
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
+	unsigned c_rqlocks;		/* Times the run queue was locked */
+	unsigned c_rqcontended;		/* ...and of those, had to wait */
+	unsigned c_inboxwakes;		/* Wakeups that came via c_inbox */
+
+	/*
+	 * Accessed by other cpus without locking.
+	 * Remote wakeups are pushed here lock-free (see thread.c); only
+	 * this cpu takes them off, linked through t_inboxnext.
+	 */
+	struct thread *volatile c_inbox;
 
 	/*
 	 * Accessed by other cpus.
@@ -35,28 +35,44 @@
 #define _FILETABLE_H_
 
 #include <limits.h> /* for OPEN_MAX */
+#include <spinlock.h>
 
 
 /*
- * The file table is an array of open files.
+ * Open file limits. A process starts out allowed OPEN_MAX files,
+ * which it can raise with setrlimit(RLIMIT_NOFILE) as far as its hard
+ * limit; that starts out FILETABLE_MAX and can only be lowered. Both
+ * are inherited across fork.
+ */
+#define FILETABLE_MAX		1024
+
+/*
+ * The file table is an array of open files. It starts empty and is
+ * grown (by doubling) when a file is placed past the end, up to the
+ * process's limit.
  *
- * There is no particular reason to use a fixed size array (of size
- * OPEN_MAX) instead of a dynamically sized array (using array.h) --
- * the code was just written this way years ago and there's no
- * compelling reason to change it that outweighs this benefit: you can
- * look through the code to see what it would take to make it dynamic,
- * or even to make it dynamic with the limit being user-settable. (See
- * setrlimit(2) on a Unix machine.)
+ * To keep finding the lowest free slot cheap, ft_lowfree records a
+ * point below which there are no free slots; and so that copying it
+ * costs in proportion to what's open rather than to its size, ft_top
+ * records a point at and above which nothing is open.
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * The threads of a multithreaded process share the file table, so
+ * the slots are protected by ft_lock. On fork, the table is copied.
+ *
+ * One thread may close a file handle while another is in the middle
+ * of e.g. read() using it. To make that safe, filetable_get takes a
+ * reference to the openfile along with looking it up, and
+ * filetable_put drops it; the file stays open until the read
+ * finishes, even though the handle is gone from the table.
  */
 struct filetable {
-	struct openfile *ft_openfiles[OPEN_MAX];
+	struct spinlock ft_lock;
+	struct openfile **ft_openfiles;	/* the table */
+	unsigned ft_size;		/* slots in ft_openfiles */
+	unsigned ft_lowfree;		/* all slots below this in use */
+	unsigned ft_top;		/* no slots at or above this in use */
+	unsigned ft_limit;		/* RLIMIT_NOFILE soft limit */
+	unsigned ft_hardlimit;		/* RLIMIT_NOFILE hard limit */
 };
 
 /*
@@ -65,26 +81,38 @@ struct filetable {
  * create -  Construct an empty file table.
  * destroy - Wipe out a file table, closing anything open in it.
  * copy -    Clone a file table.
+ * remap -   Make a new table from a list of another table's fds.
  * okfd -    Check if a file handle is in range.
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
- *           is not NULL.) Call put with the file returned from get.
+ *           is not NULL, and holds a reference until put.) Call put
+ *           with the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
  *           previously there.
+ * unplace - Remove a file placed earlier, if it's still where it was
+ *           put; returns false (and does nothing) if not.
+ * getlimit/setlimit - Get or set the soft and hard limits on the
+ *           number of file handles.
  */
 
 struct filetable *filetable_create(void);
 void filetable_destroy(struct filetable *ft);
 int filetable_copy(struct filetable *src, struct filetable **dest_ret);
+int filetable_remap(struct filetable *src, const int *fds, int nfds,
+		    struct filetable **dest_ret);
 
 bool filetable_okfd(struct filetable *ft, int fd);
 int filetable_get(struct filetable *ft, int fd, struct openfile **ret);
 void filetable_put(struct filetable *ft, int fd, struct openfile *file);
 
 int filetable_place(struct filetable *ft, struct openfile *file, int *fd);
-void filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
-		       struct openfile **oldfile_ret);
+int filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
+		      struct openfile **oldfile_ret);
+bool filetable_unplace(struct filetable *ft, int fd, struct openfile *file);
+
+void filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max);
+int filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max);
 
 
 #endif /* _FILETABLE_H_ */
@@ -79,14 +79,17 @@
 /* Max value for a process ID (change this to match your implementation) */
 #define __PID_MAX       32767
 
-/* Max open files per process */
+/* Default limit on open files per process (see setrlimit) */
 #define __OPEN_MAX      32
 
 /* Max bytes for atomic pipe I/O -- see description in the pipe() man page */
 #define __PIPE_BUF      512
 
 /* Max number of processes at once. */
-#define __PROCS_MAX       128
+#define __PROCS_MAX       4096
+
+/* Max number of threads in one process */
+#define __THREADS_MAX   32
 
 
 /*
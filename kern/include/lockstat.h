@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * With "options lockstat" in the kernel config, spinlocks, locks,
+ * rwlocks, CVs and semaphores count how often they are taken, how
+ * often the taker had to wait, the total time spent waiting, and the
+ * longest time one was held. Counts are kept per lock name, so all
+ * the locks called "sfs vnode" add up together; spinlocks are named
+ * with spinlock_setname() or SPINLOCK_NAMED_INITIALIZER, and ones
+ * that aren't all count as "spinlock". For CVs and semaphores a
+ * wait is a cv_wait or a P that slept, and there is no hold time.
+ *
+ * Nothing is recorded until lockstat_bootstrap, which must be after
+ * the clock device is attached.
+ *
+ * lockstat_get   - find (or make) the record for NAME. Never fails;
+ *                  if the table is full, returns a catch-all record.
+ * lockstat_now   - current time in nanoseconds, or 0 if not yet
+ *                  recording.
+ * lockstat_acquired - count one acquisition that waited WAITNSECS,
+ *                  and whether it had to wait at all.
+ * lockstat_released - count a hold time.
+ * lockstat_dump  - print the records, most contended first.
+ * lockstat_reset - zero all the counts, e.g. between benchmark runs.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+struct lockstat;	/* Opaque. */
+
+void lockstat_bootstrap(void);
+struct lockstat *lockstat_get(const char *name);
+uint64_t lockstat_now(void);
+void lockstat_acquired(struct lockstat *ls, bool contended,
+		       uint64_t waitnsecs);
+void lockstat_released(struct lockstat *ls, uint64_t holdnsecs);
+void lockstat_dump(void);
+void lockstat_reset(void);
+
+#endif /* OPT_LOCKSTAT */
+
+
+#endif /* _LOCKSTAT_H_ */
@@ -55,6 +55,14 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Slow the timer down to one interrupt TICKS hardclock periods after
+ * the last, and go back to the normal rate, returning the number of
+ * periods that have elapsed. (Low-level; for tickless idle.)
+ */
+void mainbus_timer_stretch(unsigned ticks);
+unsigned mainbus_timer_unstretch(unsigned ticks);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
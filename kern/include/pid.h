@@ -34,6 +34,7 @@
 #ifndef _PID_H_
 #define _PID_H_
 
+struct threadusage;	/* from <thread.h> */
 
 #define INVALID_PID	0	/* nothing has this pid */
 #define KERNEL_PID	1	/* kernel proc has this pid */
@@ -59,14 +60,18 @@ void pid_unalloc(pid_t targetpid);
 void pid_disown(pid_t targetpid);
 
 /*
- * Set the exit status of the current thread to status.  Wakes up any threads
- * waiting to read this status, and decrefs the current thread's pid.
+ * Set the exit status of the current thread to status, and its resource
+ * usage (to be added to the parent's when it waits) to usage.  Wakes up
+ * any threads waiting to read this status, and decrefs the current
+ * thread's pid.
  */
-void pid_setexitstatus(int status);
+void pid_setexitstatus(int status, const struct threadusage *usage);
 
 /*
- * Causes the current thread to wait for the thread with pid PID to
- * exit, returning the exit status when it does.
+ * Causes the current thread to wait for the thread with pid PID (or,
+ * if PID is WAIT_ANY, for any child) to exit, returning the exit
+ * status and the pid when it does. Fails with EINTR if the current
+ * process starts exiting meanwhile.
  */
 int pid_wait(pid_t targetpid, int *status, int flags, pid_t *retpid);
 
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Kernel support for poll().
+ *
+ * A thread can only sleep on one wait channel at a time, but poll()
+ * needs to wait for any of several objects. So each call to poll()
+ * makes a pollwaiter, with its own wait channel, and registers it on
+ * a pollqueue in each object it's waiting for; when an object becomes
+ * ready it wakes everything registered on its pollqueue.
+ *
+ * The readiness check is the vnode op VOP_POLL(vn, events, pw,
+ * revents): it sets *revents to the subset of EVENTS (plus POLLERR
+ * and POLLHUP, always) that are ready now. If PW is not NULL it also
+ * calls pollwaiter_add(pw, pq), at most once, with the pollqueue the
+ * object will wake when any of EVENTS becomes ready. To avoid missing
+ * a wakeup, it must do that either before checking, or while holding
+ * whatever lock it also holds when calling pollqueue_wakeup.
+ */
+
+#include <kern/poll.h>
+#include <spinlock.h>
+
+struct pollentry;		/* Private */
+struct vnode;			/* from <vnode.h> */
+struct wchan;			/* from <wchan.h> */
+
+/*
+ * Kept by each object that can be waited for.
+ */
+struct pollqueue {
+	struct spinlock pq_lock;
+	struct pollentry *pq_entries;	/* registered waiters */
+};
+
+/*
+ * Made by each poll() call.
+ */
+struct pollwaiter {
+	struct spinlock pw_lock;
+	struct wchan *pw_wchan;
+	bool pw_woken;			/* a queue it's on was woken */
+	struct pollentry *pw_entries;	/* one per queue it can be on */
+	unsigned pw_nentries;		/* number in use */
+	unsigned pw_maxentries;		/* number allocated */
+};
+
+/*
+ * Pollqueue ops:
+ *
+ * init/cleanup - Set up and tear down; on cleanup nothing may be
+ *                registered.
+ * wakeup -       Wake all pollwaiters registered. May be called in an
+ *                interrupt handler.
+ */
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+void pollqueue_wakeup(struct pollqueue *pq);
+
+/*
+ * Pollwaiter ops:
+ *
+ * create/destroy - Make or free a pollwaiter that can be registered
+ *                  on up to MAXQUEUES queues at once.
+ * add -            Register on a queue (for VOP_POLL). Does nothing
+ *                  if PW is NULL.
+ * clear -          Unregister from everything and forget any wakeup.
+ * sleep -          Sleep until woken, unless already woken since the
+ *                  last clear; give up after TICKS hardclocks if TICKS
+ *                  isn't 0. Returns 0 or ETIMEDOUT, or EINTR if the
+ *                  process starts exiting.
+ */
+struct pollwaiter *pollwaiter_create(unsigned maxqueues);
+void pollwaiter_destroy(struct pollwaiter *pw);
+void pollwaiter_add(struct pollwaiter *pw, struct pollqueue *pq);
+void pollwaiter_clear(struct pollwaiter *pw);
+int pollwaiter_sleep(struct pollwaiter *pw, unsigned ticks);
+
+/*
+ * VOP_POLL for objects whose I/O never waits, such as regular files.
+ */
+int vopready_poll(struct vnode *vn, int events, struct pollwaiter *pw,
+		  int *revents);
+
+
+#endif /* _POLL_H_ */
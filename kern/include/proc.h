@@ -36,11 +36,27 @@
  * Note: curproc is defined by <current.h>.
  */
 
+#include <limits.h>
 #include <spinlock.h>
 #include <thread.h> /* required for struct threadarray */
 
 struct addrspace;
 struct vnode;
+struct wchan;
+
+/*
+ * User threads. A thread's id (t_tid) indexes p_uthreads. Thread 0
+ * is the one the process started with; the others run on the extra
+ * stacks set aside in the address space (see as_define_tstack).
+ *
+ * A slot stays in use after its thread exits until some other thread
+ * collects its return value with thread_join.
+ */
+struct uthread {
+	bool ut_inuse;			/* id taken */
+	bool ut_exited;			/* thread is gone; ut_retval valid */
+	userptr_t ut_retval;		/* what it passed to thread_exit */
+};
 
 /*
  * Process structure.
@@ -58,6 +74,16 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
 
+	/* Accounting (see proc_getusage) */
+	struct threadusage p_usage;	/* used by threads no longer here */
+	struct threadusage p_cusage;	/* used by children waited for */
+
+	/* User threads (protected by p_lock) */
+	struct uthread p_uthreads[THREADS_MAX];
+	struct wchan *p_joinchan;	/* for thread_join */
+	bool p_exiting;			/* _exit called; threads leaving */
+	int p_exitstatus;		/* status to exit with (ditto) */
+
 	/* add more material here as needed */
 };
 
@@ -73,7 +99,10 @@ int proc_create_runprogram(const char *name, struct proc **ret);
 /* Create a fresh process for use by fork() */
 int proc_fork(struct proc **ret);
 
-/* Undo proc_fork if nothing's run in the new process yet. */
+/* Create a fresh process for use by spawnv() */
+int proc_spawn(const int *fds, int nfds, struct proc **ret);
+
+/* Undo proc_fork or proc_spawn if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
 
 /* Destroy a process. */
@@ -81,12 +110,42 @@ void proc_destroy(struct proc *proc);
 
 /*
  * Cause the current process to exit. The current thread switches
- * itself into the kernel process.
+ * itself into the kernel process. Does not return.
+ *
+ * If the process has other threads, any in interruptible sleeps
+ * (see wchan_sleep_intr) are woken; they leave as they next return
+ * to user mode (see proc_checkexit) and the last one out finishes
+ * the job. The status given by the first caller is the one reported.
  *
  * The status code should be prepared with one of the _MKWAIT macros
  * defined in <kern/wait.h>.
  */
-void proc_exit(int status);
+__DEAD void proc_exit(int status);
+
+/*
+ * User thread support.
+ *
+ * proc_thread_alloc - reserve a thread id in the current process.
+ * proc_thread_unalloc - give back an id if the thread couldn't start.
+ * proc_thread_exit - make the current thread leave the process,
+ *                    leaving RETVAL for thread_join. If it's the last
+ *                    one, the process exits with status 0.
+ * proc_thread_join - wait for thread TID to exit and collect its
+ *                    return value.
+ * proc_checkexit - call on the way back to user mode; if the process
+ *                  is exiting, leave instead of returning.
+ * proc_exec_threads - check that the current process has only one
+ *                     thread, for execv; returns EBUSY if not.
+ * proc_exec_done - after a successful execv, make the calling thread
+ *                  thread 0 again.
+ */
+int proc_thread_alloc(int *tid);
+void proc_thread_unalloc(int tid);
+__DEAD void proc_thread_exit(userptr_t retval);
+int proc_thread_join(int tid, userptr_t *retval);
+void proc_checkexit(void);
+int proc_exec_threads(void);
+void proc_exec_done(void);
 
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
@@ -94,6 +153,20 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Get the resources used so far by a process's threads, past and
+ * present. (Its children's are in p_cusage.)
+ */
+void proc_getusage(struct proc *proc, struct threadusage *ret);
+
+/*
+ * Set the cpu affinity of all of a process's threads. Returns EINVAL
+ * if the mask names no cpu that exists. The current thread may still
+ * be on a cpu it's not allowed on afterwards; see
+ * thread_affinity_enforce.
+ */
+int proc_setaffinity(struct proc *proc, cpumask_t affinity);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -45,24 +45,48 @@
 /* Get the machine-dependent bits. */
 #include <machine/spinlock.h>
 
+#include <lockstat.h>
+
 /*
  * Basic spinlock.
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * Spinlocks are ticket locks, so cpus get the lock in the order they
+ * asked for it: acquire takes the next number from splk_next and
+ * waits until splk_serving reaches it, and release moves
+ * splk_serving on. Each waiter knows how many cpus are ahead of it
+ * and backs off in proportion (see spinlock_backoff), rather than
+ * all of them hammering the lock word at once.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
-	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
-	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	volatile spinlock_data_t splk_next;    /* Next ticket to hand out. */
+	volatile spinlock_data_t splk_serving; /* Ticket that has the lock. */
+	struct cpu *splk_holder;	       /* CPU holding this lock. */
+#if OPT_LOCKSTAT
+	const char *splk_name;		       /* Name for lockstat. */
+	struct lockstat *splk_stat;	       /* Stats, once looked up. */
+	uint64_t splk_holdstart;	       /* When it was acquired. */
+#endif
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * The named form gives it a name for lockstat.
  */
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#if OPT_LOCKSTAT
+#define SPINLOCK_NAMED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL, \
+	  name, NULL, 0 }
+#else
+#define SPINLOCK_NAMED_INITIALIZER(name) \
+	{ SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER, NULL }
+#endif
+#define SPINLOCK_INITIALIZER	SPINLOCK_NAMED_INITIALIZER(NULL)
 
 /*
  * Spinlock functions.
@@ -71,18 +95,33 @@ struct spinlock {
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
+ * tryacquire	Get the lock if it's free and return true; otherwise
+ *		return false at once.
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Give the lock a name for lockstat (see lockstat.h). The
+ *		string is not copied. Does nothing without lockstat.
  */
 
 void spinlock_init(struct spinlock *lk);
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
+bool spinlock_tryacquire(struct spinlock *lk);
 void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+void spinlock_setname(struct spinlock *lk, const char *name);
+
+/*
+ * spinlock_backoff - how long a waiting cpu pauses between looks at
+ * the lock, in delay-loop turns per cpu ahead of it in line. 0 means
+ * spin flat out.
+ */
+extern unsigned spinlock_backoff;
+
 
 #endif /* _SPINLOCK_H_ */
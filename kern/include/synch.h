@@ -32,6 +32,9 @@
 
 /*
  * Header file for synchronization primitives.
+ *
+ * With "options lockstat", all of these report contention under
+ * their names; see lockstat.h.
  */
 
 
@@ -48,6 +51,9 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile unsigned sem_count;
+#if OPT_LOCKSTAT
+	struct lockstat *sem_stat;
+#endif
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
@@ -58,8 +64,12 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_intr is P for sleeps on behalf of a user process: it fails with
+ * EINTR, leaving the count alone, if the process starts exiting.
  */
 void P(struct semaphore *);
+int P_intr(struct semaphore *);
 void V(struct semaphore *);
 
 
@@ -77,6 +87,10 @@ struct lock {
 	struct wchan *lk_wchan;
 	struct spinlock lk_lock;
 	struct thread *volatile lk_holder;
+#if OPT_LOCKSTAT
+	struct lockstat *lk_stat;
+	uint64_t lk_holdstart;		/* when the holder got it */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -97,6 +111,16 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Locks are adaptive: if the holder is running on another cpu, it
+ * will likely let go soon, so lock_acquire spins for up to
+ * lock_spinmax turns waiting for that instead of going to sleep. If
+ * the holder isn't running, or stops, it sleeps. 0 turns spinning
+ * off. How waits turned out is counted per cpu (see "ts" in the
+ * menu).
+ */
+extern unsigned lock_spinmax;
+
 
 /*
  * Condition variable.
@@ -116,6 +140,9 @@ struct cv {
         char *cv_name;
 	struct wchan *cv_wchan;
 	struct spinlock cv_wchanlock;
+#if OPT_LOCKSTAT
+	struct lockstat *cv_stat;
+#endif
 };
 
 struct cv *cv_create(const char *name);
@@ -133,10 +160,73 @@ void cv_destroy(struct cv *);
  * on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
+ *
+ * cv_wait_intr is like cv_wait, but returns EINTR (with the lock
+ * reacquired) if the current process starts exiting; see P_intr.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_intr(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * too, so a steady stream of readers can't starve writers out.
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rwl_name;
+	struct wchan *rwl_rwchan;		/* readers wait here */
+	struct wchan *rwl_wwchan;		/* writers wait here */
+	struct wchan *rwl_upwchan;		/* an upgrader waits here */
+	struct spinlock rwl_lock;
+	volatile unsigned rwl_readers;		/* readers holding it */
+	volatile unsigned rwl_writerswaiting;	/* incl. an upgrader */
+	struct thread *volatile rwl_writer;	/* writer holding it */
+	volatile bool rwl_upgrading;		/* a reader is upgrading */
+#if OPT_LOCKSTAT
+	struct lockstat *rwl_stat;
+	uint64_t rwl_holdstart;			/* when the writer got it */
+#endif
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing.
+ *    rwlock_release_write - Give up a write hold. Only the thread
+ *                           holding it may do this.
+ *    rwlock_upgrade       - Turn a read hold into a write hold,
+ *                           waiting for the other readers to leave.
+ *                           Only one reader can do this at a time;
+ *                           if another is already upgrading, fails
+ *                           and returns false, still holding the
+ *                           read lock. (Then release it and call
+ *                           rwlock_acquire_write, and recheck what
+ *                           was read.)
+ *    rwlock_downgrade     - Turn a write hold into a read hold,
+ *                           without letting a writer in between.
+ *    rwlock_do_i_hold_write - Return true if the current thread
+ *                           holds the lock for writing. (Readers
+ *                           aren't tracked.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_upgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
@@ -36,11 +36,13 @@
  * Note: curthread is defined by <current.h>.
  */
 
+#include <kern/time.h>
 #include <array.h>
 #include <spinlock.h>
 #include <threadlist.h>
 
 struct cpu;
+struct wchan;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -56,6 +58,14 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Cpu affinity masks: bit N is set if a thread may run on cpu N.
+ * (MAXCPUS is 32.) Bits for cpus that don't exist are ignored.
+ */
+typedef uint32_t cpumask_t;
+#define CPUMASK_ALL	((cpumask_t)0xffffffff)
+#define CPUMASK_CPU(n)	((cpumask_t)1 << (n))
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -64,6 +74,24 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Resource usage of a thread, or summed over threads. tu_runtime is
+ * measured at each context switch; the hardclock samples in
+ * tu_uticks and tu_sticks are only used to split it into user and
+ * system time. See proc_getusage.
+ */
+struct threadusage {
+	struct timespec tu_runtime;	/* Time spent on a cpu */
+	unsigned tu_uticks;		/* Hardclocks that found it in user mode */
+	unsigned tu_sticks;		/* Hardclocks that found it in the kernel */
+	unsigned tu_nvcsw;		/* Voluntary context switches */
+	unsigned tu_nivcsw;		/* Involuntary (preemptive) switches */
+	unsigned tu_minflt;		/* Page faults handled without I/O */
+	unsigned tu_majflt;		/* Page faults that needed I/O */
+	unsigned tu_inblock;		/* File system blocks read */
+	unsigned tu_oublock;		/* File system blocks written */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -84,6 +112,30 @@ struct thread {
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
 
+	/*
+	 * Scheduler fields. See the notes on the multi-level feedback
+	 * queue in thread.c. These are touched only by the cpu the
+	 * thread is running on, or under the run queue lock of the
+	 * cpu whose run queue it is on.
+	 */
+	unsigned t_priority;		/* Queue level; 0 is the highest */
+	unsigned t_ticks;		/* Hardclocks used of current slice */
+	unsigned t_age;			/* schedule() passes spent waiting */
+	unsigned t_migrated;		/* t_cpu's hardclock at last move */
+	unsigned t_nmigrations;		/* Number of times moved */
+	struct cpu *t_lastcpu;		/* Cpu it last ran on */
+	unsigned t_lastran;		/* t_lastcpu's hardclock when it did */
+	cpumask_t t_affinity;		/* Cpus it may run on */
+	struct thread *t_inboxnext;	/* Link for a cpu's wakeup inbox */
+
+	/*
+	 * Accounting fields. These are only changed by the thread
+	 * itself, or by its cpu while it's running, so they need no
+	 * locking; others may read them for statistics.
+	 */
+	struct threadusage t_usage;	/* Resources used so far */
+	struct timespec t_runstamp;	/* When it last got a cpu */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -98,13 +150,25 @@ struct thread {
 	 * rather than per-cpu or global?
 	 */
 	bool t_in_interrupt;		/* Are we in an interrupt? */
+	bool t_intr_user;		/* ...and did it interrupt user mode? */
 	int t_curspl;			/* Current spl*() state */
 	int t_iplhigh_count;		/* # of times IPL has been raised */
 
+	/*
+	 * Interruptible sleep fields. These are protected by the
+	 * process's p_lock; see wchan_sleep_intr.
+	 */
+	struct wchan *t_intrchan;	/* Channel, if in wchan_sleep_intr */
+	struct spinlock *t_intrlock;	/* ...and its spinlock */
+	bool t_interrupted;		/* Woken by proc_exit */
+	bool t_intrbusy;		/* proc_exit is using t_intrchan */
+
 	/*
 	 * Public fields
 	 */
 
+	int t_tid;			/* Thread id in its user process */
+
 	/* add more here as needed */
 };
 
@@ -144,6 +208,35 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Same as thread_fork, but the new thread may only run on the cpus
+ * in AFFINITY instead of inheriting the current thread's affinity.
+ * It starts on one of them.
+ */
+int thread_fork_affinity(const char *name, struct proc *proc,
+			 cpumask_t affinity,
+			 void (*func)(void *, unsigned long),
+			 void *data1, unsigned long data2);
+
+/*
+ * Cpu affinity.
+ *
+ * thread_setaffinity sets the cpus thread T may run on. Returns
+ * EINVAL if none of them exist. If T is on a cpu that is no longer
+ * allowed it is moved the next time it is switched out.
+ *
+ * thread_getaffinity returns T's affinity, restricted to the cpus
+ * that exist.
+ *
+ * thread_affinity_enforce gets the current thread off the current
+ * cpu, if it isn't allowed there any more. This takes a context
+ * switch or two (a thread can't move itself while it's running) so
+ * it may not have happened yet when it returns.
+ */
+int thread_setaffinity(struct thread *t, cpumask_t affinity);
+cpumask_t thread_getaffinity(struct thread *t);
+void thread_affinity_enforce(void);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,6 +250,13 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for a clock tick, and preempt it if its
+ * time slice has run out or a better-priority thread is waiting.
+ * Called from the timer interrupt.
+ */
+void thread_tick(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
@@ -168,5 +268,43 @@ void schedule(void);
  */
 void thread_consider_migration(void);
 
+/*
+ * Print per-cpu scheduler statistics; count timer interrupts taken.
+ */
+void thread_printstats(void);
+unsigned thread_timerints(void);
+
+/*
+ * Resource usage. thread_getusage returns what thread T has used,
+ * including the time it has been running for if it's on a cpu right
+ * now; threadusage_add adds FROM into TO.
+ */
+void thread_getusage(struct thread *t, struct threadusage *ret);
+void threadusage_add(struct threadusage *to, const struct threadusage *from);
+
+/*
+ * Cpu placement tunables.
+ *
+ * sched_cachehot   - hardclocks after it last ran that a thread is
+ *                    considered cache-hot and not moved
+ * sched_holdoff    - hardclocks after being moved before a thread may
+ *                    be moved again
+ * sched_wakeaffine - if nonzero, a woken thread whose cpu is busy may
+ *                    be moved to the waking thread's cpu
+ * sched_inbox      - if nonzero, wakeups for another cpu go through
+ *                    its lock-free inbox instead of taking its run
+ *                    queue lock
+ */
+extern unsigned sched_cachehot;
+extern unsigned sched_holdoff;
+extern unsigned sched_wakeaffine;
+extern unsigned sched_inbox;
+
+/*
+ * Number of exited threads (with stacks) each cpu keeps for reuse by
+ * thread_fork; 0 to disable.
+ */
+extern unsigned thread_cache_max;
+
 
 #endif /* _THREAD_H_ */
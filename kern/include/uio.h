@@ -144,5 +144,13 @@ void uio_kinit(struct iovec *, struct uio *,
 void uio_uinit(struct iovec *, struct uio *,
 	       userptr_t ubuf, size_t len, off_t pos, enum uio_rw rw);
 
+/*
+ * The same, for IOVCNT user buffers, as passed to readv or writev;
+ * the iovecs must already have been copied into the kernel. Fails
+ * with EINVAL if the lengths add up to more than an ssize_t can hold.
+ */
+int uio_uvinit(struct iovec *, unsigned iovcnt, struct uio *,
+	       off_t pos, enum uio_rw rw);
+
 
 #endif /* _UIO_H_ */
@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -66,6 +67,25 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Like wchan_sleep, but give up after TICKS hardclocks. Returns 0 if
+ * awakened, or ETIMEDOUT if the time ran out first.
+ */
+int timed_wchan_sleep(struct wchan *wc, struct spinlock *lk, unsigned ticks);
+
+/*
+ * Like wchan_sleep and timed_wchan_sleep, but fail with EINTR if the
+ * current process starts exiting, or already has. Use these for
+ * sleeps on behalf of a user process that may not end on their own.
+ * LK may be released and reacquired on the way out.
+ *
+ * wchan_interrupt is how proc_exit wakes them; see thread.c.
+ */
+int wchan_sleep_intr(struct wchan *wc, struct spinlock *lk);
+int timed_wchan_sleep_intr(struct wchan *wc, struct spinlock *lk,
+			   unsigned ticks);
+void wchan_interrupt(struct thread *t, struct wchan *wc, struct spinlock *lk);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Work queues: deferred function calls run by kernel worker threads.
+ *
+ * Each cpu has a queue and a worker thread. work_enqueue() may be
+ * called from any context, including interrupt handlers, and never
+ * sleeps; the function is later called from the worker thread of the
+ * cpu that queued it, where it may sleep, take locks, do I/O, and so
+ * on. Work on one queue is run in the order it was queued. Work
+ * queued on different cpus may run in any order.
+ *
+ * work_enqueue_delayed() queues the work after at least TICKS
+ * hardclocks have passed.
+ *
+ * workqueue_flush() waits until all work queued (not counting delayed
+ * work that hasn't been queued yet) before it was called has been
+ * run. workqueue_drain() waits until there is no work left at all,
+ * including delayed work and work queued by other work. Neither may
+ * be called from a work function.
+ *
+ * The enqueue functions return ENOMEM if they can't allocate memory.
+ */
+
+int work_enqueue(void (*func)(void *), void *arg);
+int work_enqueue_delayed(void (*func)(void *), void *arg, unsigned ticks);
+void workqueue_flush(void);
+void workqueue_drain(void);
+
+/*
+ * Setup: workqueue_bootstrap() is called once before starting the
+ * secondary cpus; each cpu then calls workqueue_startcpu() to create
+ * its queue and worker.
+ */
+void workqueue_bootstrap(void);
+void workqueue_startcpu(void);
+
+
+#endif /* _WORKQUEUE_H_ */
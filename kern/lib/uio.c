@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
 #include <proc.h>
@@ -185,3 +186,37 @@ uio_uinit(struct iovec *iov, struct uio *u,
 	u->uio_rw = rw;
 	u->uio_space = proc_getas();
 }
+
+/*
+ * Set up a uio for a userspace transfer over several buffers.
+ */
+
+int
+uio_uvinit(struct iovec *iov, unsigned iovcnt, struct uio *u,
+	   off_t offset, enum uio_rw rw)
+{
+	/* the largest ssize_t, which is what the total gets returned as */
+	const size_t maxtotal = ((size_t)-1) >> 1;
+	size_t total;
+	unsigned i;
+
+	DEBUGASSERT(iov != NULL || iovcnt == 0);
+	DEBUGASSERT(u != NULL);
+
+	total = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > maxtotal - total) {
+			return EINVAL;
+		}
+		total += iov[i].iov_len;
+	}
+
+	u->uio_iov = iov;
+	u->uio_iovcnt = iovcnt;
+	u->uio_offset = offset;
+	u->uio_resid = total;
+	u->uio_segflg = UIO_USERSPACE;
+	u->uio_rw = rw;
+	u->uio_space = proc_getas();
+	return 0;
+}
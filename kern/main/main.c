@@ -39,14 +39,17 @@
 #include <spl.h>
 #include <clock.h>
 #include <thread.h>
+#include <workqueue.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
 #include <device.h>
 #include <pid.h>
+#include <futex.h>
 #include <syscall.h>
 #include <test.h>
 #include <version.h>
@@ -112,6 +115,7 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	pid_bootstrap();
+	futex_bootstrap();
 	hardclock_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
@@ -124,12 +128,17 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+#if OPT_LOCKSTAT
+	/* Needs the clock. */
+	lockstat_bootstrap();
+#endif
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
 	exec_bootstrap();
+	workqueue_bootstrap();
 	thread_start_cpus();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
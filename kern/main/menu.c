@@ -37,6 +37,8 @@
 #include <uio.h>
 #include <clock.h>
 #include <thread.h>
+#include <synch.h>
+#include <lockstat.h>
 #include <proc.h>
 #include <vfs.h>
 #include <sfs.h>
@@ -367,6 +369,64 @@ cmd_bootfs(int nargs, char **args)
 	return vfs_setbootfs(device);
 }
 
+/*
+ * Command for showing and setting kernel tunables.
+ */
+
+static const struct {
+	const char *name;
+	unsigned *var;
+} tunetable[] = {
+	{ "sched_cachehot",	&sched_cachehot },
+	{ "sched_holdoff",	&sched_holdoff },
+	{ "sched_wakeaffine",	&sched_wakeaffine },
+	{ "sched_inbox",	&sched_inbox },
+	{ "hardclock_tickless",	&hardclock_tickless },
+	{ "thread_cache_max",	&thread_cache_max },
+	{ "lock_spinmax",	&lock_spinmax },
+	{ "spinlock_backoff",	&spinlock_backoff },
+};
+
+static
+int
+cmd_tune(int nargs, char **args)
+{
+	unsigned i;
+
+	if (nargs != 1 && nargs != 3) {
+		kprintf("Usage: tune [name value]\n");
+		return EINVAL;
+	}
+
+	for (i=0; i<ARRAYCOUNT(tunetable); i++) {
+		if (nargs == 1) {
+			kprintf("%s = %u\n", tunetable[i].name,
+				*tunetable[i].var);
+		}
+		else if (!strcmp(tunetable[i].name, args[1])) {
+			*tunetable[i].var = atoi(args[2]);
+			return 0;
+		}
+	}
+	if (nargs == 3) {
+		kprintf("Unknown tunable %s\n", args[1]);
+		return EINVAL;
+	}
+	return 0;
+}
+
+static
+int
+cmd_threadstats(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	thread_printstats();
+
+	return 0;
+}
+
 static
 int
 cmd_kheapstats(int nargs, char **args)
@@ -379,6 +439,32 @@ cmd_kheapstats(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockstat_dump();
+
+	return 0;
+}
+
+static
+int
+cmd_lockstatreset(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	lockstat_reset();
+
+	return 0;
+}
+#endif
+
 static
 int
 cmd_kheapgeneration(int nargs, char **args)
@@ -448,6 +534,7 @@ static const char *opsmenu[] = {
 	"[pwd]     Print current directory   ",
 	"[sync]    Sync filesystems          ",
 	"[panic]   Intentional panic         ",
+	"[tune]    Show/set tunables         ",
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -474,6 +561,9 @@ static const char *testmenu[] = {
 	"[tt1] Thread test 1                 ",
 	"[tt2] Thread test 2                 ",
 	"[tt3] Thread test 3                 ",
+	"[tt4] Thread fork rate test         ",
+	"[wqt] Work queue test               ",
+	"[idt] Idle tick test                ",
 #if OPT_NET
 	"[net] Network test                  ",
 #endif
@@ -481,6 +571,8 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[sy5] RW lock test          (1)     ",
+	"[sy6] Spinlock contention test      ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -508,9 +600,14 @@ cmd_testmenu(int n, char **a)
 static const char *mainmenu[] = {
 	"[?o] Operations menu                ",
 	"[?t] Tests menu                     ",
+	"[ts] Scheduler stats                ",
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+#if OPT_LOCKSTAT
+	"[ls] Lock contention stats          ",
+	"[lsreset] Reset lock stats          ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -552,14 +649,20 @@ static struct {
 	{ "pwd",	cmd_pwd },
 	{ "sync",	cmd_sync },
 	{ "panic",	cmd_panic },
+	{ "tune",	cmd_tune },
 	{ "q",		cmd_quit },
 	{ "exit",	cmd_quit },
 	{ "halt",	cmd_quit },
 
 	/* stats */
+	{ "ts",         cmd_threadstats },
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+#if OPT_LOCKSTAT
+	{ "ls",         cmd_lockstat },
+	{ "lsreset",    cmd_lockstatreset },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -575,12 +678,17 @@ static struct {
 	{ "tt1",	threadtest },
 	{ "tt2",	threadtest2 },
 	{ "tt3",	threadtest3 },
+	{ "tt4",	threadtest4 },
+	{ "wqt",	workqueuetest },
+	{ "idt",	idletest },
 	{ "sy1",	semtest },
 
 	/* synchronization assignment tests */
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	rwtest },
+	{ "sy6",	spinlocktest },
 
 	/* system call assignment tests */
 	/* For testing the wait implementation. */
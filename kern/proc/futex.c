@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes.
+ *
+ * A futex is just an int in user memory. User code handles the
+ * uncontended case itself with atomic operations on it and only
+ * calls the kernel to sleep (futex_wait) or to wake sleepers
+ * (futex_wake).
+ *
+ * Sleepers are kept in a hash table keyed on the address space and
+ * the user address, so nothing needs to be set up beforehand or torn
+ * down afterwards. Each bucket has a lock, a CV, and a list of the
+ * threads waiting on any of the addresses that hash to it. A waiter
+ * records itself on the list (on its own stack) and sleeps on the
+ * CV until a waker marks it woken; futex_wake picks out the waiters
+ * for its address and broadcasts. Other waiters that share the bucket
+ * just go back to sleep.
+ *
+ * The check of the user's word in futex_wait is done holding the
+ * bucket lock, which futex_wake also takes, so a wakeup between the
+ * check and the sleep can't be missed. This is why the bucket lock is
+ * a sleep lock: copyin can fault.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <copyinout.h>
+#include <proc.h>
+#include <futex.h>
+
+#define FUTEX_BUCKETS  64
+
+/*
+ * A thread in futex_wait.
+ */
+struct futexwaiter {
+	struct addrspace *fw_as;	/* key: address space */
+	vaddr_t fw_addr;		/* key: user address */
+	bool fw_woken;			/* set by futex_wake */
+	struct futexwaiter *fw_next;	/* next in bucket */
+};
+
+struct futexbucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futexwaiter *fb_waiters;
+};
+
+static struct futexbucket futextable[FUTEX_BUCKETS];
+
+/*
+ * futex_bootstrap: initialize.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_BUCKETS; i++) {
+		futextable[i].fb_lock = lock_create("futex");
+		futextable[i].fb_cv = cv_create("futex");
+		if (futextable[i].fb_lock == NULL ||
+		    futextable[i].fb_cv == NULL) {
+			panic("Out of memory creating futex table\n");
+		}
+		futextable[i].fb_waiters = NULL;
+	}
+}
+
+/*
+ * Find the bucket for a key.
+ */
+static
+struct futexbucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	unsigned h;
+
+	h = (addr >> 2) ^ ((uintptr_t)as >> 4);
+	h ^= h >> 8;
+	return &futextable[h % FUTEX_BUCKETS];
+}
+
+/*
+ * Take a waiter off its bucket's list, if it's still there.
+ */
+static
+void
+futex_unlink(struct futexbucket *fb, struct futexwaiter *fw)
+{
+	struct futexwaiter **p;
+
+	for (p = &fb->fb_waiters; *p != NULL; p = &(*p)->fw_next) {
+		if (*p == fw) {
+			*p = fw->fw_next;
+			return;
+		}
+	}
+}
+
+/*
+ * futex_wait: sleep if *UADDR == VAL.
+ */
+int
+futex_wait(userptr_t uaddr, int val)
+{
+	struct futexwaiter fw;
+	struct futexbucket *fb;
+	int cur;
+	int result;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	fw.fw_as = proc_getas();
+	fw.fw_addr = (vaddr_t)uaddr;
+	fw.fw_woken = false;
+	fb = futex_bucket(fw.fw_as, fw.fw_addr);
+
+	lock_acquire(fb->fb_lock);
+
+	result = copyin(uaddr, &cur, sizeof(cur));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (cur != val) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	fw.fw_next = fb->fb_waiters;
+	fb->fb_waiters = &fw;
+
+	result = 0;
+	while (!fw.fw_woken && !result) {
+		result = cv_wait_intr(fb->fb_cv, fb->fb_lock);
+	}
+
+	if (!fw.fw_woken) {
+		/* the process is exiting */
+		futex_unlink(fb, &fw);
+		lock_release(fb->fb_lock);
+		return result;
+	}
+
+	lock_release(fb->fb_lock);
+	return 0;
+}
+
+/*
+ * futex_wake: wake up to COUNT sleepers on UADDR.
+ */
+int
+futex_wake(userptr_t uaddr, unsigned count, int *retval)
+{
+	struct futexbucket *fb;
+	struct futexwaiter **p, *fw;
+	struct addrspace *as;
+	vaddr_t addr;
+	unsigned n;
+
+	if ((vaddr_t)uaddr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	addr = (vaddr_t)uaddr;
+	fb = futex_bucket(as, addr);
+
+	n = 0;
+	lock_acquire(fb->fb_lock);
+	p = &fb->fb_waiters;
+	while (*p != NULL && n < count) {
+		fw = *p;
+		if (fw->fw_as == as && fw->fw_addr == addr) {
+			*p = fw->fw_next;
+			fw->fw_woken = true;
+			n++;
+		}
+		else {
+			p = &fw->fw_next;
+		}
+	}
+	if (n > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = n;
+	return 0;
+}
@@ -47,60 +47,108 @@
 /*
  * Structure for holding exit data of a thread.
  *
- * If pi_ppid is INVALID_PID, the parent has gone away and will not be
- * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
- * structure can be freed.
+ * While a process has a parent, its pidinfo is on one of the
+ * parent's lists of children: pi_kids while it's running, and
+ * pi_zombies once it has exited, until the parent waits for it. If
+ * pi_ppid is INVALID_PID, the parent has gone away (or has already
+ * collected the exit status) and the structure can be freed once the
+ * process has exited.
+ *
+ * Threads of a process that wait for its children sleep on its own
+ * pi_waitsem; pi_waiters counts the ones that have not been woken
+ * yet. Whenever one of the children exits or goes away, they are all
+ * woken to look again.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
 	volatile bool pi_exited;	// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct threadusage pi_usage;	// resources used (ditto)
+	struct pidinfo *pi_next;	// next in hash chain
+	struct pidinfo *pi_sibnext;	// next on parent's list
+	struct pidinfo **pi_sibprev;	// what points to us on that list
+	struct pidinfo *pi_kids;	// running children
+	struct pidinfo *pi_zombies;	// exited children not waited for
+	struct semaphore *pi_waitsem;	// use to wait for a child's exit
+	unsigned pi_waiters;		// number of threads to wake
 };
 
+/*
+ * Hash bucket: a chain of pidinfos and the spinlock that covers them.
+ */
+struct pidbucket {
+	struct spinlock pb_lock;
+	struct pidinfo *pb_list;
+};
 
 /*
  * Global pid and exit data.
  *
- * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * The process table is a chained hash table indexed by the low bits
+ * of the pid, with a spinlock per bucket. Everything in a pidinfo
+ * is protected by the lock of the bucket its pid hashes to (even
+ * after it's been taken off the chain), except that while a process
+ * has a parent, its exit data (pi_ppid, pi_exited, pi_exitstatus,
+ * pi_usage) and its links on the parent's lists are protected by the
+ * lock of the parent's bucket instead. That way a parent waiting and
+ * its children exiting meet under one lock. When the chains get
+ * longer than PIDHASH_LOAD on average, the table doubles.
+ *
+ * pidlock is a reader/writer lock on the table as a whole. Ordinary
+ * operations hold it for reading, so they only get in each other's
+ * way when they hit the same bucket; only growing the table takes it
+ * for writing.
+ *
+ * Lock order: pidlock, then a bucket lock, then pidalloc_lock. No
+ * more than one bucket lock is ever held at a time.
+ *
+ * Nothing is freed or allocated while holding a bucket lock.
  */
-static struct lock *pidlock;		// lock for global exit data
-static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
+#define PIDHASH_INITSIZE	32	/* must be a power of 2 */
+#define PIDHASH_LOAD		2
+
+static struct rwlock *pidlock;		// lock for the table as a whole
+static struct pidbucket *pidtable;	// the buckets
+static unsigned pidtable_size;		// number of buckets
+static struct spinlock pidalloc_lock = SPINLOCK_INITIALIZER;
 static pid_t nextpid;			// next candidate pid
 static int nprocs;			// number of allocated pids
 
 
 
 /*
- * Create a pidinfo structure for the specified pid.
+ * Create a pidinfo structure. The pid is filled in when it goes into
+ * the table.
  */
 static
 struct pidinfo *
-pidinfo_create(pid_t pid, pid_t ppid)
+pidinfo_create(pid_t ppid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid != INVALID_PID);
-
 	pi = kmalloc(sizeof(struct pidinfo));
 	if (pi==NULL) {
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_waitsem = sem_create("pidinfo wait", 0);
+	if (pi->pi_waitsem == NULL) {
 		kfree(pi);
 		return NULL;
 	}
 
-	pi->pi_pid = pid;
+	pi->pi_pid = INVALID_PID;
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	bzero(&pi->pi_usage, sizeof(pi->pi_usage));
+	pi->pi_next = NULL;
+	pi->pi_sibnext = NULL;
+	pi->pi_sibprev = NULL;
+	pi->pi_kids = NULL;
+	pi->pi_zombies = NULL;
+	pi->pi_waiters = 0;
 
 	return pi;
 }
@@ -114,10 +162,30 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	KASSERT(pi->pi_sibprev == NULL);
+	KASSERT(pi->pi_kids == NULL);
+	KASSERT(pi->pi_zombies == NULL);
+	KASSERT(pi->pi_waiters == 0);
+	sem_destroy(pi->pi_waitsem);
 	kfree(pi);
 }
 
+/*
+ * Free a list of pidinfos chained through pi_next.
+ */
+static
+void
+pidinfo_destroylist(struct pidinfo *pi)
+{
+	struct pidinfo *next;
+
+	while (pi != NULL) {
+		next = pi->pi_next;
+		pidinfo_destroy(pi);
+		pi = next;
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -126,154 +194,305 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
-	int i;
+	struct pidinfo *pi;
+	unsigned i;
 
-	pidlock = lock_create("pidlock");
+	pidlock = rwlock_create("pidlock");
 	if (pidlock == NULL) {
 		panic("Out of memory creating pid lock\n");
 	}
 
-	/* not really necessary - should start zeroed */
-	for (i=0; i<PROCS_MAX; i++) {
-		pidinfo[i] = NULL;
+	pidtable_size = PIDHASH_INITSIZE;
+	pidtable = kmalloc(pidtable_size * sizeof(*pidtable));
+	if (pidtable == NULL) {
+		panic("Out of memory creating pid table\n");
+	}
+	for (i=0; i<pidtable_size; i++) {
+		spinlock_init(&pidtable[i].pb_lock);
+		pidtable[i].pb_list = NULL;
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
+	pi = pidinfo_create(INVALID_PID);
+	if (pi==NULL) {
 		panic("Out of memory creating kernel pid data\n");
 	}
+	pi->pi_pid = KERNEL_PID;
+	pidtable[KERNEL_PID % pidtable_size].pb_list = pi;
 
 	nextpid = PID_MIN;
 	nprocs = 1;
 }
 
 /*
- * pi_get: look up a pidinfo in the process table.
+ * pi_bucket: find the bucket for a pid. The caller must hold pidlock,
+ * for either reading or writing, so the table stays put.
+ */
+static
+struct pidbucket *
+pi_bucket(pid_t pid)
+{
+	KASSERT(pid>=0);
+	KASSERT(pid != INVALID_PID);
+
+	return &pidtable[pid & (pidtable_size - 1)];
+}
+
+/*
+ * pi_get: look up a pidinfo in its bucket, whose lock must be held.
  */
 static
 struct pidinfo *
-pi_get(pid_t pid)
+pi_get(struct pidbucket *pb, pid_t pid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid>=0);
-	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(spinlock_do_i_hold(&pb->pb_lock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	if (pi==NULL) {
-		return NULL;
-	}
-	if (pi->pi_pid != pid) {
-		return NULL;
+	for (pi = pb->pb_list; pi != NULL; pi = pi->pi_next) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
 	}
-	return pi;
+	return NULL;
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_drop: remove a pidinfo structure from the process table. It
+ * should reflect a process that has already exited and been waited
+ * for (or has no parent to wait for it). The caller must free it
+ * after letting go of the bucket lock.
  */
 static
 void
-pi_put(pid_t pid, struct pidinfo *pi)
+pi_drop(struct pidbucket *pb, struct pidinfo *pi)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidinfo **pp;
 
-	KASSERT(pid != INVALID_PID);
+	KASSERT(spinlock_do_i_hold(&pb->pb_lock));
+	KASSERT(pi->pi_exited == true);
+	KASSERT(pi->pi_ppid == INVALID_PID);
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	for (pp = &pb->pb_list; *pp != pi; pp = &(*pp)->pi_next) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = pi->pi_next;
+	pi->pi_next = NULL;
+
+	spinlock_acquire(&pidalloc_lock);
+	nprocs--;
+	spinlock_release(&pidalloc_lock);
 }
 
 /*
- * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * pi_addkid: put a pidinfo on one of its parent's lists of children.
+ * The parent's bucket lock must be held.
  */
 static
 void
-pi_drop(pid_t pid)
+pi_addkid(struct pidinfo **list, struct pidinfo *pi)
 {
-	struct pidinfo *pi;
+	KASSERT(pi->pi_sibprev == NULL);
 
-	KASSERT(lock_do_i_hold(pidlock));
+	pi->pi_sibnext = *list;
+	pi->pi_sibprev = list;
+	if (*list != NULL) {
+		(*list)->pi_sibprev = &pi->pi_sibnext;
+	}
+	*list = pi;
+}
 
-	pi = pidinfo[pid % PROCS_MAX];
-	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+/*
+ * pi_removekid: take a pidinfo off whichever of its parent's lists
+ * it's on. The parent's bucket lock must be held.
+ */
+static
+void
+pi_removekid(struct pidinfo *pi)
+{
+	KASSERT(pi->pi_sibprev != NULL);
 
-	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	*pi->pi_sibprev = pi->pi_sibnext;
+	if (pi->pi_sibnext != NULL) {
+		pi->pi_sibnext->pi_sibprev = pi->pi_sibprev;
+	}
+	pi->pi_sibnext = NULL;
+	pi->pi_sibprev = NULL;
 }
 
-////////////////////////////////////////////////////////////
+/*
+ * pi_findkid: look for a child by pid, running or exited. The
+ * parent's bucket lock must be held.
+ */
+static
+struct pidinfo *
+pi_findkid(struct pidinfo *parent, pid_t pid)
+{
+	struct pidinfo *pi;
+
+	for (pi = parent->pi_kids; pi != NULL; pi = pi->pi_sibnext) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
+	}
+	for (pi = parent->pi_zombies; pi != NULL; pi = pi->pi_sibnext) {
+		if (pi->pi_pid == pid) {
+			return pi;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * pi_wakewaiters: wake every thread sleeping in pid_wait for one of
+ * this process's children. Its bucket lock must be held.
+ */
+static
+void
+pi_wakewaiters(struct pidinfo *pi)
+{
+	while (pi->pi_waiters > 0) {
+		V(pi->pi_waitsem);
+		pi->pi_waiters--;
+	}
+}
 
 /*
- * Helper function for pid_alloc.
+ * pid_grow: double the number of buckets, if the table still needs it
+ * once we get the write lock. Failing to get memory isn't fatal; the
+ * chains just get longer.
  */
 static
 void
-inc_nextpid(void)
+pid_grow(void)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidbucket *newtable, *oldtable, *pb;
+	struct pidinfo *pi, *next;
+	unsigned newsize, oldsize, i;
+
+	rwlock_acquire_write(pidlock);
+
+	oldtable = pidtable;
+	oldsize = pidtable_size;
+	if (oldsize * PIDHASH_LOAD >= (unsigned)nprocs) {
+		/* Someone else got here first. */
+		rwlock_release_write(pidlock);
+		return;
+	}
 
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
+	newsize = oldsize * 2;
+	newtable = kmalloc(newsize * sizeof(*newtable));
+	if (newtable == NULL) {
+		rwlock_release_write(pidlock);
+		return;
 	}
+	for (i=0; i<newsize; i++) {
+		spinlock_init(&newtable[i].pb_lock);
+		newtable[i].pb_list = NULL;
+	}
+
+	/* Nobody holds a bucket lock without pidlock, so just move them. */
+	for (i=0; i<oldsize; i++) {
+		for (pi = oldtable[i].pb_list; pi != NULL; pi = next) {
+			next = pi->pi_next;
+			pb = &newtable[pi->pi_pid & (newsize - 1)];
+			pi->pi_next = pb->pb_list;
+			pb->pb_list = pi;
+		}
+		spinlock_cleanup(&oldtable[i].pb_lock);
+	}
+
+	pidtable = newtable;
+	pidtable_size = newsize;
+
+	rwlock_release_write(pidlock);
+	kfree(oldtable);
 }
 
+////////////////////////////////////////////////////////////
+
 /*
  * pid_alloc: allocate a process id.
  */
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
+	struct pidinfo *pi, *us;
+	struct pidbucket *pb;
 	pid_t pid;
 	int count;
+	bool grow;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
-
+	/*
+	 * Count ourselves in first; then there are certainly free
+	 * pids, since PROCS_MAX is well below the number of pids.
+	 */
+	spinlock_acquire(&pidalloc_lock);
 	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
+		spinlock_release(&pidalloc_lock);
 		return EAGAIN;
 	}
+	nprocs++;
+	spinlock_release(&pidalloc_lock);
+
+	pi = pidinfo_create(curproc->p_pid);
+	if (pi==NULL) {
+		spinlock_acquire(&pidalloc_lock);
+		nprocs--;
+		spinlock_release(&pidalloc_lock);
+		return ENOMEM;
+	}
+
+	rwlock_acquire_read(pidlock);
 
 	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
+	 * Take candidates from nextpid until we find one that isn't
+	 * in use. Each candidate goes to only one caller, so once we
+	 * find ours free in its bucket it's ours. Even so, assert we
+	 * aren't looping forever.
 	 */
 	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
-
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
+	while (1) {
+		KASSERT(count < PID_MAX);
 		count++;
 
-		inc_nextpid();
+		spinlock_acquire(&pidalloc_lock);
+		pid = nextpid;
+		nextpid++;
+		if (nextpid > PID_MAX) {
+			nextpid = PID_MIN;
+		}
+		spinlock_release(&pidalloc_lock);
+
+		pb = pi_bucket(pid);
+		spinlock_acquire(&pb->pb_lock);
+		if (pi_get(pb, pid) == NULL) {
+			pi->pi_pid = pid;
+			pi->pi_next = pb->pb_list;
+			pb->pb_list = pi;
+			spinlock_release(&pb->pb_lock);
+			break;
+		}
+		spinlock_release(&pb->pb_lock);
 	}
 
-	pid = nextpid;
-
-	pi = pidinfo_create(pid, curproc->p_pid);
-	if (pi==NULL) {
-		lock_release(pidlock);
-		return ENOMEM;
-	}
+	/* Now put it on our list of children. */
+	pb = pi_bucket(curproc->p_pid);
+	spinlock_acquire(&pb->pb_lock);
+	us = pi_get(pb, curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_addkid(&us->pi_kids, pi);
+	spinlock_release(&pb->pb_lock);
 
-	pi_put(pid, pi);
+	/* A stale look at nprocs is fine; pid_grow checks again. */
+	grow = pidtable_size * PIDHASH_LOAD < (unsigned)nprocs;
 
-	inc_nextpid();
+	rwlock_release_read(pidlock);
 
-	lock_release(pidlock);
+	if (grow) {
+		pid_grow();
+	}
 
 	*retval = pid;
 	return 0;
@@ -286,25 +505,38 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidbucket *pb;
+	struct pidinfo *us, *them;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_read(pidlock);
+	pb = pi_bucket(curproc->p_pid);
+	spinlock_acquire(&pb->pb_lock);
 
-	them = pi_get(theirpid);
+	us = pi_get(pb, curproc->p_pid);
+	KASSERT(us != NULL);
+	them = pi_findkid(us, theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
+	pi_removekid(them);
+
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
 	them->pi_ppid = INVALID_PID;
 
-	pi_drop(theirpid);
+	spinlock_release(&pb->pb_lock);
 
-	lock_release(pidlock);
+	pb = pi_bucket(theirpid);
+	spinlock_acquire(&pb->pb_lock);
+	pi_drop(pb, them);
+	spinlock_release(&pb->pb_lock);
+	rwlock_release_read(pidlock);
+
+	pidinfo_destroy(them);
 }
 
 /*
@@ -314,71 +546,153 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidbucket *pb;
+	struct pidinfo *us, *them;
+	bool exited;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	rwlock_acquire_read(pidlock);
+	pb = pi_bucket(curproc->p_pid);
+	spinlock_acquire(&pb->pb_lock);
 
-	them = pi_get(theirpid);
+	us = pi_get(pb, curproc->p_pid);
+	KASSERT(us != NULL);
+	them = pi_findkid(us, theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_ppid==curproc->p_pid);
 
+	pi_removekid(them);
 	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
+	exited = them->pi_exited;
+
+	/* Anyone waiting for it should look again. */
+	pi_wakewaiters(us);
+
+	spinlock_release(&pb->pb_lock);
+
+	/* If it's still running, it drops itself when it exits. */
+	if (exited) {
+		pb = pi_bucket(theirpid);
+		spinlock_acquire(&pb->pb_lock);
+		pi_drop(pb, them);
+		spinlock_release(&pb->pb_lock);
 	}
+	rwlock_release_read(pidlock);
 
-	lock_release(pidlock);
+	if (exited) {
+		pidinfo_destroy(them);
+	}
 }
 
 /*
- * pid_setexitstatus: Sets the exit status of this process. Must only
- * be called if the thread actually had a pid assigned. Wakes up any
- * waiters and disposes of the piddata if nobody else is still using it.
+ * pid_setexitstatus: Sets the exit status of this process, and the
+ * resource usage to pass on to the parent. Must only be called if
+ * the thread actually had a pid assigned. Wakes up any waiters and
+ * disposes of the piddata if nobody else is still using it.
  *
  * As far as the process is concerned, this releases its pid for
  * subsequent reuse; thus we set curproc->p_pid to INVALID_PID.
  */
 void
-pid_setexitstatus(int status)
+pid_setexitstatus(int status, const struct threadusage *usage)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidbucket *pb;
+	struct pidinfo *us, *parent, *pi, *next, *zombies, *dead = NULL;
+	pid_t pid, ppid;
 
-	lock_acquire(pidlock);
-	KASSERT(curproc->p_pid != INVALID_PID);
+	rwlock_acquire_read(pidlock);
+	pid = curproc->p_pid;
+	KASSERT(pid != INVALID_PID);
 
-	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
-		}
+	pb = pi_bucket(pid);
+	spinlock_acquire(&pb->pb_lock);
+	us = pi_get(pb, pid);
+	KASSERT(us != NULL);
+
+	/*
+	 * Only the last thread of a process gets here, so none of
+	 * them can still be waiting for our children.
+	 */
+	KASSERT(us->pi_waiters == 0);
+
+	/*
+	 * First, disown all children. The running ones drop
+	 * themselves when they exit; the exited ones we drop below.
+	 */
+	for (pi = us->pi_kids; pi != NULL; pi = next) {
+		next = pi->pi_sibnext;
+		pi->pi_ppid = INVALID_PID;
+		pi->pi_sibnext = NULL;
+		pi->pi_sibprev = NULL;
+	}
+	us->pi_kids = NULL;
+	zombies = us->pi_zombies;
+	us->pi_zombies = NULL;
+	for (pi = zombies; pi != NULL; pi = pi->pi_sibnext) {
+		pi->pi_ppid = INVALID_PID;
 	}
 
-	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
+	/*
+	 * Note our parent. It can only change under the parent's
+	 * bucket lock, so check again once we have that.
+	 */
+	ppid = us->pi_ppid;
+	spinlock_release(&pb->pb_lock);
 
-	us->pi_exitstatus = status;
-	us->pi_exited = true;
+	for (pi = zombies; pi != NULL; pi = next) {
+		next = pi->pi_sibnext;
+		pi->pi_sibnext = NULL;
+		pi->pi_sibprev = NULL;
 
-	if (us->pi_ppid == INVALID_PID) {
-		/* no parent */
-		pi_drop(curproc->p_pid);
+		pb = pi_bucket(pi->pi_pid);
+		spinlock_acquire(&pb->pb_lock);
+		pi_drop(pb, pi);
+		spinlock_release(&pb->pb_lock);
+
+		pi->pi_next = dead;
+		dead = pi;
 	}
-	else {
-		cv_broadcast(us->pi_cv, pidlock);
+
+	/* Now, move to our parent's list of zombies and wake it up */
+	parent = NULL;
+	if (ppid != INVALID_PID) {
+		pb = pi_bucket(ppid);
+		spinlock_acquire(&pb->pb_lock);
+		if (us->pi_ppid == ppid) {
+			parent = pi_get(pb, ppid);
+			KASSERT(parent != NULL);
+
+			us->pi_exitstatus = status;
+			us->pi_usage = *usage;
+			us->pi_exited = true;
+
+			pi_removekid(us);
+			pi_addkid(&parent->pi_zombies, us);
+			pi_wakewaiters(parent);
+		}
+		/* After this the parent may free us at any time. */
+		spinlock_release(&pb->pb_lock);
+	}
+
+	if (parent == NULL) {
+		/* no parent */
+		pb = pi_bucket(pid);
+		spinlock_acquire(&pb->pb_lock);
+		us->pi_exitstatus = status;
+		us->pi_usage = *usage;
+		us->pi_exited = true;
+		pi_drop(pb, us);
+		spinlock_release(&pb->pb_lock);
+
+		us->pi_next = dead;
+		dead = us;
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	rwlock_release_read(pidlock);
+
+	pidinfo_destroylist(dead);
 }
 
 /*
@@ -386,27 +700,36 @@ pid_setexitstatus(int status)
  * status and ret are a kernel pointers, but pid/flags may come from
  * userland and may thus be maliciously invalid.
  *
+ * The pid may be WAIT_ANY, to wait for whichever child exits first;
+ * ret gets the pid actually found.
+ *
  * status may be null, in which case the status is thrown away. ret
  * may only be null if WNOHANG is not set.
  */
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidbucket *pb;
+	struct pidinfo *us, *them;
+	pid_t pid;
+	int result;
 
-	KASSERT(curproc->p_pid != INVALID_PID);
+	pid = curproc->p_pid;
+	KASSERT(pid != INVALID_PID);
 
 	/* Don't let a process wait for itself. */
-	if (theirpid == curproc->p_pid) {
+	if (theirpid == pid) {
 		return EINVAL;
 	}
 
 	/*
-	 * We don't support the Unix meanings of negative pids or 0
-	 * (0 is INVALID_PID) and other code may break on them, so
-	 * check now.
+	 * We support WAIT_ANY, but not the Unix meanings of other
+	 * negative pids or 0 (0 is INVALID_PID), which wait for
+	 * process groups, and other code may break on them, so check
+	 * now.
 	 */
-	if (theirpid == INVALID_PID || theirpid<0) {
+	if (theirpid != WAIT_ANY &&
+	    (theirpid == INVALID_PID || theirpid<0)) {
 		return ENOSYS;
 	}
 
@@ -415,51 +738,111 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
-
-	them = pi_get(theirpid);
-	if (them==NULL) {
-		lock_release(pidlock);
-		return ESRCH;
-	}
-
-	KASSERT(them->pi_pid==theirpid);
+	rwlock_acquire_read(pidlock);
+	pb = pi_bucket(pid);
+	spinlock_acquire(&pb->pb_lock);
+	us = pi_get(pb, pid);
+	KASSERT(us != NULL);
 
-	/* Only allow waiting for own children. */
-	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
-		return EPERM;
-	}
+	while (1) {
+		if (theirpid == WAIT_ANY) {
+			them = us->pi_zombies;
+			if (them != NULL) {
+				break;
+			}
+			if (us->pi_kids == NULL) {
+				spinlock_release(&pb->pb_lock);
+				rwlock_release_read(pidlock);
+				return ECHILD;
+			}
+		}
+		else {
+			them = pi_findkid(us, theirpid);
+			if (them == NULL) {
+				/* Not ours; see if it exists at all. */
+				spinlock_release(&pb->pb_lock);
+				pb = pi_bucket(theirpid);
+				spinlock_acquire(&pb->pb_lock);
+				them = pi_get(pb, theirpid);
+				spinlock_release(&pb->pb_lock);
+				rwlock_release_read(pidlock);
+				return them == NULL ? ESRCH : EPERM;
+			}
+			if (them->pi_exited) {
+				break;
+			}
+		}
 
-	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			spinlock_release(&pb->pb_lock);
+			rwlock_release_read(pidlock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+
+		/*
+		 * Sleep until one of our children exits or goes away,
+		 * and look again. We can't exit meanwhile, since this
+		 * thread is still here, so us stays put; but the table
+		 * may grow, so look up the bucket again after.
+		 */
+		us->pi_waiters++;
+		spinlock_release(&pb->pb_lock);
+		rwlock_release_read(pidlock);
+
+		result = P_intr(us->pi_waitsem);
+
+		rwlock_acquire_read(pidlock);
+		pb = pi_bucket(pid);
+		spinlock_acquire(&pb->pb_lock);
+
+		if (result) {
+			/*
+			 * We're exiting. Take ourselves off the count,
+			 * unless we were already woken; then the V is
+			 * left on the semaphore, which only causes
+			 * another waiter to look again for nothing.
+			 */
+			if (us->pi_waiters > 0) {
+				us->pi_waiters--;
+			}
+			spinlock_release(&pb->pb_lock);
+			rwlock_release_read(pidlock);
+			return result;
+		}
 	}
 
+	KASSERT(them->pi_exited == true);
+	KASSERT(them->pi_ppid == pid);
+
 	if (status != NULL) {
 		*status = them->pi_exitstatus;
 	}
+
+	/* Collect its resource usage for RUSAGE_CHILDREN. */
+	spinlock_acquire(&curproc->p_lock);
+	threadusage_add(&curproc->p_cusage, &them->pi_usage);
+	spinlock_release(&curproc->p_lock);
+
 	if (ret != NULL) {
-		/*
-		 * In Unix you can wait for any of several possible
-		 * processes by passing particular magic values of
-		 * pid. wait then returns the pid you actually
-		 * found. We don't support this, so always return the
-		 * pid we looked for.
-		 */
-		*ret = theirpid;
+		*ret = them->pi_pid;
 	}
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	pi_removekid(them);
+	them->pi_ppid = INVALID_PID;
+
+	/* Anyone else waiting for it, or for the last child, looks again. */
+	pi_wakewaiters(us);
+
+	spinlock_release(&pb->pb_lock);
+
+	pb = pi_bucket(them->pi_pid);
+	spinlock_acquire(&pb->pb_lock);
+	pi_drop(pb, them);
+	spinlock_release(&pb->pb_lock);
+	rwlock_release_read(pidlock);
 
-	lock_release(pidlock);
+	pidinfo_destroy(them);
 	return 0;
 }
@@ -38,13 +38,15 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes may have more than one thread too; see the notes on
+ * user threads below.
  */
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <spl.h>
+#include <wchan.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -87,6 +89,24 @@ proc_create(const char *name)
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
 
+	/* Accounting fields */
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+
+	/* User thread fields; every process starts with thread 0 */
+	bzero(proc->p_uthreads, sizeof(proc->p_uthreads));
+	proc->p_uthreads[0].ut_inuse = true;
+	proc->p_joinchan = wchan_create("join");
+	if (proc->p_joinchan == NULL) {
+		spinlock_cleanup(&proc->p_lock);
+		threadarray_cleanup(&proc->p_threads);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_exiting = false;
+	proc->p_exitstatus = 0;
+
 	return proc;
 }
 
@@ -175,6 +195,7 @@ proc_destroy(struct proc *proc)
 	}
 
 	KASSERT(proc->p_pid == INVALID_PID);
+	wchan_destroy(proc->p_joinchan);
 	threadarray_cleanup(&proc->p_threads);
 	spinlock_cleanup(&proc->p_lock);
 
@@ -272,6 +293,15 @@ proc_fork(struct proc **ret)
 		return result;
 	}
 
+	/*
+	 * The new process has only the thread that called fork, which
+	 * keeps its thread id (and with it, its stack).
+	 */
+	if (curthread->t_tid != 0) {
+		newproc->p_uthreads[0].ut_inuse = false;
+		newproc->p_uthreads[curthread->t_tid].ut_inuse = true;
+	}
+
 #if 0 /* not yet */
 	/*
 	 * If the caller doesn't want to collect the exit status,
@@ -325,7 +355,71 @@ proc_fork(struct proc **ret)
 }
 
 /*
- * Undo proc_fork if nothing's run in the new process yet.
+ * Create a fresh process for spawnv.
+ *
+ * Unlike proc_fork, the new process gets no address space at all,
+ * since it's about to load a program anyway; copying the caller's
+ * just to throw it away is what spawnv is for avoiding. Its file
+ * table is a copy of the caller's if FDS is null, and otherwise is
+ * made of the NFDS file handles listed in FDS (see filetable_remap).
+ * It inherits the caller's current directory.
+ */
+int
+proc_spawn(const int *fds, int nfds, struct proc **ret)
+{
+	struct proc *newproc;
+	struct filetable *tbl;
+	int result;
+
+	newproc = proc_create(curproc->p_name);
+	if (newproc == NULL) {
+		return ENOMEM;
+	}
+	/* Get a process ID */
+	result = pid_alloc(&newproc->p_pid);
+	if (result) {
+		proc_destroy(newproc);
+		return result;
+	}
+
+	/* VM fields */
+
+	newproc->p_addrspace = NULL;
+
+	/* VFS fields */
+	tbl = curproc->p_filetable;
+	if (fds == NULL) {
+		result = filetable_copy(tbl, &newproc->p_filetable);
+	}
+	else {
+		result = filetable_remap(tbl, fds, nfds,
+					 &newproc->p_filetable);
+	}
+	if (result) {
+		pid_unalloc(newproc->p_pid);
+		newproc->p_pid = INVALID_PID;
+		proc_destroy(newproc);
+		return result;
+	}
+
+	/*
+	 * Lock the current process to copy its current directory.
+	 * (We don't need to lock the new process, though, as we have
+	 * the only reference to it.)
+	 */
+	spinlock_acquire(&curproc->p_lock);
+	if (curproc->p_cwd != NULL) {
+		VOP_INCREF(curproc->p_cwd);
+		newproc->p_cwd = curproc->p_cwd;
+	}
+	spinlock_release(&curproc->p_lock);
+
+	*ret = newproc;
+	return 0;
+}
+
+/*
+ * Undo proc_fork or proc_spawn if nothing's run in the new process yet.
  */
 void
 proc_unfork(struct proc *newproc)
@@ -335,19 +429,166 @@ proc_unfork(struct proc *newproc)
 	proc_destroy(newproc);
 }
 
+/*
+ * Take thread T out of PROC's thread array, leaving USAGE (what it
+ * used) behind with the process. p_lock must be held. Returns false
+ * if T wasn't there.
+ */
+static
+bool
+proc_unlink_thread(struct proc *proc, struct thread *t,
+		   const struct threadusage *usage)
+{
+	unsigned i, num;
+
+	KASSERT(spinlock_do_i_hold(&proc->p_lock));
+
+	/* ugh: find the thread in the array */
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		if (threadarray_get(&proc->p_threads, i) == t) {
+			threadarray_remove(&proc->p_threads, i);
+			threadusage_add(&proc->p_usage, usage);
+			bzero(&t->t_usage, sizeof(t->t_usage));
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Clear t_proc after proc_unlink_thread. See proc_remthread for why
+ * interrupts are turned off.
+ */
+static
+void
+proc_clear_thread(struct thread *t)
+{
+	int spl;
+
+	spl = splhigh();
+	t->t_proc = NULL;
+	splx(spl);
+}
+
+/*
+ * Move the current thread, already unlinked from its process, to the
+ * kernel process and exit.
+ */
+static
+__DEAD
+void
+proc_leave(void)
+{
+	proc_clear_thread(curthread);
+	proc_addthread(kproc, curthread);
+	thread_exit();
+}
+
+/*
+ * Wake the other threads of an exiting process that are asleep in
+ * wchan_sleep_intr (or P_intr, or cv_wait_intr), so they fail with
+ * EINTR and head back out. See wchan_sleep_intr for the protocol.
+ *
+ * Since p_lock has to be dropped to wake each one, start over each
+ * time; marking each t_interrupted keeps it from being woken twice,
+ * and no new sleeps begin now that p_exiting is set.
+ *
+ * The caller must still be in the process, so it can't be destroyed
+ * out from under us.
+ */
+static
+void
+proc_interrupt(struct proc *proc)
+{
+	struct thread *t;
+	struct wchan *wc;
+	struct spinlock *lk;
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_exiting);
+ again:
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num; i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t->t_intrchan == NULL || t->t_interrupted) {
+			continue;
+		}
+		t->t_interrupted = true;
+		t->t_intrbusy = true;
+		wc = t->t_intrchan;
+		lk = t->t_intrlock;
+		spinlock_release(&proc->p_lock);
+
+		wchan_interrupt(t, wc, lk);
+
+		spinlock_acquire(&proc->p_lock);
+		t->t_intrbusy = false;
+		goto again;
+	}
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Make the current process exit.
+ *
+ * The first thread to get here sets the exit status and wakes up any
+ * threads waiting in thread_join or in an interruptible sleep (see
+ * proc_interrupt) so they can notice. Every thread but the last then
+ * just leaves; the last does the actual exit.
  */
 void
 proc_exit(int status)
 {
 	struct proc *proc = curproc;
+	struct threadusage usage;
+	bool first, last;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
+	thread_getusage(curthread, &usage);
+
+	spinlock_acquire(&proc->p_lock);
+	first = !proc->p_exiting;
+	if (first) {
+		proc->p_exiting = true;
+		proc->p_exitstatus = status;
+		wchan_wakeall(proc->p_joinchan, &proc->p_lock);
+	}
+	spinlock_release(&proc->p_lock);
+
+	if (first) {
+		proc_interrupt(proc);
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	last = threadarray_num(&proc->p_threads) == 1;
+	if (!last) {
+		if (!proc_unlink_thread(proc, curthread, &usage)) {
+			panic("Thread (%p) has escaped from its process "
+			      "(%p)\n", curthread, proc);
+		}
+	}
+	spinlock_release(&proc->p_lock);
+
+	if (!last) {
+		proc_leave();
+	}
+
+	/* Nobody else can change it now. */
+	status = proc->p_exitstatus;
+
+	/*
+	 * Our parent inherits what we used, and what our children
+	 * used, when it collects our exit status.
+	 */
+	proc_getusage(proc, &usage);
+	threadusage_add(&usage, &proc->p_cusage);
+
 	/* Set exit status and wake up anyone waiting for us. */
-	pid_setexitstatus(status);
+	pid_setexitstatus(status, &usage);
 
 	/* Detach from the process and attach to the kernel process. */
 	KASSERT(curthread->t_proc == proc);
@@ -363,6 +604,186 @@ proc_exit(int status)
 	thread_exit();
 }
 
+/*
+ * User threads.
+ *
+ * Threads are created with thread ids from p_uthreads, which also
+ * pick their user stacks; see sys___thread_create. A thread that
+ * exits leaves its return value in its slot until someone joins it.
+ *
+ * Exiting the process (with _exit, or by taking a fatal fault) from
+ * one thread makes the others leave too. We have no way to interrupt
+ * a thread that's off in user mode, so each one checks p_exiting on
+ * its way back there, which happens at least every hardclock. Ones
+ * asleep in the kernel for something that may take indefinitely long
+ * (thread_join, waitpid, pipes, poll, console input, futexes, sleeps)
+ * are woken at once and fail with EINTR; other sleeps, such as for
+ * disk I/O or locks, end on their own.
+ */
+
+/*
+ * Reserve a thread id in the current process.
+ */
+int
+proc_thread_alloc(int *tid)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	int i;
+
+	spinlock_acquire(&proc->p_lock);
+	for (i=1; i<THREADS_MAX; i++) {
+		ut = &proc->p_uthreads[i];
+		if (!ut->ut_inuse) {
+			ut->ut_inuse = true;
+			ut->ut_exited = false;
+			ut->ut_retval = NULL;
+			spinlock_release(&proc->p_lock);
+			*tid = i;
+			return 0;
+		}
+	}
+	spinlock_release(&proc->p_lock);
+	return EAGAIN;
+}
+
+/*
+ * Undo proc_thread_alloc if the thread never started.
+ */
+void
+proc_thread_unalloc(int tid)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	KASSERT(proc->p_uthreads[tid].ut_inuse);
+	proc->p_uthreads[tid].ut_inuse = false;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Make the current thread exit, leaving RETVAL for thread_join. The
+ * last thread to go takes the process with it.
+ */
+void
+proc_thread_exit(userptr_t retval)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	struct threadusage usage;
+	bool last;
+
+	KASSERT(proc != kproc);
+
+	thread_getusage(curthread, &usage);
+
+	spinlock_acquire(&proc->p_lock);
+	last = threadarray_num(&proc->p_threads) == 1;
+	if (!last) {
+		ut = &proc->p_uthreads[curthread->t_tid];
+		KASSERT(ut->ut_inuse && !ut->ut_exited);
+		ut->ut_exited = true;
+		ut->ut_retval = retval;
+		if (!proc_unlink_thread(proc, curthread, &usage)) {
+			panic("Thread (%p) has escaped from its process "
+			      "(%p)\n", curthread, proc);
+		}
+		wchan_wakeall(proc->p_joinchan, &proc->p_lock);
+	}
+	spinlock_release(&proc->p_lock);
+
+	if (last) {
+		proc_exit(_MKWAIT_EXIT(0));
+	}
+	proc_leave();
+}
+
+/*
+ * Wait for thread TID of the current process to exit, and return
+ * what it passed to thread_exit. This frees the thread id. Fails with
+ * EINTR if the process starts exiting meanwhile.
+ */
+int
+proc_thread_join(int tid, userptr_t *retval)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+
+	if (tid < 0 || tid >= THREADS_MAX) {
+		return ESRCH;
+	}
+	if (tid == curthread->t_tid) {
+		return EINVAL;
+	}
+	ut = &proc->p_uthreads[tid];
+
+	spinlock_acquire(&proc->p_lock);
+	while (ut->ut_inuse && !ut->ut_exited && !proc->p_exiting) {
+		wchan_sleep(proc->p_joinchan, &proc->p_lock);
+	}
+	if (!ut->ut_inuse) {
+		/* Never existed, or someone else joined it first. */
+		spinlock_release(&proc->p_lock);
+		return ESRCH;
+	}
+	if (!ut->ut_exited) {
+		spinlock_release(&proc->p_lock);
+		return EINTR;
+	}
+	*retval = ut->ut_retval;
+	ut->ut_inuse = false;
+	ut->ut_exited = false;
+	spinlock_release(&proc->p_lock);
+	return 0;
+}
+
+/*
+ * Leave now, instead of returning to user mode, if the current
+ * process is exiting.
+ */
+void
+proc_checkexit(void)
+{
+	/* Unlocked peek; it only ever goes from false to true. */
+	if (curproc->p_exiting) {
+		/* The status was set by whoever started the exit. */
+		proc_exit(0);
+	}
+}
+
+/*
+ * Check that execv can go ahead: the other threads would be left
+ * running in the new program.
+ */
+int
+proc_exec_threads(void)
+{
+	struct proc *proc = curproc;
+	unsigned num;
+
+	spinlock_acquire(&proc->p_lock);
+	num = threadarray_num(&proc->p_threads);
+	spinlock_release(&proc->p_lock);
+
+	return num > 1 ? EBUSY : 0;
+}
+
+/*
+ * After execv, the calling thread is thread 0 of the new program.
+ * Any exited threads that were never joined are forgotten.
+ */
+void
+proc_exec_done(void)
+{
+	struct proc *proc = curproc;
+
+	spinlock_acquire(&proc->p_lock);
+	bzero(proc->p_uthreads, sizeof(proc->p_uthreads));
+	proc->p_uthreads[0].ut_inuse = true;
+	curthread->t_tid = 0;
+	spinlock_release(&proc->p_lock);
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -405,28 +826,63 @@ void
 proc_remthread(struct thread *t)
 {
 	struct proc *proc;
-	unsigned i, num;
-	int spl;
+	struct threadusage usage;
+	bool found;
 
 	proc = t->t_proc;
 	KASSERT(proc != NULL);
 
+	thread_getusage(t, &usage);
+
 	spinlock_acquire(&proc->p_lock);
-	/* ugh: find the thread in the array */
+	found = proc_unlink_thread(proc, t, &usage);
+	spinlock_release(&proc->p_lock);
+	if (!found) {
+		panic("Thread (%p) has escaped from its process (%p)\n",
+		      t, proc);
+	}
+	proc_clear_thread(t);
+}
+
+/*
+ * Add up the resources used by a process: what its departed threads
+ * left behind in p_usage, plus what the live ones have used so far.
+ */
+void
+proc_getusage(struct proc *proc, struct threadusage *ret)
+{
+	struct threadusage usage;
+	unsigned i, num;
+
+	spinlock_acquire(&proc->p_lock);
+	*ret = proc->p_usage;
 	num = threadarray_num(&proc->p_threads);
 	for (i=0; i<num; i++) {
-		if (threadarray_get(&proc->p_threads, i) == t) {
-			threadarray_remove(&proc->p_threads, i);
-			spinlock_release(&proc->p_lock);
-			spl = splhigh();
-			t->t_proc = NULL;
-			splx(spl);
-			return;
-		}
+		thread_getusage(threadarray_get(&proc->p_threads, i), &usage);
+		threadusage_add(ret, &usage);
+	}
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Set the cpu affinity of every thread in a process. Threads it
+ * creates later inherit it from their creator.
+ */
+int
+proc_setaffinity(struct proc *proc, cpumask_t affinity)
+{
+	unsigned i, num;
+	int result;
+
+	spinlock_acquire(&proc->p_lock);
+	result = 0;
+	num = threadarray_num(&proc->p_threads);
+	for (i=0; i<num && result == 0; i++) {
+		result = thread_setaffinity(
+			threadarray_get(&proc->p_threads, i), affinity);
 	}
-	/* Did not find it. */
 	spinlock_release(&proc->p_lock);
-	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
+	return result;
 }
 
 /*
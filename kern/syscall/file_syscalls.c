@@ -39,6 +39,8 @@
 #include <kern/stat.h>
 #include <lib.h>
 #include <uio.h>
+#include <clock.h>
+#include <callout.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -47,6 +49,8 @@
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pipe.h>
+#include <poll.h>
 #include <syscall.h>
 
 /*
@@ -105,20 +109,18 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for read and write, and readv and writev.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on the uio, at the
+ * file's seek position.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, struct uio *useruio, int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
-	struct uio useruio;
+	size_t size;
 	int result;
 
 	/* better be a valid file descriptor */
@@ -131,10 +133,10 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	locked = VOP_ISSEEKABLE(file->of_vnode);
 	if (locked) {
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio->uio_offset = file->of_offset;
 	}
 	else {
-		pos = 0;
+		useruio->uio_offset = 0;
 	}
 
 	if (file->of_accmode == badaccmode) {
@@ -142,20 +144,18 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 		goto fail;
 	}
 
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
-
 	/* do the read or write */
-	result = (rw == UIO_READ) ?
-		VOP_READ(file->of_vnode, &useruio) :
-		VOP_WRITE(file->of_vnode, &useruio);
+	size = useruio->uio_resid;
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
 	if (result) {
 		goto fail;
 	}
 
 	if (locked) {
 		/* set the offset to the updated offset in the uio */
-		file->of_offset = useruio.uio_offset;
+		file->of_offset = useruio->uio_offset;
 		lock_release(file->of_offsetlock);
 	}
 
@@ -165,7 +165,7 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	 * The amount read (or written) is the original buffer size,
 	 * minus how much is left in it.
 	 */
-	*retval = size - useruio.uio_resid;
+	*retval = size - useruio->uio_resid;
 
 	return 0;
 
@@ -177,13 +177,76 @@ fail:
 	return result;
 }
 
+/*
+ * Common logic for pread and pwrite, and preadv and pwritev.
+ *
+ * Like sys_readwrite, but at the position already in the uio rather
+ * than the seek position, which isn't used or changed. So the offset
+ * lock isn't needed, and processes sharing the open file can do I/O
+ * on it at the same time.
+ */
+static
+int
+sys_preadwrite(int fd, struct uio *useruio, int badaccmode, ssize_t *retval)
+{
+	struct openfile *file;
+	size_t size;
+	int result;
+
+	/* better be a valid file descriptor */
+	result = filetable_get(curproc->p_filetable, fd, &file);
+	if (result) {
+		return result;
+	}
+
+	/* a position only means something if the object is seekable */
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		result = ESPIPE;
+		goto fail;
+	}
+
+	if (useruio->uio_offset < 0) {
+		result = EINVAL;
+		goto fail;
+	}
+
+	if (file->of_accmode == badaccmode) {
+		result = EBADF;
+		goto fail;
+	}
+
+	/* do the read or write */
+	size = useruio->uio_resid;
+	result = (useruio->uio_rw == UIO_READ) ?
+		VOP_READ(file->of_vnode, useruio) :
+		VOP_WRITE(file->of_vnode, useruio);
+	if (result) {
+		goto fail;
+	}
+
+	filetable_put(curproc->p_filetable, fd, file);
+
+	*retval = size - useruio->uio_resid;
+
+	return 0;
+
+fail:
+	filetable_put(curproc->p_filetable, fd, file);
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	/* the offset is filled in by sys_readwrite */
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_READ);
+	return sys_readwrite(fd, &useruio, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +255,137 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, 0, UIO_WRITE);
+	return sys_readwrite(fd, &useruio, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_preadwrite
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_READ);
+	return sys_preadwrite(fd, &useruio, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_preadwrite
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+	struct uio useruio;
+
+	uio_uinit(&iov, &useruio, buf, size, pos, UIO_WRITE);
+	return sys_preadwrite(fd, &useruio, O_RDONLY, retval);
+}
+
+/*
+ * Number of iovecs the vector calls handle without kmalloc. Most
+ * callers pass only a few (a header and a payload, say).
+ */
+#define IOV_ONSTACK	8
+
+/*
+ * Common logic for readv, writev, preadv, and pwritev: copy in the
+ * iovec array, set up a uio over all of it, and go to sys_readwrite
+ * (or, if POSITIONAL, sys_preadwrite at POS). The buffers themselves
+ * are checked as they're used, by uiomove.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t uiov, int iovcnt,
+	       bool positional, off_t pos, enum uio_rw rw, int badaccmode,
+	       ssize_t *retval)
+{
+	struct iovec stackiov[IOV_ONSTACK], *iov;
+	struct uio useruio;
+	int result;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+
+	if (iovcnt <= IOV_ONSTACK) {
+		iov = stackiov;
+	}
+	else {
+		iov = kmalloc(iovcnt * sizeof(iov[0]));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	result = copyin(uiov, iov, iovcnt * sizeof(iov[0]));
+	if (result) {
+		goto done;
+	}
+
+	result = uio_uvinit(iov, iovcnt, &useruio, pos, rw);
+	if (result) {
+		goto done;
+	}
+
+	if (positional) {
+		result = sys_preadwrite(fd, &useruio, badaccmode, retval);
+	}
+	else {
+		result = sys_readwrite(fd, &useruio, badaccmode, retval);
+	}
+
+done:
+	if (iov != stackiov) {
+		kfree(iov);
+	}
+	return result;
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, false, 0,
+			      UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * preadv() - use sys_readwritev
+ */
+int
+sys_preadv(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwritev() - use sys_readwritev
+ */
+int
+sys_pwritev(int fd, const_userptr_t iov, int iovcnt, off_t pos, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, true, pos,
+			      UIO_WRITE, O_RDONLY, retval);
 }
 
 /*
@@ -211,7 +404,10 @@ sys_close(int fd)
 		return EBADF;
 	}
 
-	/* place null in the filetable and get the file previously there */
+	/*
+	 * place null in the filetable and get the file previously there
+	 * (placing null can't fail)
+	 */
 	filetable_placeat(ft, NULL, fd, &file);
 
 	if (file == NULL) {
@@ -320,8 +516,12 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	openfile_incref(oldfdfile);
 	filetable_put(ft, oldfd, oldfdfile);
 
-	/* place it */
-	filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	/* place it (this may need to grow the table) */
+	result = filetable_placeat(ft, oldfdfile, newfd, &newfdfile);
+	if (result) {
+		openfile_decref(oldfdfile);
+		return result;
+	}
 
 	/* if there was a file already there, drop that reference */
 	if (newfdfile != NULL) {
@@ -333,6 +533,207 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * Take a handle sys_pipe placed back out of the table, on failure.
+ * Another thread may have closed it, or even reused the number for
+ * another file, meanwhile; in that case leave it alone, since the
+ * close already dropped our reference.
+ */
+static
+void
+pipe_unplace(struct filetable *ft, int fd, struct openfile *file)
+{
+	if (filetable_unplace(ft, fd, file)) {
+		openfile_decref(file);
+	}
+}
+
+/*
+ * pipe() - make a pipe, wrap each end in an openfile, and put both in
+ * the file table.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct filetable *ft;
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	result = openfile_fromvnode(readvn, O_RDONLY, &readfile);
+	if (result) {
+		VOP_DECREF(readvn);
+		VOP_DECREF(writevn);
+		return result;
+	}
+	result = openfile_fromvnode(writevn, O_WRONLY, &writefile);
+	if (result) {
+		openfile_decref(readfile);
+		VOP_DECREF(writevn);
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		pipe_unplace(ft, fds[0], readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		/* take them back out */
+		pipe_unplace(ft, fds[1], writefile);
+		pipe_unplace(ft, fds[0], readfile);
+		return result;
+	}
+
+	return 0;
+}
+
+/*
+ * poll() - wait until one of several file handles is ready.
+ *
+ * Check each with VOP_POLL, which registers our pollwaiter with any
+ * object that isn't ready; if none is, sleep until one of them wakes
+ * the waiter (or the time runs out) and check them all again. The
+ * open files are held the whole time, so nothing we're registered on
+ * can go away. If the process starts exiting, give up with EINTR.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct filetable *ft;
+	struct pollfd *fds;
+	struct openfile **files;
+	struct pollwaiter *pw;
+	struct timespec deadline, now, left;
+	uint64_t ticks;
+	unsigned i;
+	int revents, nready;
+	int result;
+
+	ft = curproc->p_filetable;
+
+	if (nfds > FILETABLE_MAX) {
+		return EINVAL;
+	}
+
+	fds = kmalloc(nfds * sizeof(fds[0]));
+	files = kmalloc(nfds * sizeof(files[0]));
+	pw = pollwaiter_create(nfds);
+	if (fds == NULL || files == NULL || pw == NULL) {
+		result = ENOMEM;
+		goto out_free;
+	}
+
+	result = copyin(ufds, fds, nfds * sizeof(fds[0]));
+	if (result) {
+		goto out_free;
+	}
+
+	/* negative fds are ignored; fds that aren't open get POLLNVAL */
+	for (i=0; i<nfds; i++) {
+		files[i] = NULL;
+		fds[i].revents = 0;
+		if (fds[i].fd >= 0 &&
+		    filetable_get(ft, fds[i].fd, &files[i]) != 0) {
+			files[i] = NULL;
+			fds[i].revents = POLLNVAL;
+		}
+	}
+
+	if (timeout > 0) {
+		gettime(&deadline);
+		left.tv_sec = timeout / 1000;
+		left.tv_nsec = (timeout % 1000) * 1000000;
+		timespec_add(&deadline, &left, &deadline);
+	}
+
+	while (1) {
+		nready = 0;
+		for (i=0; i<nfds; i++) {
+			if (files[i] == NULL) {
+				if (fds[i].revents != 0) {
+					nready++;
+				}
+				continue;
+			}
+			/* once something's ready we won't sleep */
+			result = VOP_POLL(files[i]->of_vnode, fds[i].events,
+					  nready > 0 ? NULL : pw, &revents);
+			if (result) {
+				goto out_clear;
+			}
+			fds[i].revents = revents;
+			if (revents != 0) {
+				nready++;
+			}
+		}
+		if (nready > 0 || timeout == 0) {
+			break;
+		}
+
+		ticks = 0;
+		if (timeout > 0) {
+			gettime(&now);
+			if (now.tv_sec > deadline.tv_sec ||
+			    (now.tv_sec == deadline.tv_sec &&
+			     now.tv_nsec >= deadline.tv_nsec)) {
+				break;
+			}
+			timespec_sub(&deadline, &now, &left);
+			ticks = left.tv_sec * HZ +
+				(left.tv_nsec + 1000000000/HZ - 1) /
+				(1000000000/HZ);
+			if (ticks > CALLOUT_MAXTICKS) {
+				ticks = CALLOUT_MAXTICKS;
+			}
+		}
+
+		/* a timeout is noticed on the next time around */
+		result = pollwaiter_sleep(pw, ticks);
+		if (result == EINTR) {
+			goto out_clear;
+		}
+		pollwaiter_clear(pw);
+	}
+
+	result = copyout(fds, ufds, nfds * sizeof(fds[0]));
+	if (result == 0) {
+		*retval = nready;
+	}
+
+ out_clear:
+	pollwaiter_clear(pw);
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			filetable_put(ft, fds[i].fd, files[i]);
+		}
+	}
+ out_free:
+	if (pw != NULL) {
+		pollwaiter_destroy(pw);
+	}
+	kfree(files);
+	kfree(fds);
+	return result;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -37,6 +37,9 @@
 #include <openfile.h>
 #include <filetable.h>
 
+/* Size of a table when first grown. */
+#define FILETABLE_MINSIZE	8
+
 
 /*
  * Construct a filetable.
@@ -45,41 +48,108 @@ struct filetable *
 filetable_create(void)
 {
 	struct filetable *ft;
-	int fd;
 
 	ft = kmalloc(sizeof(struct filetable));
 	if (ft == NULL) {
 		return NULL;
 	}
 
-	/* the table starts empty */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		ft->ft_openfiles[fd] = NULL;
-	}
+	spinlock_init(&ft->ft_lock);
+
+	/* the table starts empty; it gets slots when something's placed */
+	ft->ft_openfiles = NULL;
+	ft->ft_size = 0;
+	ft->ft_lowfree = 0;
+	ft->ft_top = 0;
+	ft->ft_limit = OPEN_MAX;
+	ft->ft_hardlimit = FILETABLE_MAX;
 
 	return ft;
 }
 
 /*
- * Destroy a filetable.
+ * Destroy a filetable. This happens when the last thread leaves the
+ * process, so nobody else can be using it.
  */
 void
 filetable_destroy(struct filetable *ft)
 {
-	int fd;
+	unsigned fd;
 
 	KASSERT(ft != NULL);
 
 	/* Close any open files. */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < ft->ft_top; fd++) {
 		if (ft->ft_openfiles[fd] != NULL) {
 			openfile_decref(ft->ft_openfiles[fd]);
 			ft->ft_openfiles[fd] = NULL;
 		}
 	}
+	if (ft->ft_openfiles != NULL) {
+		kfree(ft->ft_openfiles);
+	}
+	spinlock_cleanup(&ft->ft_lock);
 	kfree(ft);
 }
 
+/*
+ * Make the table at least WANT slots. It's doubled, so that placing
+ * files one after another costs constant time each on average.
+ *
+ * We can't allocate holding the spinlock; so allocate first, and if
+ * another thread grew the table meanwhile, throw ours away.
+ */
+static
+int
+filetable_grow(struct filetable *ft, unsigned want)
+{
+	struct openfile **newfiles, **oldfiles;
+	unsigned newsize, fd;
+
+	spinlock_acquire(&ft->ft_lock);
+	newsize = ft->ft_size;
+	spinlock_release(&ft->ft_lock);
+
+	if (want <= newsize) {
+		return 0;
+	}
+	newsize = newsize == 0 ? FILETABLE_MINSIZE : newsize * 2;
+	if (newsize > FILETABLE_MAX) {
+		newsize = FILETABLE_MAX;
+	}
+	if (newsize < want) {
+		newsize = want;
+	}
+
+	newfiles = kmalloc(newsize * sizeof(newfiles[0]));
+	if (newfiles == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	if (ft->ft_size >= newsize) {
+		/* someone else got there first */
+		spinlock_release(&ft->ft_lock);
+		kfree(newfiles);
+		return 0;
+	}
+	for (fd = 0; fd < ft->ft_size; fd++) {
+		newfiles[fd] = ft->ft_openfiles[fd];
+	}
+	for (; fd < newsize; fd++) {
+		newfiles[fd] = NULL;
+	}
+	oldfiles = ft->ft_openfiles;
+	ft->ft_openfiles = newfiles;
+	ft->ft_size = newsize;
+	spinlock_release(&ft->ft_lock);
+
+	if (oldfiles != NULL) {
+		kfree(oldfiles);
+	}
+	return 0;
+}
+
 /*
  * Clone a filetable, for use in fork.
  *
@@ -94,13 +164,17 @@ filetable_destroy(struct filetable *ft)
  *
  * produce the intended output instead of having the second echo
  * command overwrite the first.
+ *
+ * Only the slots up to the highest one in use are copied, so the new
+ * table is no bigger than it needs to be.
  */
 int
 filetable_copy(struct filetable *src, struct filetable **dest_ret)
 {
 	struct filetable *dest;
 	struct openfile *file;
-	int fd;
+	unsigned fd, top;
+	int result;
 
 	/* Copying the nonexistent table avoids special cases elsewhere */
 	if (src == NULL) {
@@ -113,29 +187,109 @@ filetable_copy(struct filetable *src, struct filetable **dest_ret)
 		return ENOMEM;
 	}
 
+	/* make room; another of our threads might open more meanwhile */
+	spinlock_acquire(&src->ft_lock);
+	while (src->ft_top > dest->ft_size) {
+		top = src->ft_top;
+		spinlock_release(&src->ft_lock);
+		result = filetable_grow(dest, top);
+		if (result) {
+			filetable_destroy(dest);
+			return result;
+		}
+		spinlock_acquire(&src->ft_lock);
+	}
+
 	/* share the entries */
-	for (fd = 0; fd < OPEN_MAX; fd++) {
+	for (fd = 0; fd < src->ft_top; fd++) {
 		file = src->ft_openfiles[fd];
 		if (file != NULL) {
 			openfile_incref(file);
 		}
 		dest->ft_openfiles[fd] = file;
 	}
+	dest->ft_lowfree = src->ft_lowfree;
+	dest->ft_top = src->ft_top;
+	dest->ft_limit = src->ft_limit;
+	dest->ft_hardlimit = src->ft_hardlimit;
+	spinlock_release(&src->ft_lock);
 
 	*dest_ret = dest;
 	return 0;
 }
 
 /*
- * Check if a file handle is in range.
+ * Make a new filetable, for use in spawn, whose file handle i is
+ * shared with file handle fds[i] of src, for i < nfds; or is left
+ * empty if fds[i] is -1. Everything past nfds starts empty. The
+ * limits are inherited, and nfds may not exceed the soft limit.
+ */
+int
+filetable_remap(struct filetable *src, const int *fds, int nfds,
+		struct filetable **dest_ret)
+{
+	struct filetable *dest;
+	struct openfile *file, *oldfile;
+	unsigned limit, hardlimit;
+	int fd, result;
+
+	KASSERT(src != NULL);
+
+	filetable_getlimit(src, &limit, &hardlimit);
+	if (nfds < 0 || (unsigned)nfds > limit) {
+		return EINVAL;
+	}
+
+	dest = filetable_create();
+	if (dest == NULL) {
+		return ENOMEM;
+	}
+	dest->ft_limit = limit;
+	dest->ft_hardlimit = hardlimit;
+
+	for (fd = 0; fd < nfds; fd++) {
+		if (fds[fd] == -1) {
+			continue;
+		}
+		/* get's reference becomes the table's */
+		result = filetable_get(src, fds[fd], &file);
+		if (result) {
+			filetable_destroy(dest);
+			return result;
+		}
+		result = filetable_placeat(dest, file, fd, &oldfile);
+		if (result) {
+			openfile_decref(file);
+			filetable_destroy(dest);
+			return result;
+		}
+		KASSERT(oldfile == NULL);
+	}
+
+	*dest_ret = dest;
+	return 0;
+}
+
+/*
+ * Check if a file handle is in range: below the limit, or in the
+ * table anyway (it may have been opened before the limit was
+ * lowered).
  */
 bool
 filetable_okfd(struct filetable *ft, int fd)
 {
-	/* We have a fixed-size table so we don't need to check the size */
-	(void)ft;
+	bool ret;
+
+	if (fd < 0) {
+		return false;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	ret = (unsigned)fd < ft->ft_limit ||
+		((unsigned)fd < ft->ft_size && ft->ft_openfiles[fd] != NULL);
+	spinlock_release(&ft->ft_lock);
 
-	return (fd >= 0 && fd < OPEN_MAX);
+	return ret;
 }
 
 /*
@@ -145,46 +299,52 @@ filetable_okfd(struct filetable *ft, int fd)
  * This checks that the file handle is in range and fails rather than
  * returning a null openfile; it only yields files that are actually
  * open.
+ *
+ * The caller gets its own reference to the openfile, so it stays
+ * valid even if another thread closes the handle meanwhile.
  */
 int
 filetable_get(struct filetable *ft, int fd, struct openfile **ret)
 {
 	struct openfile *file;
 
-	if (!filetable_okfd(ft, fd)) {
+	if (fd < 0) {
 		return EBADF;
 	}
 
+	spinlock_acquire(&ft->ft_lock);
+	if ((unsigned)fd >= ft->ft_size) {
+		spinlock_release(&ft->ft_lock);
+		return EBADF;
+	}
 	file = ft->ft_openfiles[fd];
 	if (file == NULL) {
+		spinlock_release(&ft->ft_lock);
 		return EBADF;
 	}
+	openfile_incref(file);
+	spinlock_release(&ft->ft_lock);
 
 	*ret = file;
 	return 0;
 }
 
 /*
- * Put a file handle back when done with it. This does not actually do
- * anything (other than crosscheck) but it's always good practice to
- * build things so when you take them out you put them back again
- * rather than dropping them on the floor. Then if you need to do
- * something at cleanup time you can put it in this function instead
- * of having to hunt for all the places to insert the new logic.
+ * Put a file handle back when done with it. This drops the reference
+ * filetable_get took, which closes the file if the handle was closed
+ * in the meantime.
  *
- * (For example, if you have multithreaded processes you will need to
- * insert additional lock and/or refcount manipulations here and in
- * filetable_get.)
- *
- * The openfile should be the one returned from filetable_get. If you
- * want to manipulate the table so the assertion's no longer true, get
- * your own reference to the openfile (with openfile_incref) and call
- * filetable_put before mucking about.
+ * The openfile should be the one returned from filetable_get. It may
+ * no longer be in the table at FD (if another thread closed or
+ * replaced it) so that's not checked.
  */
 void
 filetable_put(struct filetable *ft, int fd, struct openfile *file)
 {
-	KASSERT(ft->ft_openfiles[fd] == file);
+	(void)ft;
+	(void)fd;
+
+	openfile_decref(file);
 }
 
 /*
@@ -194,44 +354,197 @@ filetable_put(struct filetable *ft, int fd, struct openfile *file)
  * the behavior had to be defined explicitly in order to allow
  * manipulating stdin/stdout/stderr.)
  *
+ * The search starts at ft_lowfree, so it doesn't go over the in-use
+ * slots at the bottom every time.
+ *
  * Consumes a reference to the openfile object. (That reference is
  * placed in the table.)
  */
 int
 filetable_place(struct filetable *ft, struct openfile *file, int *fd_ret)
 {
-	int fd;
+	unsigned fd, end;
+	int result;
 
-	for (fd = 0; fd < OPEN_MAX; fd++) {
-		if (ft->ft_openfiles[fd] == NULL) {
-			ft->ft_openfiles[fd] = file;
-			*fd_ret = fd;
-			return 0;
+	spinlock_acquire(&ft->ft_lock);
+	while (1) {
+		end = ft->ft_size < ft->ft_limit ? ft->ft_size : ft->ft_limit;
+		for (fd = ft->ft_lowfree; fd < end; fd++) {
+			if (ft->ft_openfiles[fd] == NULL) {
+				ft->ft_openfiles[fd] = file;
+				ft->ft_lowfree = fd + 1;
+				if (ft->ft_top <= fd) {
+					ft->ft_top = fd + 1;
+				}
+				spinlock_release(&ft->ft_lock);
+				*fd_ret = fd;
+				return 0;
+			}
+		}
+		/* the slots up to here are all in use */
+		ft->ft_lowfree = fd;
+
+		if (end == ft->ft_limit) {
+			break;
+		}
+
+		/* full, but the limit allows more; grow and look again */
+		spinlock_release(&ft->ft_lock);
+		result = filetable_grow(ft, end + 1);
+		if (result) {
+			return result;
 		}
+		spinlock_acquire(&ft->ft_lock);
 	}
+	spinlock_release(&ft->ft_lock);
 
 	return EMFILE;
 }
 
+/*
+ * Update the free-slot hints after clearing slot FD. Call with the
+ * table locked.
+ */
+static
+void
+filetable_cleared(struct filetable *ft, unsigned fd)
+{
+	if (fd < ft->ft_lowfree) {
+		ft->ft_lowfree = fd;
+	}
+	while (ft->ft_top > 0 && ft->ft_openfiles[ft->ft_top - 1] == NULL) {
+		ft->ft_top--;
+	}
+}
+
 /*
  * Place a file in a file table at a specific location and return the
- * file previously at that location. The location must be in range.
+ * file previously at that location. The location should have passed
+ * filetable_okfd; the table is grown if needed to reach it.
  *
  * Consumes a reference to the passed-in openfile object; returns a
  * reference to the old openfile object (if not NULL); this should
  * generally be decref'd.
  *
- * Doesn't fail.
+ * Fails only if the table has to grow and can't, or if the location
+ * is at or past the limit (e.g. because another thread lowered it)
+ * and isn't already open.
+ * Placing NULL never fails.
  *
  * Note that you can use this to place NULL in the filetable, which is
  * potentially handy.
  */
-void
+int
 filetable_placeat(struct filetable *ft, struct openfile *newfile, int fd,
 		  struct openfile **oldfile_ret)
 {
-	KASSERT(filetable_okfd(ft, fd));
+	unsigned ufd;
+	int result;
+
+	KASSERT(fd >= 0);
+	ufd = fd;
 
-	*oldfile_ret = ft->ft_openfiles[fd];
-	ft->ft_openfiles[fd] = newfile;
+	spinlock_acquire(&ft->ft_lock);
+	while (ufd >= ft->ft_size) {
+		if (newfile == NULL) {
+			/* past the end, so nothing there to clear */
+			spinlock_release(&ft->ft_lock);
+			*oldfile_ret = NULL;
+			return 0;
+		}
+		if (ufd >= ft->ft_limit) {
+			spinlock_release(&ft->ft_lock);
+			return EBADF;
+		}
+		spinlock_release(&ft->ft_lock);
+		result = filetable_grow(ft, ufd + 1);
+		if (result) {
+			return result;
+		}
+		spinlock_acquire(&ft->ft_lock);
+	}
+
+	if (newfile != NULL && ufd >= ft->ft_limit &&
+	    ft->ft_openfiles[ufd] == NULL) {
+		/* past the limit; only replacing an open handle is allowed */
+		spinlock_release(&ft->ft_lock);
+		return EBADF;
+	}
+
+	*oldfile_ret = ft->ft_openfiles[ufd];
+	ft->ft_openfiles[ufd] = newfile;
+
+	if (newfile == NULL) {
+		filetable_cleared(ft, ufd);
+	}
+	else if (ufd >= ft->ft_top) {
+		ft->ft_top = ufd + 1;
+	}
+	spinlock_release(&ft->ft_lock);
+
+	return 0;
+}
+
+/*
+ * Take a file back out of a file table, but only if it's still at
+ * FD; another thread may have closed or replaced it since it was
+ * placed. Returns true if it was removed, in which case the table's
+ * reference to it becomes the caller's. If not, whoever took it out
+ * already dealt with that reference.
+ */
+bool
+filetable_unplace(struct filetable *ft, int fd, struct openfile *file)
+{
+	unsigned ufd;
+	bool ret;
+
+	KASSERT(fd >= 0);
+	KASSERT(file != NULL);
+	ufd = fd;
+
+	spinlock_acquire(&ft->ft_lock);
+	ret = ufd < ft->ft_size && ft->ft_openfiles[ufd] == file;
+	if (ret) {
+		ft->ft_openfiles[ufd] = NULL;
+		filetable_cleared(ft, ufd);
+	}
+	spinlock_release(&ft->ft_lock);
+
+	return ret;
+}
+
+/*
+ * Get the limits on the number of file handles.
+ */
+void
+filetable_getlimit(struct filetable *ft, unsigned *cur, unsigned *max)
+{
+	spinlock_acquire(&ft->ft_lock);
+	*cur = ft->ft_limit;
+	*max = ft->ft_hardlimit;
+	spinlock_release(&ft->ft_lock);
+}
+
+/*
+ * Set the limits on the number of file handles. The hard limit can
+ * be lowered but not raised. Files already open past a lowered soft
+ * limit stay open.
+ */
+int
+filetable_setlimit(struct filetable *ft, unsigned cur, unsigned max)
+{
+	if (cur > max) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&ft->ft_lock);
+	if (max > ft->ft_hardlimit) {
+		spinlock_release(&ft->ft_lock);
+		return EPERM;
+	}
+	ft->ft_limit = cur;
+	ft->ft_hardlimit = max;
+	spinlock_release(&ft->ft_lock);
+
+	return 0;
 }
@@ -34,6 +34,8 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/wait.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
@@ -42,11 +44,11 @@
 #include <current.h>
 #include <copyinout.h>
 #include <pid.h>
+#include <filetable.h>
+#include <futex.h>
 #include <syscall.h>
 #include <addrspace.h>
 
-#define VM_STACKPAGES    18
-
 /* note that sys_execv is in runprogram.c */
 
 
@@ -84,12 +86,13 @@ sys__exit(int status)
 
 static
 void
-fork_newthread(void *vtf, unsigned long junk)
+fork_newthread(void *vtf, unsigned long tid)
 {
 	struct trapframe mytf;
 	struct trapframe *ntf = vtf;
 
-	(void)junk;
+	/* We're the same thread of the new process as our parent was. */
+	curthread->t_tid = tid;
 
 	/*
 	 * Now copy the trapframe to our stack, so we can free the one
@@ -130,7 +133,7 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	*retval = newproc->p_pid;
 
 	result = thread_fork(curthread->t_name, newproc,
-			     fork_newthread, ntf, 0);
+			     fork_newthread, ntf, curthread->t_tid);
 	if (result) {
 		proc_unfork(newproc);
 		kfree(ntf);
@@ -161,11 +164,311 @@ sys_waitpid(pid_t pid, userptr_t retstatus, int flags, pid_t *retval)
 	return result;
 }
 
+/*
+ * Convert a threadusage to a struct rusage.
+ *
+ * The run time is exact, but whether it was spent in user mode or in
+ * the kernel is only known from hardclock samples, so split it in the
+ * same proportion as the samples. With no samples at all (it never
+ * ran for a whole tick) call it all system time, as BSD does.
+ */
+static
+void
+usage_to_rusage(const struct threadusage *tu, struct rusage *ru)
+{
+	uint64_t run, user, ticks;
+
+	bzero(ru, sizeof(*ru));
+
+	run = (uint64_t)tu->tu_runtime.tv_sec * 1000000000
+		+ tu->tu_runtime.tv_nsec;
+	ticks = (uint64_t)tu->tu_uticks + tu->tu_sticks;
+	user = ticks == 0 ? 0 : run * tu->tu_uticks / ticks;
+
+	ru->ru_utime.tv_sec = user / 1000000000;
+	ru->ru_utime.tv_usec = (user % 1000000000) / 1000;
+	ru->ru_stime.tv_sec = (run - user) / 1000000000;
+	ru->ru_stime.tv_usec = ((run - user) % 1000000000) / 1000;
+
+	ru->ru_minflt = tu->tu_minflt;
+	ru->ru_majflt = tu->tu_majflt;
+	ru->ru_inblock = tu->tu_inblock;
+	ru->ru_oublock = tu->tu_oublock;
+	ru->ru_nvcsw = tu->tu_nvcsw;
+	ru->ru_nivcsw = tu->tu_nivcsw;
+}
+
+/*
+ * sys_getrusage
+ * report the resources used by this process, or by the children it
+ * has waited for.
+ */
+int
+sys_getrusage(int who, userptr_t usage)
+{
+	struct threadusage tu;
+	struct rusage ru;
+
+	switch (who) {
+	    case RUSAGE_SELF:
+		proc_getusage(curproc, &tu);
+		break;
+	    case RUSAGE_CHILDREN:
+		spinlock_acquire(&curproc->p_lock);
+		tu = curproc->p_cusage;
+		spinlock_release(&curproc->p_lock);
+		break;
+	    default:
+		return EINVAL;
+	}
+
+	usage_to_rusage(&tu, &ru);
+	return copyout(&ru, usage, sizeof(ru));
+}
+
+/*
+ * sys_getrlimit
+ * report a resource limit. Only RLIMIT_NOFILE is actually enforced
+ * (by the file table); the others are reported as unlimited.
+ */
+int
+sys_getrlimit(int resource, userptr_t rlp)
+{
+	struct rlimit rl;
+	unsigned cur, max;
+
+	if (resource < 0 || resource >= __RLIMIT_NUM) {
+		return EINVAL;
+	}
+
+	if (resource == RLIMIT_NOFILE) {
+		filetable_getlimit(curproc->p_filetable, &cur, &max);
+		rl.rlim_cur = cur;
+		rl.rlim_max = max;
+	}
+	else {
+		rl.rlim_cur = RLIM_INFINITY;
+		rl.rlim_max = RLIM_INFINITY;
+	}
+
+	return copyout(&rl, rlp, sizeof(rl));
+}
+
+/*
+ * sys_setrlimit
+ * set a resource limit. Only RLIMIT_NOFILE can be set.
+ */
+int
+sys_setrlimit(int resource, const_userptr_t rlp)
+{
+	struct rlimit rl;
+	int result;
+
+	if (resource != RLIMIT_NOFILE) {
+		return EINVAL;
+	}
+
+	result = copyin(rlp, &rl, sizeof(rl));
+	if (result) {
+		return result;
+	}
+
+	if (rl.rlim_cur > rl.rlim_max) {
+		return EINVAL;
+	}
+	if (rl.rlim_max > FILETABLE_MAX) {
+		/* more than the hard limit can ever be */
+		return EPERM;
+	}
+
+	return filetable_setlimit(curproc->p_filetable,
+				  rl.rlim_cur, rl.rlim_max);
+}
+
+/*
+ * sys_sched_setaffinity
+ * restrict this process to the cpus in MASK. There's no way to look
+ * up another process by pid, so PID must be 0 or our own.
+ */
+int
+sys_sched_setaffinity(pid_t pid, unsigned mask)
+{
+	int result;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	result = proc_setaffinity(curproc, mask);
+	if (result) {
+		return result;
+	}
+
+	/* Get off this cpu now if we're no longer allowed here. */
+	thread_affinity_enforce();
+	return 0;
+}
+
+/*
+ * sys_sched_getaffinity
+ * report the cpus this process may run on. Bits are only set for
+ * cpus that exist, so this also tells the caller how many there are.
+ */
+int
+sys_sched_getaffinity(pid_t pid, userptr_t mask)
+{
+	unsigned kmask;
+
+	if (pid != 0 && pid != curproc->p_pid) {
+		return ESRCH;
+	}
+
+	kmask = thread_getaffinity(curthread);
+	return copyout(&kmask, mask, sizeof(kmask));
+}
+
+/*
+ * What a new user thread needs to get going; see uthread_start.
+ */
+struct uthread_args {
+	struct trapframe ua_tf;
+	int ua_tid;
+	vaddr_t ua_entry;
+	userptr_t ua_func;
+	userptr_t ua_arg;
+	vaddr_t ua_stack;
+};
+
+/*
+ * The new thread of a user process begins executing here. Like
+ * fork_newthread, copy the args to our own stack first.
+ */
+static
+void
+uthread_start(void *vargs, unsigned long junk)
+{
+	struct uthread_args myargs;
+	struct uthread_args *args = vargs;
+
+	(void)junk;
+
+	myargs = *args;
+	kfree(args);
+
+	curthread->t_tid = myargs.ua_tid;
+
+	/* The process may have exited before we got to run. */
+	proc_checkexit();
+
+	enter_new_thread(&myargs.ua_tf, myargs.ua_entry,
+			 myargs.ua_func, myargs.ua_arg, myargs.ua_stack);
+}
+
+/*
+ * sys___thread_create
+ * start a new thread in this process, running START(FUNC, ARG) on
+ * its own user stack. START is the libc thread startup routine and
+ * must not return. Returns the new thread id.
+ */
+int
+sys___thread_create(struct trapframe *tf, userptr_t start,
+		    userptr_t func, userptr_t arg, int *retval)
+{
+	struct uthread_args *args;
+	int tid;
+	int result;
+
+	args = kmalloc(sizeof(*args));
+	if (args == NULL) {
+		return ENOMEM;
+	}
+
+	result = proc_thread_alloc(&tid);
+	if (result) {
+		kfree(args);
+		return result;
+	}
+
+	result = as_define_tstack(proc_getas(), tid, &args->ua_stack);
+	if (result) {
+		proc_thread_unalloc(tid);
+		kfree(args);
+		return result;
+	}
+
+	args->ua_tf = *tf;
+	args->ua_tid = tid;
+	args->ua_entry = (vaddr_t)start;
+	args->ua_func = func;
+	args->ua_arg = arg;
+
+	/* Same affinity as the calling thread, like fork. */
+	result = thread_fork(curthread->t_name, NULL,
+			     uthread_start, args, 0);
+	if (result) {
+		proc_thread_unalloc(tid);
+		kfree(args);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+/*
+ * sys_thread_exit
+ * the process-level work happens in proc_thread_exit().
+ */
+__DEAD
+void
+sys_thread_exit(userptr_t retval)
+{
+	proc_thread_exit(retval);
+}
+
+/*
+ * sys_thread_join
+ * wait for a thread and collect what it passed to thread_exit.
+ */
+int
+sys_thread_join(int tid, userptr_t retval)
+{
+	userptr_t kretval;
+	int result;
+
+	result = proc_thread_join(tid, &kretval);
+	if (result) {
+		return result;
+	}
+
+	if (retval != NULL) {
+		result = copyout(&kretval, retval, sizeof(kretval));
+	}
+	return result;
+}
+
+/*
+ * sys_futex_wait
+ * sys_futex_wake
+ * just pass off the work to the futex code.
+ */
+int
+sys_futex_wait(userptr_t uaddr, int val)
+{
+	return futex_wait(uaddr, val);
+}
+
+int
+sys_futex_wake(userptr_t uaddr, unsigned count, int *retval)
+{
+	return futex_wake(uaddr, count, retval);
+}
+
 int
 sys_sbrk(intptr_t amount, int* retval) 
 {
 	struct addrspace *as = proc_getas();
-	vaddr_t heapbreak = as->as_heaptop;
+	vaddr_t heapbreak;
 	
 	// check for alignment
 	if (amount % PAGE_SIZE != 0) {
@@ -174,8 +477,13 @@ sys_sbrk(intptr_t amount, int* retval)
 		return EINVAL;
 	}
 
+	// other threads in the process may be moving the break too
+	spinlock_acquire(&as->as_lock);
+	heapbreak = as->as_heaptop;
+
 	// if sbrk(0), return the heaptop
 	if (amount == 0) {
+		spinlock_release(&as->as_lock);
 		*retval = (int)heapbreak;
 		return 0;
 	}
@@ -186,26 +494,32 @@ sys_sbrk(intptr_t amount, int* retval)
 	//
 	if (amount < 0) {
 		if (heapbreak + amount < as->as_heapbase) {
+			spinlock_release(&as->as_lock);
 			DEBUG(DB_EXEC, "heaptop hits heapbase\n");
 			*retval = (int)((void *)-1);
 			return EINVAL;
 		} else {
 			as->as_heaptop += amount;
+			spinlock_release(&as->as_lock);
 			*retval = (int)heapbreak;
 			return 0;
 		}
 	} 
 
-	// final check if added sum exceeds to stack segment, not allowed
+	// final check if added sum exceeds to stack segment (or the thread
+	// stacks below it), not allowed
 	// else increase the heaptop, return original new heaptop
 	//
-	if (as->as_heaptop + amount >= PADDR_TO_KVADDR(as->as_stackbase[VM_STACKPAGES-1])) {
+	if (as->as_heaptop + amount >= PADDR_TO_KVADDR(as->as_stackbase[VM_STACKPAGES-1]) ||
+	    as->as_heaptop + amount > AS_TSTACKBASE) {
+		spinlock_release(&as->as_lock);
 		DEBUG(DB_EXEC, "heaptop hits stacktop\n");
 		*retval = (int)((void *)-1);
 		return ENOMEM;
 	}
 
 	as->as_heaptop += amount;
+	spinlock_release(&as->as_lock);
 	*retval = (int)heapbreak;
 	return 0;
-}
\ No newline at end of file
+}
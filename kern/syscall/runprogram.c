@@ -28,16 +28,18 @@
  */
 
 /*
- * Code for running a user program from the menu, and code for execv,
- * which have a lot in common.
+ * Code for running a user program from the menu, and code for execv
+ * and spawnv, which have a lot in common.
  */
 
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
+#include <thread.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
@@ -47,6 +49,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pid.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -54,13 +57,17 @@
  * argv buffer.
  *
  * This is an abstraction that holds an argv while it's being shuffled
- * through the kernel during exec.
+ * through the kernel during exec. The data is whole pages, laid out
+ * (by argbuf_layout) the way the new process will see its argv; the
+ * pages used are then handed to the new address space as the top of
+ * its stack, so the strings are copied only once, on the way in.
  */
 struct argbuf {
 	char *data;
 	size_t len;
 	size_t max;
 	int nargs;
+	unsigned npages;
 	bool tooksem;
 };
 
@@ -95,6 +102,7 @@ argbuf_init(struct argbuf *buf)
 	buf->len = 0;
 	buf->max = 0;
 	buf->nargs = 0;
+	buf->npages = 0;
 	buf->tooksem = false;
 }
 
@@ -105,13 +113,18 @@ static
 void
 argbuf_cleanup(struct argbuf *buf)
 {
+	size_t i;
+
 	if (buf->data != NULL) {
-		kfree(buf->data);
+		for (i=0; i<buf->max; i += PAGE_SIZE) {
+			free_kpages((vaddr_t)buf->data + i);
+		}
 		buf->data = NULL;
 	}
 	buf->len = 0;
 	buf->max = 0;
 	buf->nargs = 0;
+	buf->npages = 0;
 	if (buf->tooksem) {
 		V(execthrottle);
 		buf->tooksem = false;
@@ -119,20 +132,40 @@ argbuf_cleanup(struct argbuf *buf)
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Allocate the memory for an argv buffer. SIZE must be whole pages.
+ * They're split up so we can give away some and free the rest.
  */
 static
 int
 argbuf_allocate(struct argbuf *buf, size_t size)
 {
-	buf->data = kmalloc(size);
-	if (buf->data == NULL) {
+	vaddr_t addr;
+
+	KASSERT(size % PAGE_SIZE == 0);
+
+	addr = alloc_kpages(size / PAGE_SIZE);
+	if (addr == 0) {
 		return ENOMEM;
 	}
+	vm_splitkpages(addr, size / PAGE_SIZE);
+
+	buf->data = (char *)addr;
 	buf->max = size;
 	return 0;
 }
 
+/*
+ * Space the argv takes once laid out: the strings, then, aligned,
+ * the argv pointers and the ending NULL.
+ */
+static
+size_t
+argbuf_size(struct argbuf *buf)
+{
+	return ROUNDUP(buf->len, sizeof(userptr_t)) +
+		(buf->nargs + 1) * sizeof(userptr_t);
+}
+
 /*
  * Prepare an argv buffer for runprogram, using a kernel pointer.
  *
@@ -148,14 +181,20 @@ argbuf_fromkernel(struct argbuf *buf, const char *progname)
 
 	len = strlen(progname) + 1;
 
-	result = argbuf_allocate(buf, len);
+	result = argbuf_allocate(buf, PAGE_SIZE);
 	if (result) {
 		return result;
 	}
+	if (len > buf->max) {
+		return E2BIG;
+	}
 	strcpy(buf->data, progname);
 	buf->len = len;
 	buf->nargs = 1;
 
+	if (argbuf_size(buf) > buf->max) {
+		return E2BIG;
+	}
 	return 0;
 }
 
@@ -203,6 +242,11 @@ argbuf_copyin(struct argbuf *buf, userptr_t uargv)
 		buf->nargs++;
 	}
 
+	/* The argv pointers have to fit too. */
+	if (argbuf_size(buf) > buf->max) {
+		return E2BIG;
+	}
+
 	return 0;
 }
 
@@ -248,86 +292,73 @@ argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 }
 
 /*
- * Copy an argv out of kernel space to user space.
- *
- * Note: ustackp is an in/out argument.
+ * Lay the argv out for the new process: after the strings, aligned,
+ * goes the argv pointer array. The pages used will be the top of the
+ * user stack, ending at USERSTACK, so the user address of each
+ * string is already known. The rest of the last page is cleared so
+ * that nothing of the kernel's goes out with it.
  */
 static
-int
-argbuf_copyout(struct argbuf *buf, vaddr_t *ustackp,
-	       int *argc_ret, userptr_t *uargv_ret)
+void
+argbuf_layout(struct argbuf *buf, int *argc_ret, userptr_t *uargv_ret)
 {
-	vaddr_t ustack;
-	userptr_t ustringbase, uargvbase, uargv_i;
-	userptr_t thisarg;
-	size_t thisarglen;
-	size_t pos;
-	int result;
-
-	/* Begin the stack at the passed in top. */
-	ustack = *ustackp;
-
-	/*
-	 * Allocate space.
-	 *
-	 * buf->pos is the amount of space used by the strings; put that
-	 * first, then align the stack, then make space for the argv
-	 * pointers. Allow an extra slot for the ending NULL.
-	 */
+	size_t argvpos, end, pos;
+	vaddr_t ubase;
+	userptr_t *kargv;
+	int i;
 
-	ustack -= buf->len;
-	ustack -= (ustack & (sizeof(void *) - 1));
-	ustringbase = (userptr_t)ustack;
+	argvpos = ROUNDUP(buf->len, sizeof(userptr_t));
+	end = argbuf_size(buf);
+	KASSERT(end <= buf->max);
 
-	ustack -= (buf->nargs + 1) * sizeof(userptr_t);
-	uargvbase = (userptr_t)ustack;
+	buf->npages = DIVROUNDUP(end, PAGE_SIZE);
+	ubase = USERSTACK - buf->npages * PAGE_SIZE;
 
-	/* Now copy the data out. */
+	/* Fill in the argv array. */
+	kargv = (userptr_t *)(buf->data + argvpos);
 	pos = 0;
-	uargv_i = uargvbase;
-	while (pos < buf->len) {
-		/* The user address of the string will be ustringbase + pos. */
-		thisarg = ustringbase + pos;
-
-		/* Place it in the argv array. */
-		result = copyout(&thisarg, uargv_i, sizeof(thisarg));
-		if (result) {
-			return result;
-		}
-
-		/* Push out the string. */
-		result = copyoutstr(buf->data + pos, thisarg,
-				    buf->len - pos, &thisarglen);
-		if (result) {
-			return result;
-		}
-
-		/* thisarglen includes the \0 */
-		pos += thisarglen;
-		uargv_i += sizeof(thisarg);
+	for (i=0; i<buf->nargs; i++) {
+		kargv[i] = (userptr_t)(ubase + pos);
+		/* strlen doesn't include the \0 */
+		pos += strlen(buf->data + pos) + 1;
 	}
 	/* Should have come out even... */
 	KASSERT(pos == buf->len);
+	kargv[buf->nargs] = NULL;
 
-	/* Add the NULL. */
-	thisarg = NULL;
-	result = copyout(&thisarg, uargv_i, sizeof(userptr_t));
-	if (result) {
-		return result;
-	}
+	bzero(buf->data + buf->len, argvpos - buf->len);
+	bzero(buf->data + end, buf->npages * PAGE_SIZE - end);
 
-	*ustackp = ustack;
 	*argc_ret = buf->nargs;
-	*uargv_ret = uargvbase;
-	return 0;
+	*uargv_ret = (userptr_t)(ubase + argvpos);
+}
+
+/*
+ * The new address space has taken the laid-out pages; free the
+ * rest. (The throttle, if we took it, is kept until cleanup.)
+ */
+static
+void
+argbuf_handoff(struct argbuf *buf)
+{
+	size_t i;
+
+	for (i = buf->npages * PAGE_SIZE; i<buf->max; i += PAGE_SIZE) {
+		free_kpages((vaddr_t)buf->data + i);
+	}
+	buf->data = NULL;
+	buf->max = 0;
 }
 
 /*
  * Common code for execv and runprogram: loading the executable.
+ * ARGS must have been laid out already; on success its pages belong
+ * to the new address space.
  */
 static
 int
-loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
+loadexec(char *path, struct argbuf *args,
+	 vaddr_t *entrypoint, vaddr_t *stackptr)
 {
 	struct addrspace *newvm, *oldvm;
 	struct vnode *v;
@@ -376,8 +407,9 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 
 	vfs_close(v);
 
-	/* Define the user stack in the address space */
-	result = as_define_stack(newvm, stackptr);
+	/* Define the user stack in the address space, with the argv on it */
+	result = as_define_stack(newvm, (vaddr_t)args->data, args->npages,
+				 stackptr);
 	if (result) {
 		proc_setas(oldvm);
 		as_activate();
@@ -385,6 +417,7 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 		kfree(newname);
 		return result;
         }
+	argbuf_handoff(args);
 
 	/*
 	 * Wipe out old address space.
@@ -432,7 +465,11 @@ placed_open(const char *path, int openflags, int fd)
 	}
 
 	/* place the file in the filetable in the right slot */
-	filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	result = filetable_placeat(curproc->p_filetable, newfile, fd, &oldfile);
+	if (result) {
+		openfile_decref(newfile);
+		return result;
+	}
 
 	/* the table should previously have been empty */
 	KASSERT(oldfile == NULL);
@@ -518,21 +555,16 @@ runprogram(char *progname)
 		argbuf_cleanup(&kargv);
 		return result;
 	}
+	argbuf_layout(&kargv, &argc, &uargv);
 
 	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(progname, &entrypoint, &stackptr);
+	result = loadexec(progname, &kargv, &entrypoint, &stackptr);
 	if (result) {
 		argbuf_cleanup(&kargv);
 		return result;
 	}
 
-	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
-	if (result) {
-		/* If copyout fails, *we* messed up, so panic */
-		panic("execv: copyout_args failed: %s\n", strerror(result));
-	}
-
-	/* free the space */
+	/* free what's left */
 	argbuf_cleanup(&kargv);
 
 	/* Warp to user mode. */
@@ -546,11 +578,11 @@ runprogram(char *progname)
 /*
  * execv.
  *
+ * 0. Refuse if the process has other threads.
  * 1. Copy in the program name.
- * 2. Copy in the argv with copyin_args.
- * 3. Load the executable.
- * 4. Copy the argv out again with copyout_args.
- * 5. Warp to usermode.
+ * 2. Copy in the argv with argbuf_fromuser, and lay it out.
+ * 3. Load the executable, giving it the argv pages as its stack top.
+ * 4. Warp to usermode.
  */
 int
 sys_execv(userptr_t prog, userptr_t uargv)
@@ -561,6 +593,15 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	int argc;
 	int result;
 
+	/*
+	 * The other threads would be left running in the new image.
+	 * (Since we're the only one, none can appear meanwhile.)
+	 */
+	result = proc_exec_threads();
+	if (result) {
+		return result;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -583,32 +624,199 @@ sys_execv(userptr_t prog, userptr_t uargv)
 		kfree(path);
 		return result;
 	}
+	argbuf_layout(&kargv, &argc, &uargv);
 
 	/* Load the executable. Note: must not fail after this succeeds. */
-	result = loadexec(path, &entrypoint, &stackptr);
+	result = loadexec(path, &kargv, &entrypoint, &stackptr);
 	if (result) {
 		argbuf_cleanup(&kargv);
 		kfree(path);
 		return result;
 	}
 
-	/* don't need this any more */
+	/* don't need these any more */
 	kfree(path);
+	argbuf_cleanup(&kargv);
+
+	/* We are thread 0 of the new image. */
+	proc_exec_done();
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+	return EINVAL;
+}
+
+/*
+ * What sys_spawnv hands to the new process's first thread.
+ */
+struct spawnargs {
+	char *path;			/* program to load */
+	struct argbuf *kargv;		/* its argv, laid out */
+	int argc;			/* where the argv will be */
+	userptr_t uargv;
+	struct semaphore *done;		/* posted once loaded (or not) */
+	int result;			/* how the load went */
+};
+
+/*
+ * First thread of a process made by spawnv: load the program into
+ * our empty address space, report back, and warp to user mode.
+ */
+static
+void
+spawn_newthread(void *vsa, unsigned long junk)
+{
+	struct spawnargs *sa = vsa;
+	vaddr_t entrypoint, stackptr;
+	int argc;
+	userptr_t uargv;
+	int result;
+
+	(void)junk;
+
+	/* The parent laid out the argv; get where it'll be. */
+	argc = sa->argc;
+	uargv = sa->uargv;
+
+	result = loadexec(sa->path, sa->kargv, &entrypoint, &stackptr);
+
+	/* The parent is waiting; after this, sa is gone. */
+	sa->result = result;
+	V(sa->done);
 
-	/* Send the argv strings to the process. */
-	result = argbuf_copyout(&kargv, &stackptr, &argc, &uargv);
 	if (result) {
-		/* if copyout fails, *we* messed up, so panic */
-		panic("execv: copyout_args failed: %s\n", strerror(result));
+		/* The parent collects our exit status and reports result. */
+		proc_exit(_MKWAIT_EXIT(255));
 	}
 
-	/* free the argv buffer space */
-	argbuf_cleanup(&kargv);
-
 	/* Warp to user mode. */
 	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
 
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
-	return EINVAL;
+}
+
+/*
+ * spawnv: run a program in a new process, like fork followed by
+ * execv in the child, but without copying the caller's address space
+ * only to throw it away.
+ *
+ * 1. Copy in the program name, argv, and file handle list.
+ * 2. Make the new process, with no address space.
+ * 3. Start its thread, which loads the executable, with the argv
+ *    pages we laid out as the top of its stack.
+ * 4. Wait until it has, so that if it couldn't we can collect it and
+ *    fail with the error, the way execv would have.
+ *
+ * If ufds is null the new process gets a copy of our file table;
+ * otherwise its file handle i is our ufds[i] (or closed, if -1), for
+ * i < nfds, and nothing else is open.
+ */
+int
+sys_spawnv(userptr_t prog, userptr_t uargv, userptr_t ufds, int nfds,
+	   pid_t *retval)
+{
+	int *fds;
+	unsigned limit, hardlimit;
+	struct spawnargs sa;
+	struct argbuf kargv;
+	struct proc *newproc;
+	pid_t pid;
+	int result;
+
+	fds = NULL;
+	if (ufds != NULL) {
+		/* the list can reach as far as our own soft limit */
+		filetable_getlimit(curproc->p_filetable, &limit, &hardlimit);
+		if (nfds < 0 || (unsigned)nfds > limit) {
+			return EINVAL;
+		}
+		/* allocate at least one so an empty list isn't NULL */
+		fds = kmalloc((nfds > 0 ? nfds : 1) * sizeof(fds[0]));
+		if (fds == NULL) {
+			return ENOMEM;
+		}
+		result = copyin(ufds, fds, nfds * sizeof(fds[0]));
+		if (result) {
+			kfree(fds);
+			return result;
+		}
+	}
+
+	sa.path = kmalloc(PATH_MAX);
+	if (sa.path == NULL) {
+		kfree(fds);
+		return ENOMEM;
+	}
+
+	/* Get the filename. */
+	result = copyinstr(prog, sa.path, PATH_MAX, NULL);
+	if (result) {
+		kfree(sa.path);
+		kfree(fds);
+		return result;
+	}
+
+	/* get the argv strings. */
+	argbuf_init(&kargv);
+	result = argbuf_fromuser(&kargv, uargv);
+	if (result) {
+		argbuf_cleanup(&kargv);
+		kfree(sa.path);
+		kfree(fds);
+		return result;
+	}
+	argbuf_layout(&kargv, &sa.argc, &sa.uargv);
+	sa.kargv = &kargv;
+
+	sa.done = sem_create("spawn", 0);
+	if (sa.done == NULL) {
+		argbuf_cleanup(&kargv);
+		kfree(sa.path);
+		kfree(fds);
+		return ENOMEM;
+	}
+	sa.result = 0;
+
+	/* the new process's table is built from the list; done with it */
+	result = proc_spawn(fds, nfds, &newproc);
+	kfree(fds);
+	if (result) {
+		sem_destroy(sa.done);
+		argbuf_cleanup(&kargv);
+		kfree(sa.path);
+		return result;
+	}
+	pid = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     spawn_newthread, &sa, 0);
+	if (result) {
+		proc_unfork(newproc);
+		sem_destroy(sa.done);
+		argbuf_cleanup(&kargv);
+		kfree(sa.path);
+		return result;
+	}
+
+	P(sa.done);
+
+	sem_destroy(sa.done);
+	argbuf_cleanup(&kargv);
+	kfree(sa.path);
+
+	if (sa.result) {
+		/*
+		 * It's exiting. Collect it so it doesn't linger. (If
+		 * another of our threads beats us to it, that's fine.)
+		 */
+		pid_wait(pid, NULL, 0, NULL);
+		return sa.result;
+	}
+
+	*retval = pid;
+	return 0;
 }
@@ -28,7 +28,9 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <clock.h>
+#include <callout.h>
 #include <copyinout.h>
 #include <syscall.h>
 
@@ -56,3 +58,40 @@ sys___time(userptr_t user_seconds_ptr, userptr_t user_nanoseconds_ptr)
 
 	return 0;
 }
+
+/*
+ * Sleep for the time given by REQ, rounded up to whole hardclocks.
+ * One tick is added because the current tick is already partly over.
+ *
+ * Since there are no signals, the sleep is only interrupted if the
+ * process is exiting, when nobody will see the result; so REM (the
+ * time remaining) is never written.
+ */
+int
+sys_nanosleep(const_userptr_t user_req, userptr_t user_rem)
+{
+	struct timespec req;
+	uint64_t ticks;
+	int result;
+
+	(void)user_rem;
+
+	result = copyin(user_req, &req, sizeof(req));
+	if (result) {
+		return result;
+	}
+	if (req.tv_sec < 0 || req.tv_nsec < 0 || req.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
+
+	if (req.tv_sec >= CALLOUT_MAXTICKS / HZ) {
+		ticks = CALLOUT_MAXTICKS;
+	}
+	else {
+		ticks = req.tv_sec * HZ +
+			(req.tv_nsec + 1000000000/HZ - 1) / (1000000000/HZ);
+		ticks++;
+	}
+
+	return ticksleep(ticks);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Tickless idle test.
+ *
+ * Sleeps for a while with idle cpus ticking and then again with them
+ * tickless, and reports the timer interrupts taken per second by the
+ * whole system in each case. The test's own cpu is idle while it
+ * sleeps too, so on an otherwise quiet system nearly all of these are
+ * idle ticks; each one is a trip through the interrupt path, so this
+ * is proportional to the instructions executed per idle second. The
+ * cycle counts sys161 prints at shutdown show the same thing.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <test.h>
+
+#define DEFAULT_SECS 5
+
+static
+unsigned
+idlemeasure(int secs)
+{
+	unsigned before, after;
+
+	/* Give cpus that are already idle a chance to notice the setting. */
+	clocksleep(1);
+
+	before = thread_timerints();
+	clocksleep(secs);
+	after = thread_timerints();
+
+	return (after - before) / secs;
+}
+
+int
+idletest(int nargs, char **args)
+{
+	unsigned saved, ticking, tickless;
+	int secs;
+
+	secs = DEFAULT_SECS;
+	if (nargs > 1) {
+		secs = atoi(args[1]);
+	}
+	if (secs <= 0) {
+		kprintf("Usage: idt [seconds]\n");
+		return EINVAL;
+	}
+
+	kprintf("Starting idle tick test (%d seconds each)...\n", secs);
+
+	saved = hardclock_tickless;
+	hardclock_tickless = 0;
+	ticking = idlemeasure(secs);
+	hardclock_tickless = 1;
+	tickless = idlemeasure(secs);
+	hardclock_tickless = saved;
+
+	kprintf("Timer interrupts per second, all cpus: "
+		"%u ticking, %u tickless\n", ticking, tickless);
+	kprintf("Idle tick test done.\n");
+	return 0;
+}
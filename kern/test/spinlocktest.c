@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Spinlock contention benchmark.
+ *
+ * One thread per cpu, each pinned to its cpu, takes and releases a
+ * shared spinlock until the group has done NSPINACQUIRES between
+ * them. This is run for 1, 2, 4, ... cpus, first with a plain
+ * test-and-test-and-set lock for comparison, then with the ticket
+ * spinlock with and without backoff. For each run it prints the
+ * acquisitions per second, and how evenly they were spread: the
+ * fewest any one cpu got as a percentage of the most.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <test.h>
+
+#define NSPINACQUIRES	20000
+#define NSPINCPUS	32	/* bits in cpumask_t */
+
+enum spinkind {
+	SPIN_TTAS,
+	SPIN_TICKET,
+};
+
+static struct spinlock benchlock = SPINLOCK_INITIALIZER;
+static volatile spinlock_data_t benchword = SPINLOCK_DATA_INITIALIZER;
+static volatile unsigned benchtotal;
+static unsigned benchcounts[NSPINCPUS];
+static enum spinkind benchkind;
+static struct semaphore *startsem;
+static struct semaphore *donesem;
+
+/*
+ * Test-and-test-and-set, as spinlock_acquire used to do it.
+ */
+static
+int
+ttas_acquire(void)
+{
+	int s;
+
+	s = splhigh();
+	while (spinlock_data_get(&benchword) != 0 ||
+	       spinlock_data_testandset(&benchword) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return s;
+}
+
+static
+void
+ttas_release(int s)
+{
+	membar_any_store();
+	spinlock_data_set(&benchword, 0);
+	splx(s);
+}
+
+static
+void
+spinthread(void *junk, unsigned long num)
+{
+	unsigned count = 0;
+	bool done;
+	int s = 0;
+
+	(void)junk;
+
+	P(startsem);
+	do {
+		if (benchkind == SPIN_TTAS) {
+			s = ttas_acquire();
+		}
+		else {
+			spinlock_acquire(&benchlock);
+		}
+
+		done = (benchtotal >= NSPINACQUIRES);
+		if (!done) {
+			benchtotal++;
+			count++;
+		}
+
+		if (benchkind == SPIN_TTAS) {
+			ttas_release(s);
+		}
+		else {
+			spinlock_release(&benchlock);
+		}
+	} while (!done);
+
+	benchcounts[num] = count;
+	V(donesem);
+}
+
+static
+void
+spinrun(const char *label, enum spinkind kind, const unsigned *cpus,
+	unsigned ncpus)
+{
+	struct timespec before, after, duration;
+	uint64_t usecs;
+	unsigned i, min, max;
+	int result;
+
+	benchkind = kind;
+	benchtotal = 0;
+	for (i=0; i<ncpus; i++) {
+		benchcounts[i] = 0;
+		result = thread_fork_affinity("spinbench", NULL,
+					      CPUMASK_CPU(cpus[i]),
+					      spinthread, NULL, i);
+		if (result) {
+			panic("spinlocktest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&before);
+	for (i=0; i<ncpus; i++) {
+		V(startsem);
+	}
+	for (i=0; i<ncpus; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+
+	min = max = benchcounts[0];
+	for (i=1; i<ncpus; i++) {
+		if (benchcounts[i] < min) {
+			min = benchcounts[i];
+		}
+		if (benchcounts[i] > max) {
+			max = benchcounts[i];
+		}
+	}
+
+	timespec_sub(&after, &before, &duration);
+	usecs = duration.tv_sec * 1000000ULL + duration.tv_nsec / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	kprintf("%-16s %2u cpus: %8llu acquires/sec, fairness %3u%%\n",
+		label, ncpus,
+		(unsigned long long)(NSPINACQUIRES * 1000000ULL / usecs),
+		max > 0 ? min * 100 / max : 100);
+}
+
+int
+spinlocktest(int nargs, char **args)
+{
+	unsigned cpus[NSPINCPUS];
+	unsigned ncpus, n, i;
+	unsigned savedbackoff;
+	cpumask_t mask;
+
+	(void)nargs;
+	(void)args;
+
+	if (startsem == NULL) {
+		startsem = sem_create("spinbench start", 0);
+		donesem = sem_create("spinbench done", 0);
+		if (startsem == NULL || donesem == NULL) {
+			panic("spinlocktest: sem_create failed\n");
+		}
+	}
+
+	/* The cpus we're allowed on are the ones to use. */
+	mask = thread_getaffinity(curthread);
+	ncpus = 0;
+	for (i=0; i<NSPINCPUS; i++) {
+		if (mask & CPUMASK_CPU(i)) {
+			cpus[ncpus++] = i;
+		}
+	}
+
+	kprintf("Starting spinlock contention test...\n");
+
+	savedbackoff = spinlock_backoff;
+	n = 1;
+	while (1) {
+		spinrun("ttas", SPIN_TTAS, cpus, n);
+		spinlock_backoff = 0;
+		spinrun("ticket", SPIN_TICKET, cpus, n);
+		spinlock_backoff = savedbackoff;
+		spinrun("ticket+backoff", SPIN_TICKET, cpus, n);
+
+		if (n == ncpus) {
+			break;
+		}
+		n = (n * 2 > ncpus) ? ncpus : n * 2;
+	}
+
+	kprintf("Spinlock contention test done.\n");
+	return 0;
+}
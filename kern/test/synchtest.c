@@ -400,3 +400,162 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+/*
+ * Reader/writer lock test.
+ *
+ * One thread in four is a writer; the rest read. Writers update the
+ * three test values together and check that no reader is inside;
+ * readers check that the values are consistent and that no writer
+ * is inside. Some readers also try to upgrade to a write hold and
+ * then downgrade back again.
+ */
+
+#define NRWLOOPS 200
+
+static struct rwlock *testrwlock;
+static struct spinlock rwcount_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwreaders;
+static volatile unsigned rwmaxreaders;
+static volatile bool rwwriting;
+static volatile unsigned rwupgrades;
+
+static
+void
+rwfail(unsigned long num, const char *msg)
+{
+	kprintf("thread %lu: %s\n", num, msg);
+	panic("rwtest failed\n");
+}
+
+static
+void
+rwcheckvals(unsigned long num)
+{
+	if (testval2 != testval1*testval1) {
+		rwfail(num, "Mismatch on testval2/testval1");
+	}
+	if (testval3 != testval1%3) {
+		rwfail(num, "Mismatch on testval3/testval1");
+	}
+}
+
+static
+void
+rwenter(void)
+{
+	spinlock_acquire(&rwcount_lock);
+	rwreaders++;
+	if (rwreaders > rwmaxreaders) {
+		rwmaxreaders = rwreaders;
+	}
+	spinlock_release(&rwcount_lock);
+}
+
+static
+void
+rwleave(void)
+{
+	spinlock_acquire(&rwcount_lock);
+	rwreaders--;
+	spinlock_release(&rwcount_lock);
+}
+
+static
+void
+rwwrite(unsigned long num)
+{
+	if (rwreaders != 0) {
+		rwfail(num, "Readers present during write");
+	}
+	rwwriting = true;
+	testval1 = num;
+	thread_yield();
+	testval2 = num*num;
+	testval3 = num%3;
+	rwcheckvals(num);
+	rwwriting = false;
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrwlock);
+			KASSERT(rwlock_do_i_hold_write(testrwlock));
+			rwwrite(num);
+			rwlock_release_write(testrwlock);
+			continue;
+		}
+
+		rwlock_acquire_read(testrwlock);
+		rwenter();
+		if (rwwriting) {
+			rwfail(num, "Writer present during read");
+		}
+		rwcheckvals(num);
+		thread_yield();
+		rwcheckvals(num);
+
+		if (num % 4 == 1 && i % 8 == 0) {
+			rwleave();
+			if (rwlock_upgrade(testrwlock)) {
+				KASSERT(rwlock_do_i_hold_write(testrwlock));
+				rwwrite(num);
+				rwlock_downgrade(testrwlock);
+				spinlock_acquire(&rwcount_lock);
+				rwupgrades++;
+				spinlock_release(&rwcount_lock);
+			}
+			rwenter();
+			rwcheckvals(num);
+		}
+
+		rwleave();
+		rwlock_release_read(testrwlock);
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (testrwlock == NULL) {
+		testrwlock = rwlock_create("testrwlock");
+		if (testrwlock == NULL) {
+			panic("rwtest: rwlock_create failed\n");
+		}
+	}
+	testval1 = testval2 = testval3 = 0;
+	rwreaders = rwmaxreaders = rwupgrades = 0;
+	rwwriting = false;
+
+	kprintf("Starting rwlock test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Most concurrent readers: %u; upgrades: %u\n",
+		rwmaxreaders, rwupgrades);
+	kprintf("Rwlock test done.\n");
+	return 0;
+}
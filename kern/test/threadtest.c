@@ -32,11 +32,13 @@
  */
 #include <types.h>
 #include <lib.h>
+#include <clock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
 
 #define NTHREADS  8
+#define NFORKS    2000
 
 static struct semaphore *tsem = NULL;
 
@@ -144,3 +146,77 @@ threadtest2(int nargs, char **args)
 
 	return 0;
 }
+
+static
+void
+nullthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	V(tsem);
+}
+
+/*
+ * Fork NFORKS threads that exit immediately, NTHREADS at a time, and
+ * return the number per second.
+ */
+static
+unsigned
+forkrate(void)
+{
+	struct timespec before, after, duration;
+	uint64_t usecs;
+	int i, j, result;
+
+	gettime(&before);
+	for (i=0; i<NFORKS; i+=NTHREADS) {
+		for (j=0; j<NTHREADS; j++) {
+			result = thread_fork("forkrate", NULL, nullthread,
+					     NULL, j);
+			if (result) {
+				panic("threadtest4: thread_fork failed %s)\n",
+				      strerror(result));
+			}
+		}
+		for (j=0; j<NTHREADS; j++) {
+			P(tsem);
+		}
+	}
+	gettime(&after);
+
+	timespec_sub(&after, &before, &duration);
+	usecs = duration.tv_sec * 1000000ULL + duration.tv_nsec / 1000;
+	if (usecs == 0) {
+		usecs = 1;
+	}
+	return (NFORKS * 1000000ULL) / usecs;
+}
+
+/*
+ * Measure the thread fork rate with and without the thread cache.
+ */
+int
+threadtest4(int nargs, char **args)
+{
+	unsigned saved, uncached, cached;
+
+	(void)nargs;
+	(void)args;
+
+	init_sem();
+	kprintf("Starting thread test 4...\n");
+
+	saved = thread_cache_max;
+	thread_cache_max = 0;
+	uncached = forkrate();
+	thread_cache_max = saved > 0 ? saved : NTHREADS;
+	cached = forkrate();
+	thread_cache_max = saved;
+
+	kprintf("Thread forks per second: %u uncached, %u cached\n",
+		uncached, cached);
+	kprintf("Thread test 4 done.\n");
+
+	return 0;
+}
@@ -31,6 +31,7 @@
  * Wait test code.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <stdarg.h>
@@ -257,6 +258,40 @@ waittest(int nargs, char **args)
 		printstatus(kid, err, status);
 	}
 
+	/*
+	 * This fourth set is collected with WAIT_ANY, in whatever
+	 * order they exit. Once they're all gone, there are no
+	 * children left to wait for, so one more wait should fail.
+	 */
+
+	kprintf("\n");
+	kprintf("Set 4 (wait for any child)\n");
+	kprintf("--------------------------\n");
+
+	for (i = 0; i < NTHREADS; i++) {
+		err = dofork("wait test thread", waitfirstthread, NULL, i,
+			     &kid);
+		if (err) {
+			panic("waittest: dofork failed (%d)\n", err);
+		}
+		kprintf("Spawned pid %d\n", kid);
+	}
+
+	for (i = 0; i < NTHREADS; i++) {
+		kprintf("Waiting on any child...\n");
+		err = pid_wait(WAIT_ANY, &status, 0, &kid);
+		printstatus(err ? WAIT_ANY : kid, err, status);
+	}
+
+	err = pid_wait(WAIT_ANY, &status, WNOHANG, &kid);
+	if (err == ECHILD) {
+		kprintf("No children left, as expected\n");
+	}
+	else {
+		kprintf("Wait with no children: error %d, pid %d!\n",
+			err, err ? 0 : kid);
+	}
+
 	kprintf("\nWait test done.\n");
 
 	return 0;
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Work queue test.
+ */
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <callout.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NWORK    200
+#define NDELAYED 20
+
+static struct spinlock wqt_lock = SPINLOCK_INITIALIZER;
+static unsigned wqt_count;
+
+static
+void
+countwork(void *arg)
+{
+	(void)arg;
+
+	spinlock_acquire(&wqt_lock);
+	wqt_count++;
+	spinlock_release(&wqt_lock);
+}
+
+/*
+ * Queue more work from work, to check that drain waits for it.
+ */
+static
+void
+chainwork(void *arg)
+{
+	unsigned n = (unsigned)(uintptr_t)arg;
+
+	countwork(NULL);
+	if (n > 0) {
+		if (work_enqueue(chainwork, (void *)(uintptr_t)(n - 1))) {
+			panic("wqt: work_enqueue failed\n");
+		}
+	}
+}
+
+/*
+ * Queue work from interrupt context.
+ */
+static
+void
+interruptwork(void *arg)
+{
+	(void)arg;
+	if (work_enqueue(countwork, NULL)) {
+		panic("wqt: work_enqueue from interrupt failed\n");
+	}
+}
+
+static
+unsigned
+wqt_getcount(void)
+{
+	unsigned ret;
+
+	spinlock_acquire(&wqt_lock);
+	ret = wqt_count;
+	wqt_count = 0;
+	spinlock_release(&wqt_lock);
+	return ret;
+}
+
+int
+workqueuetest(int nargs, char **args)
+{
+	struct callout co;
+	unsigned i, count;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting work queue test...\n");
+	wqt_getcount();
+
+	/* Queued work is all done after a flush. */
+	for (i=0; i<NWORK; i++) {
+		if (work_enqueue(countwork, NULL)) {
+			panic("wqt: work_enqueue failed\n");
+		}
+	}
+	workqueue_flush();
+	count = wqt_getcount();
+	kprintf("wqt: %u of %u queued items run after flush\n",
+		count, NWORK);
+	if (count != NWORK) {
+		panic("wqt: flush returned early\n");
+	}
+
+	/* Delayed work, and work queueing more work, is done after drain. */
+	for (i=0; i<NDELAYED; i++) {
+		if (work_enqueue_delayed(countwork, NULL, i * 2)) {
+			panic("wqt: work_enqueue_delayed failed\n");
+		}
+	}
+	if (work_enqueue(chainwork, (void *)(uintptr_t)(NWORK - 1))) {
+		panic("wqt: work_enqueue failed\n");
+	}
+	workqueue_drain();
+	count = wqt_getcount();
+	kprintf("wqt: %u of %u delayed and chained items run after drain\n",
+		count, NDELAYED + NWORK);
+	if (count != NDELAYED + NWORK) {
+		panic("wqt: drain returned early\n");
+	}
+
+	/* Work can be queued from an interrupt handler. */
+	callout_init(&co, interruptwork, NULL);
+	callout_schedule(&co, 1);
+	ticksleep(2);
+	callout_cancel(&co);
+	workqueue_flush();
+	count = wqt_getcount();
+	kprintf("wqt: %u of 1 items queued from interrupt run after flush\n",
+		count);
+	if (count != 1) {
+		panic("wqt: work queued from interrupt was lost\n");
+	}
+
+	kprintf("Work queue test done.\n");
+	return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Callouts, kept on a hierarchical timer wheel.
+ *
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SIZE slots each. A
+ * callout due within WHEEL_SIZE ticks goes in level 0, in the slot
+ * for its expiry tick; one due later goes in the first level whose
+ * slots are wide enough to reach it, again indexed by its expiry
+ * time. Each tick we run the level 0 slot for that tick. Whenever
+ * the level 0 index wraps around, the next slot of level 1 is
+ * emptied and its callouts reinserted ("cascaded"), which drops them
+ * into level 0; likewise level 2 is cascaded into level 1 when level
+ * 1 wraps, and so on.
+ *
+ * There is one wheel for the whole system, driven by cpu 0's
+ * hardclock. The wheel is protected by callout_lock; callout
+ * functions are called without it held.
+ *
+ * When cpu 0 goes idle it may stop its clock until the next callout
+ * is due (see callout_idle); every tick skipped is processed in order
+ * when it starts again, so all this costs is latency. A callout
+ * scheduled meanwhile that is due sooner than that wakes cpu 0 up.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <current.h>
+#include <callout.h>
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1U << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+
+static struct spinlock callout_lock;
+static struct callout *callout_wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static unsigned callout_now;		/* Next tick to be processed */
+static unsigned callout_npending;	/* Number of callouts on the wheel */
+static struct callout *callout_running;	/* Callout being called now */
+
+/* Tickless idle state; see callout_idle */
+static struct cpu *callout_sleepcpu;	/* Cpu sleeping, or NULL */
+static unsigned callout_deadline;	/* Last tick it won't process */
+
+/*
+ * Setup.
+ */
+void
+callout_bootstrap(void)
+{
+	spinlock_init(&callout_lock);
+	callout_now = 0;
+	callout_npending = 0;
+	callout_running = NULL;
+	callout_sleepcpu = NULL;
+	callout_deadline = 0;
+}
+
+void
+callout_init(struct callout *co, void (*func)(void *), void *arg)
+{
+	co->co_func = func;
+	co->co_arg = arg;
+	co->co_expire = 0;
+	co->co_pending = false;
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+}
+
+/*
+ * Put a callout on the wheel according to co_expire.
+ */
+static
+void
+callout_insert(struct callout *co)
+{
+	struct callout **head;
+	unsigned delta, level, slot;
+
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+	KASSERT(!co->co_pending);
+
+	delta = co->co_expire - callout_now;
+	KASSERT(delta <= CALLOUT_MAXTICKS);
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1U << (WHEEL_BITS * (level + 1)))) {
+			break;
+		}
+	}
+	slot = (co->co_expire >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	head = &callout_wheel[level][slot];
+
+	co->co_next = *head;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = &co->co_next;
+	}
+	co->co_prevp = head;
+	*head = co;
+	co->co_pending = true;
+	callout_npending++;
+}
+
+/*
+ * Take a callout off whatever list it's on.
+ */
+static
+void
+callout_remove(struct callout *co)
+{
+	KASSERT(spinlock_do_i_hold(&callout_lock));
+	KASSERT(co->co_pending);
+
+	*co->co_prevp = co->co_next;
+	if (co->co_next != NULL) {
+		co->co_next->co_prevp = co->co_prevp;
+	}
+	co->co_next = NULL;
+	co->co_prevp = NULL;
+	co->co_pending = false;
+	callout_npending--;
+}
+
+/*
+ * Move all the callouts in one slot of a higher level down the wheel.
+ */
+static
+void
+callout_cascade(unsigned level, unsigned slot)
+{
+	struct callout *co;
+
+	while ((co = callout_wheel[level][slot]) != NULL) {
+		callout_remove(co);
+		callout_insert(co);
+	}
+}
+
+void
+callout_schedule(struct callout *co, unsigned ticks)
+{
+	struct cpu *wake = NULL;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > CALLOUT_MAXTICKS) {
+		ticks = CALLOUT_MAXTICKS;
+	}
+
+	spinlock_acquire(&callout_lock);
+	if (co->co_pending) {
+		callout_remove(co);
+	}
+	co->co_expire = callout_now + ticks - 1;
+	callout_insert(co);
+	if (callout_sleepcpu != NULL && callout_sleepcpu != curcpu->c_self &&
+	    co->co_expire - callout_now < callout_deadline - callout_now) {
+		wake = callout_sleepcpu;
+	}
+	spinlock_release(&callout_lock);
+
+	if (wake != NULL) {
+		ipi_send(wake, IPI_UNIDLE);
+	}
+}
+
+bool
+callout_cancel(struct callout *co)
+{
+	bool ret = false;
+
+	spinlock_acquire(&callout_lock);
+	while (1) {
+		if (co->co_pending) {
+			callout_remove(co);
+			ret = true;
+		}
+		if (callout_running != co) {
+			break;
+		}
+		/* Wait for it to finish; it might reschedule itself. */
+		spinlock_release(&callout_lock);
+		spinlock_acquire(&callout_lock);
+	}
+	spinlock_release(&callout_lock);
+
+	return ret;
+}
+
+/*
+ * Advance the wheel by one tick and call whatever is due.
+ */
+void
+callout_hardclock(void)
+{
+	struct callout *expired, *co;
+	unsigned level, slot;
+
+	spinlock_acquire(&callout_lock);
+
+	if ((callout_now & WHEEL_MASK) == 0) {
+		for (level = 1; level < WHEEL_LEVELS; level++) {
+			slot = (callout_now >> (WHEEL_BITS * level))
+				& WHEEL_MASK;
+			callout_cascade(level, slot);
+			if (slot != 0) {
+				break;
+			}
+		}
+	}
+
+	/*
+	 * Detach this tick's slot before advancing, so that anything
+	 * scheduled by the functions we call lands on a later tick.
+	 * Callouts on the detached list can still be cancelled.
+	 */
+	slot = callout_now & WHEEL_MASK;
+	expired = callout_wheel[0][slot];
+	callout_wheel[0][slot] = NULL;
+	if (expired != NULL) {
+		expired->co_prevp = &expired;
+	}
+	callout_now++;
+
+	while ((co = expired) != NULL) {
+		callout_remove(co);
+		callout_running = co;
+		spinlock_release(&callout_lock);
+
+		co->co_func(co->co_arg);
+
+		spinlock_acquire(&callout_lock);
+		callout_running = NULL;
+	}
+
+	spinlock_release(&callout_lock);
+}
+
+/*
+ * Called by cpu 0 when it's about to go idle. Returns the number of
+ * ticks, at most MAXTICKS, it may sleep before some callout is due,
+ * and if that's more than one, notes that it's sleeping so that
+ * callout_schedule can wake it if needed.
+ *
+ * If the level 0 slots are all empty but there's something further
+ * out, we don't know exactly when it's due, so wake up in time for
+ * the next cascade and look again then.
+ */
+unsigned
+callout_idle(unsigned maxticks)
+{
+	unsigned n, ticks;
+
+	KASSERT(maxticks > 0);
+
+	spinlock_acquire(&callout_lock);
+
+	ticks = maxticks;
+	if (callout_npending > 0) {
+		for (n = 0; n < WHEEL_SIZE && n < maxticks; n++) {
+			if (callout_wheel[0][(callout_now + n) & WHEEL_MASK]
+			    != NULL) {
+				break;
+			}
+		}
+		if (n < WHEEL_SIZE && n < maxticks) {
+			/* found one due on the (n+1)th tick */
+			ticks = n + 1;
+		}
+		else if (n == WHEEL_SIZE) {
+			/* ticks until the next tick that cascades */
+			n = (WHEEL_SIZE - (callout_now & WHEEL_MASK)) & WHEEL_MASK;
+			if (n + 1 < ticks) {
+				ticks = n + 1;
+			}
+		}
+	}
+
+	if (ticks > 1) {
+		callout_sleepcpu = curcpu->c_self;
+		callout_deadline = callout_now + ticks - 1;
+	}
+
+	spinlock_release(&callout_lock);
+	return ticks;
+}
+
+/*
+ * Called by cpu 0 when it stops idling, before its next regular
+ * callout_hardclock, with the number of ticks it skipped. Process
+ * them all.
+ */
+void
+callout_wake(unsigned skipped)
+{
+	spinlock_acquire(&callout_lock);
+	callout_sleepcpu = NULL;
+	spinlock_release(&callout_lock);
+
+	while (skipped-- > 0) {
+		callout_hardclock();
+	}
+}
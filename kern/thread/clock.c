@@ -28,19 +28,22 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <cpu.h>
 #include <wchan.h>
+#include <callout.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution that one second.
+ * Callbacks at specific points in the future are handled by the
+ * callout code (callout.c), which is driven from hardclock() and so
+ * has a resolution of 1/HZ seconds. Timed sleeps are built on that.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -54,10 +57,28 @@
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Tickless idle. An idle cpu has nothing to do on a hardclock, so
+ * rather than taking HZ interrupts a second for nothing it stretches
+ * the next timer interrupt out to TICKLESS_MAXTICKS hardclocks, or on
+ * cpu 0 until the next callout is due. Anything that gives an idle
+ * cpu work sends it an interrupt anyway (IPI_UNIDLE), and when it
+ * wakes up for any reason it goes back to the normal rate and counts
+ * the ticks it skipped into c_hardclocks, so the scheduler's notion
+ * of time keeps moving.
+ *
+ * Set hardclock_tickless to 0 (from the kernel menu) to keep idle cpus
+ * ticking for comparison.
+ */
+#define TICKLESS_MAXTICKS	HZ	/* Tick at least once a second. */
+
+unsigned hardclock_tickless = 1;
+
+/*
+ * Threads in ticksleep() wait here. Nobody ever wakes this channel
+ * up; each sleeper's own timeout does.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+static struct wchan *sleepchan;
+static struct spinlock sleepchan_lock;
 
 /*
  * Setup.
@@ -65,10 +86,11 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	callout_bootstrap();
+	spinlock_init(&sleepchan_lock);
+	sleepchan = wchan_create("ticksleep");
+	if (sleepchan == NULL) {
+		panic("Couldn't create ticksleep wchan\n");
 	}
 }
 
@@ -79,10 +101,64 @@ hardclock_bootstrap(void)
 void
 timerclock(void)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	/* Nothing to do; timed sleeps are done with callouts. */
+}
+
+/*
+ * Account for hardclocks skipped while tickless.
+ */
+static
+void
+hardclock_catchup(unsigned skipped)
+{
+	curcpu->c_hardclocks += skipped;
+	curcpu->c_skippedticks += skipped;
+	if (curcpu->c_number == 0) {
+		callout_wake(skipped);
+	}
+}
+
+/*
+ * Called by an idle cpu, with interrupts off, just before it waits for
+ * an interrupt.
+ */
+void
+hardclock_idle_begin(void)
+{
+	unsigned ticks;
+
+	KASSERT(curcpu->c_stretch == 0);
+
+	if (!hardclock_tickless) {
+		return;
+	}
+
+	ticks = TICKLESS_MAXTICKS;
+	if (curcpu->c_number == 0) {
+		ticks = callout_idle(ticks);
+	}
+	if (ticks > 1) {
+		curcpu->c_stretch = ticks;
+		mainbus_timer_stretch(ticks);
+	}
+}
+
+/*
+ * Called by an idle cpu, with interrupts off, after it was woken up.
+ * If it was the stretched timer interrupt that woke us, hardclock()
+ * has already dealt with it.
+ */
+void
+hardclock_idle_end(void)
+{
+	unsigned skipped;
+
+	if (curcpu->c_stretch == 0) {
+		return;
+	}
+	skipped = mainbus_timer_unstretch(curcpu->c_stretch);
+	curcpu->c_stretch = 0;
+	hardclock_catchup(skipped);
 }
 
 /*
@@ -92,18 +168,46 @@ timerclock(void)
 void
 hardclock(void)
 {
+	unsigned skipped;
+
 	/*
 	 * Collect statistics here as desired.
 	 */
+	curcpu->c_timerints++;
+
+	if (curcpu->c_stretch > 0) {
+		/* the end of a stretched (tickless) period */
+		skipped = curcpu->c_stretch - 1;
+		curcpu->c_stretch = 0;
+		hardclock_catchup(skipped);
+	}
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		callout_hardclock();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
 	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	thread_tick();
+}
+
+/*
+ * Suspend execution for the given number of hardclocks. In a user
+ * process, stop early with EINTR if the process starts exiting.
+ */
+int
+ticksleep(unsigned ticks)
+{
+	int result;
+
+	spinlock_acquire(&sleepchan_lock);
+	result = timed_wchan_sleep_intr(sleepchan, &sleepchan_lock, ticks);
+	spinlock_release(&sleepchan_lock);
+	return result == ETIMEDOUT ? 0 : result;
 }
 
 /*
@@ -112,10 +216,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		ticksleep(num_secs * HZ);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention statistics. See lockstat.h.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <lockstat.h>
+
+/* Number of distinct lock names we keep track of. */
+#define LOCKSTAT_MAX		128
+
+/* Names longer than this are cut short. */
+#define LOCKSTAT_NAMELEN	24
+
+/*
+ * One record per lock name.
+ *
+ * The records can't be protected with spinlocks, since spinlocks
+ * themselves report here; instead each has a bare test-and-set word
+ * of its own, as does the table. Nothing is done while holding one
+ * except updating the numbers.
+ */
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];
+	volatile spinlock_data_t ls_busy;	/* guards the counts */
+	uint64_t ls_acquires;		/* times taken */
+	uint64_t ls_contended;		/* times the taker had to wait */
+	uint64_t ls_waitnsecs;		/* total time spent waiting */
+	uint64_t ls_maxholdnsecs;	/* longest hold */
+};
+
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned nlockstats;
+static volatile spinlock_data_t lockstats_busy;	/* guards the table */
+static volatile bool lockstat_on;
+
+/* The last slot catches everything once the table is full. */
+static struct lockstat *const lockstat_other = &lockstats[LOCKSTAT_MAX - 1];
+
+static
+void
+lockstat_grab(volatile spinlock_data_t *busy)
+{
+	splraise(IPL_NONE, IPL_HIGH);
+	while (spinlock_data_get(busy) != 0 ||
+	       spinlock_data_testandset(busy) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+}
+
+static
+void
+lockstat_drop(volatile spinlock_data_t *busy)
+{
+	membar_any_store();
+	spinlock_data_set(busy, 0);
+	spllower(IPL_HIGH, IPL_NONE);
+}
+
+/*
+ * Start recording. Before this, lockstat_now returns 0 and nothing
+ * gets counted.
+ */
+void
+lockstat_bootstrap(void)
+{
+	strcpy(lockstat_other->ls_name, "(other)");
+	lockstat_on = true;
+}
+
+struct lockstat *
+lockstat_get(const char *name)
+{
+	char key[LOCKSTAT_NAMELEN];
+	struct lockstat *ls;
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN - 1 && name[i] != 0; i++) {
+		key[i] = name[i];
+	}
+	key[i] = 0;
+
+	lockstat_grab(&lockstats_busy);
+	for (i=0; i<nlockstats; i++) {
+		ls = &lockstats[i];
+		if (!strcmp(ls->ls_name, key)) {
+			lockstat_drop(&lockstats_busy);
+			return ls;
+		}
+	}
+	if (nlockstats == LOCKSTAT_MAX - 1) {
+		lockstat_drop(&lockstats_busy);
+		return lockstat_other;
+	}
+	ls = &lockstats[nlockstats];
+	strcpy(ls->ls_name, key);
+	nlockstats++;
+	lockstat_drop(&lockstats_busy);
+	return ls;
+}
+
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+
+	if (!lockstat_on) {
+		return 0;
+	}
+	gettime(&ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+lockstat_acquired(struct lockstat *ls, bool contended, uint64_t waitnsecs)
+{
+	lockstat_grab(&ls->ls_busy);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+		ls->ls_waitnsecs += waitnsecs;
+	}
+	lockstat_drop(&ls->ls_busy);
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t holdnsecs)
+{
+	lockstat_grab(&ls->ls_busy);
+	if (holdnsecs > ls->ls_maxholdnsecs) {
+		ls->ls_maxholdnsecs = holdnsecs;
+	}
+	lockstat_drop(&ls->ls_busy);
+}
+
+/*
+ * Print the report. Take a copy first, since printing takes locks
+ * that will want to update the records; then sort it by total wait
+ * time, then by how often there was a wait.
+ */
+void
+lockstat_dump(void)
+{
+	struct lockstat *copy, tmp;
+	unsigned i, j, n;
+
+	lockstat_grab(&lockstats_busy);
+	n = nlockstats;
+	lockstat_drop(&lockstats_busy);
+
+	/* The catch-all goes at the end. */
+	copy = kmalloc((n + 1) * sizeof(*copy));
+	if (copy == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	for (i=0; i<n; i++) {
+		lockstat_grab(&lockstats[i].ls_busy);
+		copy[i] = lockstats[i];
+		lockstat_drop(&lockstats[i].ls_busy);
+	}
+	lockstat_grab(&lockstat_other->ls_busy);
+	copy[n] = *lockstat_other;
+	lockstat_drop(&lockstat_other->ls_busy);
+	n++;
+
+	for (i=1; i<n; i++) {
+		tmp = copy[i];
+		for (j=i; j>0; j--) {
+			if (copy[j-1].ls_waitnsecs > tmp.ls_waitnsecs ||
+			    (copy[j-1].ls_waitnsecs == tmp.ls_waitnsecs &&
+			     copy[j-1].ls_contended >= tmp.ls_contended)) {
+				break;
+			}
+			copy[j] = copy[j-1];
+		}
+		copy[j] = tmp;
+	}
+
+	kprintf("%-24s %10s %10s %5s %12s %10s\n", "lock", "acquires",
+		"contended", "cont%", "wait usec", "maxhold us");
+	for (i=0; i<n; i++) {
+		if (copy[i].ls_acquires == 0) {
+			continue;
+		}
+		kprintf("%-24s %10llu %10llu %4llu%% %12llu %10llu\n",
+			copy[i].ls_name,
+			copy[i].ls_acquires,
+			copy[i].ls_contended,
+			copy[i].ls_contended * 100 / copy[i].ls_acquires,
+			copy[i].ls_waitnsecs / 1000,
+			copy[i].ls_maxholdnsecs / 1000);
+	}
+
+	kfree(copy);
+}
+
+void
+lockstat_reset(void)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_MAX; i++) {
+		lockstat_grab(&lockstats[i].ls_busy);
+		lockstats[i].ls_acquires = 0;
+		lockstats[i].ls_contended = 0;
+		lockstats[i].ls_waitnsecs = 0;
+		lockstats[i].ls_maxholdnsecs = 0;
+		lockstat_drop(&lockstats[i].ls_busy);
+	}
+}
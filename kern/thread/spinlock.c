@@ -30,6 +30,7 @@
 /* Make sure to build out-of-line versions of inline functions */
 #define SPINLOCK_INLINE   /* empty */
 #define MEMBAR_INLINE     /* empty */
+#define ATOMIC_INLINE     /* empty */
 
 #include <types.h>
 #include <lib.h>
@@ -37,12 +38,31 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <membar.h>
+#include <atomic.h>
 #include <current.h>	/* for curcpu */
 
 /*
  * Spinlocks.
  */
 
+/* Delay-loop turns to wait per cpu ahead of us in line. */
+unsigned spinlock_backoff = 50;
+
+/*
+ * Wait a while without touching the lock. The loop counter is
+ * volatile so the compiler doesn't throw the loop away.
+ */
+static
+void
+spinlock_delay(unsigned turns)
+{
+	volatile unsigned i;
+
+	for (i=0; i<turns; i++) {
+		/* nothing */
+	}
+}
+
 
 /*
  * Initialize spinlock.
@@ -50,10 +70,54 @@
 void
 spinlock_init(struct spinlock *splk)
 {
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
+	spinlock_data_set(&splk->splk_serving, 0);
 	splk->splk_holder = NULL;
+#if OPT_LOCKSTAT
+	splk->splk_name = NULL;
+	splk->splk_stat = NULL;
+	splk->splk_holdstart = 0;
+#endif
 }
 
+/*
+ * Name a spinlock for lockstat.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+#if OPT_LOCKSTAT
+	splk->splk_name = name;
+	splk->splk_stat = NULL;
+#else
+	(void)splk;
+	(void)name;
+#endif
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Record an acquisition that began at START and note when the hold
+ * began. The stats record is looked up the first time, since many
+ * spinlocks are in use before lockstat is. We hold the lock, so
+ * the fields are ours to change.
+ */
+static
+void
+spinlock_stat_acquired(struct spinlock *splk, bool contended, uint64_t start)
+{
+	uint64_t now;
+
+	if (splk->splk_stat == NULL) {
+		splk->splk_stat = lockstat_get(splk->splk_name != NULL ?
+					       splk->splk_name : "spinlock");
+	}
+	now = lockstat_now();
+	lockstat_acquired(splk->splk_stat, contended, now - start);
+	splk->splk_holdstart = now;
+}
+#endif
+
 /*
  * Clean up spinlock.
  */
@@ -61,20 +125,26 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	KASSERT(spinlock_data_get(&splk->splk_next) ==
+		spinlock_data_get(&splk->splk_serving));
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket with
+ * a machine-level atomic increment and wait for it to come up.
  */
 void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+	bool contended = false;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +160,87 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+	/*
+	 * Only the atomic increment writes to the lock while we
+	 * wait; after that we just read splk_serving, which changes
+	 * once per release. Unsigned arithmetic takes care of the
+	 * counters wrapping around.
+	 */
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+#endif
+	ticket = spinlock_data_fetchinc(&splk->splk_next);
 	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+		serving = spinlock_data_get(&splk->splk_serving);
+		if (serving == ticket) {
+			break;
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+		contended = true;
+		spinlock_delay((ticket - serving) * spinlock_backoff);
+	}
+
+	membar_store_any();
+	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	if (start != 0) {
+		spinlock_stat_acquired(splk, contended, start);
+	}
+#else
+	(void)contended;
+#endif
+}
+
+/*
+ * Get the lock only if nobody has it. This is for callers that have
+ * something better to do than spin, or want to know whether they
+ * would have had to.
+ */
+bool
+spinlock_tryacquire(struct spinlock *splk)
+{
+	struct cpu *mycpu;
+	spinlock_data_t ticket;
+#if OPT_LOCKSTAT
+	uint64_t start;
+#endif
+
+	splraise(IPL_NONE, IPL_HIGH);
+
+	/* this must work before curcpu initialization */
+	if (CURCPU_EXISTS()) {
+		mycpu = curcpu->c_self;
+		if (splk->splk_holder == mycpu) {
+			panic("Deadlock on spinlock %p\n", splk);
 		}
-		break;
+	}
+	else {
+		mycpu = NULL;
 	}
 
+	/*
+	 * The lock is free if nobody holds a ticket that hasn't come
+	 * up yet. If so, take the next ticket, unless someone else
+	 * takes it first.
+	 */
+	ticket = spinlock_data_get(&splk->splk_serving);
+	if (spinlock_data_get(&splk->splk_next) != ticket ||
+	    spinlock_data_cas(&splk->splk_next, ticket, ticket+1) != ticket) {
+		spllower(IPL_HIGH, IPL_NONE);
+		return false;
+	}
+
+	if (mycpu != NULL) {
+		mycpu->c_spinlocks++;
+	}
 	membar_store_any();
 	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	start = lockstat_now();
+	if (start != 0) {
+		spinlock_stat_acquired(splk, false, start);
+	}
+#endif
+	return true;
 }
 
 /*
@@ -127,9 +256,19 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	if (splk->splk_holdstart != 0) {
+		lockstat_released(splk->splk_stat,
+				  lockstat_now() - splk->splk_holdstart);
+		splk->splk_holdstart = 0;
+	}
+#endif
+
+	/* Only the holder writes splk_serving, so no atomic op needed. */
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_serving,
+			  spinlock_data_get(&splk->splk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -36,10 +36,45 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
 
+#if OPT_LOCKSTAT
+/*
+ * Count an acquisition (or wait) of LS that began at START, and
+ * return the time now. Does nothing if START is 0, that is, if
+ * lockstat wasn't running yet.
+ */
+static
+uint64_t
+synch_stat(struct lockstat *ls, bool contended, uint64_t start)
+{
+	uint64_t now;
+
+	if (start == 0) {
+		return 0;
+	}
+	now = lockstat_now();
+	lockstat_acquired(ls, contended, now - start);
+	return now;
+}
+
+/*
+ * Count the end of a hold that began at *HOLDSTART, if it was timed.
+ */
+static
+void
+synch_stat_released(struct lockstat *ls, uint64_t *holdstart)
+{
+	if (*holdstart != 0) {
+		lockstat_released(ls, lockstat_now() - *holdstart);
+		*holdstart = 0;
+	}
+}
+#endif
+
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
@@ -68,7 +103,11 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, "sem_lock");
         sem->sem_count = initial_count;
+#if OPT_LOCKSTAT
+	sem->sem_stat = lockstat_get(name);
+#endif
 
         return sem;
 }
@@ -88,6 +127,11 @@ sem_destroy(struct semaphore *sem)
 void
 P(struct semaphore *sem)
 {
+	bool slept = false;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
         KASSERT(sem != NULL);
 
         /*
@@ -114,10 +158,55 @@ P(struct semaphore *sem)
 		 * ordering?
 		 */
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+		slept = true;
         }
         KASSERT(sem->sem_count > 0);
         sem->sem_count--;
 	spinlock_release(&sem->sem_lock);
+
+#if OPT_LOCKSTAT
+	synch_stat(sem->sem_stat, slept, start);
+#else
+	(void)slept;
+#endif
+}
+
+/*
+ * P, but give up with EINTR (without decrementing) if the current
+ * process starts exiting. See wchan_sleep_intr.
+ */
+int
+P_intr(struct semaphore *sem)
+{
+	bool slept = false;
+	int result = 0;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&sem->sem_lock);
+	while (sem->sem_count == 0) {
+		result = wchan_sleep_intr(sem->sem_wchan, &sem->sem_lock);
+		slept = true;
+		if (result) {
+			break;
+		}
+	}
+	if (!result) {
+		KASSERT(sem->sem_count > 0);
+		sem->sem_count--;
+	}
+	spinlock_release(&sem->sem_lock);
+
+#if OPT_LOCKSTAT
+	synch_stat(sem->sem_stat, slept, start);
+#else
+	(void)slept;
+#endif
+	return result;
 }
 
 void
@@ -161,7 +250,12 @@ lock_create(const char *name)
 		return NULL;
 	}
 	spinlock_init(&lock->lk_lock);
+	spinlock_setname(&lock->lk_lock, "lk_lock");
 	lock->lk_holder = NULL;
+#if OPT_LOCKSTAT
+	lock->lk_stat = lockstat_get(name);
+	lock->lk_holdstart = 0;
+#endif
 
         return lock;
 }
@@ -179,21 +273,90 @@ lock_destroy(struct lock *lock)
         kfree(lock);
 }
 
+/*
+ * Spin budget for a contended lock_acquire; see synch.h. Spinning is
+ * done in rounds of LOCK_SPINROUND turns, between which we check
+ * that the holder is still running.
+ */
+unsigned lock_spinmax = 2000;
+#define LOCK_SPINROUND 100
+
+/*
+ * Check if the holder of LOCK is running on another cpu. We need
+ * lk_lock held so the holder can't release the lock and go away
+ * while we look at it.
+ */
+static
+bool
+lock_holder_running(struct lock *lock)
+{
+	struct thread *holder = lock->lk_holder;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	return holder->t_state == S_RUN && holder->t_cpu != curcpu->c_self;
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread *holder;
+	unsigned spins, i;
+	bool slept;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
 	DEBUGASSERT(lock != NULL);
         KASSERT(curthread->t_in_interrupt == false);
 
+	spins = 0;
+	slept = false;
+
 	spinlock_acquire(&lock->lk_lock);
 	KASSERT(lock->lk_holder != curthread);
 	while (lock->lk_holder != NULL) {
+		if (spins < lock_spinmax && lock_holder_running(lock)) {
+			/*
+			 * Wait for the holder to let go, without the
+			 * spinlock so it can. Only the holder pointer
+			 * is looked at, since it may be gone by the
+			 * time we see it change.
+			 */
+			holder = lock->lk_holder;
+			spinlock_release(&lock->lk_lock);
+			for (i=0; i<LOCK_SPINROUND &&
+				     lock->lk_holder == holder; i++) {
+				/* nothing */
+			}
+			spins += i + 1;
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
 		/* As in the semaphore. */
                 wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		slept = true;
 	}
 
 	lock->lk_holder = curthread;
 	spinlock_release(&lock->lk_lock);
+
+	/* Only statistics; a lost count doesn't matter. */
+	if (slept) {
+		if (spins > 0) {
+			curcpu->c_lockspinfails++;
+		}
+		else {
+			curcpu->c_locksleeps++;
+		}
+	}
+	else if (spins > 0) {
+		curcpu->c_lockspins++;
+	}
+
+#if OPT_LOCKSTAT
+	lock->lk_holdstart = synch_stat(lock->lk_stat, slept || spins > 0,
+					start);
+#endif
 }
 
 void
@@ -201,6 +364,10 @@ lock_release(struct lock *lock)
 {
 	DEBUGASSERT(lock != NULL);
 
+#if OPT_LOCKSTAT
+	synch_stat_released(lock->lk_stat, &lock->lk_holdstart);
+#endif
+
 	spinlock_acquire(&lock->lk_lock);
 	KASSERT(lock->lk_holder == curthread);
 	lock->lk_holder = NULL;
@@ -251,6 +418,10 @@ cv_create(const char *name)
 	}
 
 	spinlock_init(&cv->cv_wchanlock);
+	spinlock_setname(&cv->cv_wchanlock, "cv_wchanlock");
+#if OPT_LOCKSTAT
+	cv->cv_stat = lockstat_get(name);
+#endif
         return cv;
 }
 
@@ -269,6 +440,10 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
 	spinlock_acquire(&cv->cv_wchanlock);
 	lock_release(lock);
 	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
@@ -281,7 +456,34 @@ cv_wait(struct cv *cv, struct lock *lock)
 	 * logic to make that work cleanly.
 	 */
 	spinlock_release(&cv->cv_wchanlock);
+#if OPT_LOCKSTAT
+	/* Every cv_wait waits; count it before retaking the lock. */
+	synch_stat(cv->cv_stat, true, start);
+#endif
+	lock_acquire(lock);
+}
+
+/*
+ * cv_wait, but return EINTR if the current process starts exiting.
+ * The lock is reacquired either way.
+ */
+int
+cv_wait_intr(struct cv *cv, struct lock *lock)
+{
+	int result;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	result = wchan_sleep_intr(cv->cv_wchan, &cv->cv_wchanlock);
+	spinlock_release(&cv->cv_wchanlock);
+#if OPT_LOCKSTAT
+	synch_stat(cv->cv_stat, true, start);
+#endif
 	lock_acquire(lock);
+	return result;
 }
 
 void
@@ -301,3 +503,253 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+        struct rwlock *rwlock;
+
+        rwlock = kmalloc(sizeof(struct rwlock));
+        if (rwlock == NULL) {
+                return NULL;
+        }
+
+        rwlock->rwl_name = kstrdup(name);
+        if (rwlock->rwl_name == NULL) {
+                kfree(rwlock);
+                return NULL;
+        }
+
+	rwlock->rwl_rwchan = wchan_create(rwlock->rwl_name);
+	rwlock->rwl_wwchan = wchan_create(rwlock->rwl_name);
+	rwlock->rwl_upwchan = wchan_create(rwlock->rwl_name);
+	if (rwlock->rwl_rwchan == NULL || rwlock->rwl_wwchan == NULL ||
+	    rwlock->rwl_upwchan == NULL) {
+		if (rwlock->rwl_rwchan != NULL) {
+			wchan_destroy(rwlock->rwl_rwchan);
+		}
+		if (rwlock->rwl_wwchan != NULL) {
+			wchan_destroy(rwlock->rwl_wwchan);
+		}
+		if (rwlock->rwl_upwchan != NULL) {
+			wchan_destroy(rwlock->rwl_upwchan);
+		}
+		kfree(rwlock->rwl_name);
+		kfree(rwlock);
+		return NULL;
+	}
+
+	spinlock_init(&rwlock->rwl_lock);
+	spinlock_setname(&rwlock->rwl_lock, "rwl_lock");
+	rwlock->rwl_readers = 0;
+	rwlock->rwl_writerswaiting = 0;
+	rwlock->rwl_writer = NULL;
+	rwlock->rwl_upgrading = false;
+#if OPT_LOCKSTAT
+	rwlock->rwl_stat = lockstat_get(name);
+	rwlock->rwl_holdstart = 0;
+#endif
+
+        return rwlock;
+}
+
+void
+rwlock_destroy(struct rwlock *rwlock)
+{
+        KASSERT(rwlock != NULL);
+
+	KASSERT(rwlock->rwl_readers == 0);
+	KASSERT(rwlock->rwl_writer == NULL);
+	KASSERT(rwlock->rwl_writerswaiting == 0);
+	spinlock_cleanup(&rwlock->rwl_lock);
+	wchan_destroy(rwlock->rwl_upwchan);
+	wchan_destroy(rwlock->rwl_wwchan);
+	wchan_destroy(rwlock->rwl_rwchan);
+
+        kfree(rwlock->rwl_name);
+        kfree(rwlock);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rwlock)
+{
+	bool slept = false;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
+	DEBUGASSERT(rwlock != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_writer != curthread);
+	/* Stand aside for waiting writers too; see synch.h. */
+	while (rwlock->rwl_writer != NULL || rwlock->rwl_writerswaiting > 0) {
+		wchan_sleep(rwlock->rwl_rwchan, &rwlock->rwl_lock);
+		slept = true;
+	}
+	rwlock->rwl_readers++;
+	spinlock_release(&rwlock->rwl_lock);
+
+#if OPT_LOCKSTAT
+	synch_stat(rwlock->rwl_stat, slept, start);
+#else
+	(void)slept;
+#endif
+}
+
+void
+rwlock_release_read(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_readers > 0);
+	rwlock->rwl_readers--;
+	if (rwlock->rwl_upgrading) {
+		/* The upgrader is the last one left. */
+		if (rwlock->rwl_readers == 1) {
+			wchan_wakeone(rwlock->rwl_upwchan, &rwlock->rwl_lock);
+		}
+	}
+	else if (rwlock->rwl_readers == 0) {
+		wchan_wakeone(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+	}
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rwlock)
+{
+	bool slept = false;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
+	DEBUGASSERT(rwlock != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_writer != curthread);
+	rwlock->rwl_writerswaiting++;
+	while (rwlock->rwl_writer != NULL || rwlock->rwl_readers > 0) {
+		wchan_sleep(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+		slept = true;
+	}
+	rwlock->rwl_writerswaiting--;
+	rwlock->rwl_writer = curthread;
+	spinlock_release(&rwlock->rwl_lock);
+
+#if OPT_LOCKSTAT
+	rwlock->rwl_holdstart = synch_stat(rwlock->rwl_stat, slept, start);
+#else
+	(void)slept;
+#endif
+}
+
+/*
+ * Let the next one in: another writer if there is one, otherwise all
+ * the waiting readers.
+ */
+static
+void
+rwlock_wakeup(struct rwlock *rwlock)
+{
+	KASSERT(spinlock_do_i_hold(&rwlock->rwl_lock));
+
+	if (rwlock->rwl_writerswaiting > 0) {
+		wchan_wakeone(rwlock->rwl_wwchan, &rwlock->rwl_lock);
+	}
+	else {
+		wchan_wakeall(rwlock->rwl_rwchan, &rwlock->rwl_lock);
+	}
+}
+
+void
+rwlock_release_write(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+#if OPT_LOCKSTAT
+	synch_stat_released(rwlock->rwl_stat, &rwlock->rwl_holdstart);
+#endif
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_writer == curthread);
+	rwlock->rwl_writer = NULL;
+	rwlock_wakeup(rwlock);
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+bool
+rwlock_upgrade(struct rwlock *rwlock)
+{
+	bool slept = false;
+#if OPT_LOCKSTAT
+	uint64_t start = lockstat_now();
+#endif
+
+	DEBUGASSERT(rwlock != NULL);
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_readers > 0);
+	KASSERT(rwlock->rwl_writer == NULL);
+	if (rwlock->rwl_upgrading) {
+		/* Two upgraders would wait for each other forever. */
+		spinlock_release(&rwlock->rwl_lock);
+		return false;
+	}
+
+	/* Count as a waiting writer so new readers hold off. */
+	rwlock->rwl_upgrading = true;
+	rwlock->rwl_writerswaiting++;
+	while (rwlock->rwl_readers > 1) {
+		wchan_sleep(rwlock->rwl_upwchan, &rwlock->rwl_lock);
+		slept = true;
+	}
+	rwlock->rwl_writerswaiting--;
+	rwlock->rwl_upgrading = false;
+	rwlock->rwl_readers = 0;
+	rwlock->rwl_writer = curthread;
+	spinlock_release(&rwlock->rwl_lock);
+
+#if OPT_LOCKSTAT
+	rwlock->rwl_holdstart = synch_stat(rwlock->rwl_stat, slept, start);
+#else
+	(void)slept;
+#endif
+	return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+#if OPT_LOCKSTAT
+	synch_stat_released(rwlock->rwl_stat, &rwlock->rwl_holdstart);
+#endif
+
+	spinlock_acquire(&rwlock->rwl_lock);
+	KASSERT(rwlock->rwl_writer == curthread);
+	rwlock->rwl_writer = NULL;
+	rwlock->rwl_readers = 1;
+	/* Other readers can join us, unless a writer is waiting. */
+	if (rwlock->rwl_writerswaiting == 0) {
+		wchan_wakeall(rwlock->rwl_rwchan, &rwlock->rwl_lock);
+	}
+	spinlock_release(&rwlock->rwl_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rwlock)
+{
+	DEBUGASSERT(rwlock != NULL);
+
+	/* Only we can set it to ourselves, so no need to lock. */
+	return rwlock->rwl_writer == curthread;
+}
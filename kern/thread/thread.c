@@ -42,12 +42,17 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <membar.h>
 #include <wchan.h>
+#include <callout.h>
+#include <clock.h>
+#include <workqueue.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
 #include <proc.h>
 #include <current.h>
+#include <atomic.h>
 #include <synch.h>
 #include <addrspace.h>
 #include <mainbus.h>
@@ -58,6 +63,38 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Scheduler tuning. There are SCHED_NPRIO run queue levels; a thread
+ * at level N gets a time slice of SCHED_QUANTUM(N) hardclocks. A
+ * thread waiting on a run queue for SCHED_AGE_LIMIT calls to
+ * schedule() is moved up one level.
+ */
+#define SCHED_NPRIO		4
+#define SCHED_QUANTUM(prio)	(1U << (prio))
+#define SCHED_AGE_LIMIT		8
+
+/*
+ * Cpu placement tunables; see thread_can_migrate and
+ * thread_wake_placement. These can be changed from the kernel menu.
+ */
+unsigned sched_cachehot = 2;	/* Hardclocks a thread stays cache-hot */
+unsigned sched_holdoff = 8;	/* Hardclocks between moves of a thread */
+unsigned sched_wakeaffine = 1;	/* Wake threads on the waker's cpu */
+unsigned sched_inbox = 1;	/* Post remote wakeups to the cpu's inbox */
+
+/*
+ * Number of exited threads each cpu keeps, stack and all, for
+ * thread_fork to reuse. Can be changed from the kernel menu; 0
+ * disables the cache.
+ */
+unsigned thread_cache_max = 16;
+
+/*
+ * Set once the clock has been attached and gettime() may be used;
+ * until then context switches aren't timed.
+ */
+static bool thread_accounting = false;
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -118,6 +155,8 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+static void thread_init(struct thread *thread);
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -140,25 +179,63 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
+	thread->t_stack = NULL;
+	thread_init(thread);
+
+	return thread;
+}
+
+/*
+ * Initialize the fields of a thread other than its name and stack.
+ * This is used both for new threads and for ones recycled from the
+ * thread cache.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
 	thread->t_wchan_name = "NEW";
 	thread->t_state = S_READY;
 
 	/* Thread subsystem fields */
 	thread_machdep_init(&thread->t_machdep);
 	threadlistnode_init(&thread->t_listnode, thread);
-	thread->t_stack = NULL;
 	thread->t_context = NULL;
 	thread->t_cpu = NULL;
 	thread->t_proc = NULL;
 
+	/* Scheduler fields; new threads start at the top level */
+	thread->t_priority = 0;
+	thread->t_ticks = 0;
+	thread->t_age = 0;
+	thread->t_migrated = 0;
+	thread->t_nmigrations = 0;
+	thread->t_lastcpu = NULL;
+	thread->t_lastran = 0;
+	thread->t_affinity = CPUMASK_ALL;
+	thread->t_inboxnext = NULL;
+
+	/* Accounting fields */
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_runstamp.tv_sec = 0;
+	thread->t_runstamp.tv_nsec = 0;
+
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
+	thread->t_intr_user = false;
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
-	/* If you add to struct thread, be sure to initialize here */
+	/* Interruptible sleep fields */
+	thread->t_intrchan = NULL;
+	thread->t_intrlock = NULL;
+	thread->t_interrupted = false;
+	thread->t_intrbusy = false;
 
-	return thread;
+	/* Public fields */
+	thread->t_tid = 0;
+
+	/* If you add to struct thread, be sure to initialize here */
 }
 
 /*
@@ -186,16 +263,32 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
+	c->c_workqueue = NULL;
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_steals = 0;
+	c->c_pushes = 0;
+	c->c_stretch = 0;
+	c->c_timerints = 0;
+	c->c_skippedticks = 0;
+	c->c_lockspins = 0;
+	c->c_lockspinfails = 0;
+	c->c_locksleeps = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "c_runqueue_lock");
+	c->c_rqlocks = 0;
+	c->c_rqcontended = 0;
+	c->c_inboxwakes = 0;
+	c->c_inbox = NULL;
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "c_ipi_lock");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
@@ -270,9 +363,99 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Thread cache.
+ *
+ * Rather than freeing an exited thread and its stack, only to have
+ * thread_fork allocate them again, each cpu keeps up to
+ * thread_cache_max of them on c_threadcache. The stack's magic number
+ * was checked when the thread switched away for the last time and
+ * nothing has used the stack since, so it doesn't need to be set up
+ * again (except paranoidly, with assertions on).
+ *
+ * The cache is only touched by its own cpu, with interrupts off so
+ * that the current thread can't be preempted and moved elsewhere in
+ * the middle.
+ */
+
+/*
+ * Put a zombie in the cache. Returns false if it doesn't fit.
+ */
+static
+bool
+thread_cache_put(struct thread *thread)
+{
+	int spl;
+	bool ret = false;
+
+	if (thread->t_stack == NULL) {
+		/* boot thread; can't reuse the boot stack */
+		return false;
+	}
+
+	spl = splhigh();
+	if (curcpu->c_threadcache.tl_count < thread_cache_max) {
+		thread->t_wchan_name = "CACHED";
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		ret = true;
+	}
+	splx(spl);
+
+	return ret;
+}
+
+/*
+ * Get a thread from the cache, if there is one, and set it up as a
+ * fresh thread called NAME.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	if (thread_cache_max == 0) {
+		return NULL;
+	}
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* Reuse the name buffer too if it's big enough. */
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
+	}
+
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread_init(thread);
+#if !OPT_NOASSERTS
+	thread_checkstack_init(thread);
+#endif
+
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Keep what we can in
+ * the thread cache.
  *
  * The list of zombies is per-cpu.
  */
@@ -285,7 +468,9 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		if (!thread_cache_put(z)) {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -417,6 +602,8 @@ cpu_hatch(unsigned software_number)
 
 	kprintf("cpu%u: %s\n", software_number, buf);
 
+	workqueue_startcpu();
+
 	V(cpu_startup_sem);
 	thread_exit();
 }
@@ -433,6 +620,9 @@ thread_start_cpus(void)
 	cpu_identify(buf, sizeof(buf));
 	kprintf("cpu0: %s\n", buf);
 
+	/* Devices are attached by now, so the clock can be read. */
+	thread_accounting = true;
+
 	cpu_startup_sem = sem_create("cpu_hatch", 0);
 	mainbus_start_cpus();
 
@@ -443,10 +633,402 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Lock and unlock a cpu's run queue. Locking counts how often the
+ * lock was taken and how often we found someone else holding it,
+ * which is what tells whether the inbox below is earning its keep.
+ * The counts are updated with the lock held.
+ */
+static
+void
+runqueue_lock(struct cpu *c)
+{
+	bool contended;
+
+	contended = !spinlock_tryacquire(&c->c_runqueue_lock);
+	if (contended) {
+		spinlock_acquire(&c->c_runqueue_lock);
+		c->c_rqcontended++;
+	}
+	c->c_rqlocks++;
+}
+
+static
+void
+runqueue_unlock(struct cpu *c)
+{
+	spinlock_release(&c->c_runqueue_lock);
+}
+
+/*
+ * Put a ready thread on a cpu's run queue.
+ *
+ * The run queue is kept sorted by priority level, best first, and the
+ * thread goes behind everything at its own level so that threads of
+ * equal priority are served round-robin. Because threads mostly
+ * arrive at the same or a worse level than those already queued,
+ * scanning from the tail is usually short.
+ *
+ * The run queue lock of C must be held.
+ */
+static
+void
+thread_runqueue_add(struct cpu *c, struct thread *t)
+{
+	struct thread *other;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL_REV(other, c->c_runqueue) {
+		if (other->t_priority <= t->t_priority) {
+			threadlist_insertafter(&c->c_runqueue, other, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
+/*
+ * Remote wakeup inbox.
+ *
+ * Waking a thread that lives on another cpu used to mean taking that
+ * cpu's run queue lock, which its owner also takes on every context
+ * switch and hardclock; with many cross-cpu wakeups (pipes, producer
+ * and consumer threads) the lock bounces between cpus. Instead, the
+ * waker marks the thread ready and pushes it onto the target cpu's
+ * c_inbox, a singly-linked stack updated with compare-and-swap. Any
+ * number of cpus may push; only the owning cpu takes things off, and
+ * it takes the whole list at once with a swap, so there's no ABA
+ * problem to worry about.
+ *
+ * The owner drains its inbox into its run queue, with the run queue
+ * locked, whenever it is about to pick a thread (thread_switch) and
+ * on each hardclock (thread_tick), so a woken thread waits no longer
+ * than it would have on the run queue itself.
+ *
+ * The target may still be switching away from the woken thread when
+ * it is posted. That is fine: only the target cpu can put it back on
+ * a run queue, and it does so under the run queue lock it is already
+ * holding for the switch; and thread_can_migrate never moves the
+ * cpu's current thread.
+ */
+static
+void
+thread_inbox_post(struct cpu *c, struct thread *t)
+{
+	struct thread *old;
+
+	KASSERT(t->t_state == S_READY);
+
+	do {
+		old = c->c_inbox;
+		t->t_inboxnext = old;
+	} while (atomic_cas_ptr((void *volatile *)&c->c_inbox,
+				old, t) != old);
+
+	/*
+	 * The cas is a full barrier, so this read of c_isidle comes
+	 * after the push. The target sets c_isidle before it last
+	 * looks at its inbox, so one of us sees the other.
+	 */
+	if (c->c_isidle) {
+		ipi_send(c, IPI_UNIDLE);
+	}
+}
+
+/*
+ * Move everything in the current cpu's inbox to its run queue, in
+ * the order it arrived. The run queue lock must be held.
+ */
+static
+void
+thread_inbox_drain(struct cpu *c)
+{
+	struct thread *t, *next, *list;
+
+	KASSERT(c == curcpu->c_self);
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	if (c->c_inbox == NULL) {
+		return;
+	}
+	t = atomic_swap_ptr((void *volatile *)&c->c_inbox, NULL);
+
+	/* The inbox is a stack; reverse it. */
+	list = NULL;
+	while (t != NULL) {
+		next = t->t_inboxnext;
+		t->t_inboxnext = list;
+		list = t;
+		t = next;
+	}
+
+	while (list != NULL) {
+		t = list;
+		list = t->t_inboxnext;
+		t->t_inboxnext = NULL;
+		KASSERT(t->t_cpu == c);
+		thread_runqueue_add(c, t);
+		c->c_inboxwakes++;
+	}
+}
+
+/*
+ * Migration cost accounting.
+ *
+ * Moving a thread to another cpu costs it its cache footprint, so two
+ * kinds of thread are left where they are:
+ *
+ *   - a thread that is cache-hot, that is, one that last ran on C
+ *     less than sched_cachehot hardclocks ago;
+ *
+ *   - a thread that was moved to C less than sched_holdoff hardclocks
+ *     ago. This keeps threads from ping-ponging between cpus when
+ *     the push side (thread_consider_migration), the pull side
+ *     (thread_steal), and wakeup placement disagree for a moment.
+ *
+ * Both timestamps are taken from C's own clock, so they are only ever
+ * compared against the same cpu's counter.
+ *
+ * Also, never move the thread that C is currently running. Ordinarily
+ * that thread will not appear on C's run queue. However, it can under
+ * the following circumstances:
+ *   - it went to sleep;
+ *   - the processor became idle, so it remained curthread;
+ *   - it was reawakened, so it was put on the run queue;
+ *   - and the processor hasn't fully unidled yet, so all these things
+ *     are still true.
+ *
+ * Migrating that thread can cause bad things to happen (Exercise:
+ * Why? And what?) so it has to be skipped.
+ *
+ * The run queue lock of C must be held.
+ */
+static
+bool
+thread_can_migrate(struct cpu *c, struct thread *t)
+{
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+	KASSERT(t->t_cpu == c);
+
+	if (t == c->c_curthread) {
+		return false;
+	}
+	/* c_hardclocks of another cpu may be read without locking */
+	if (t->t_lastcpu == c &&
+	    c->c_hardclocks - t->t_lastran < sched_cachehot) {
+		return false;
+	}
+	return (c->c_hardclocks - t->t_migrated) >= sched_holdoff;
+}
+
+/*
+ * Move a thread (not on any run queue) over to cpu C.
+ */
+static
+void
+thread_migrate(struct thread *t, struct cpu *c)
+{
+	DEBUG(DB_THREADS, "Migrated thread %s: cpu %u -> %u",
+	      t->t_name, t->t_cpu->c_number, c->c_number);
+
+	t->t_cpu = c;
+	t->t_migrated = c->c_hardclocks;
+	t->t_nmigrations++;
+}
+
+/*
+ * Cpu affinity.
+ *
+ * Each thread has a mask of the cpus it may run on (t_affinity),
+ * normally all of them. It's checked wherever a thread is placed on
+ * a cpu: wakeup placement, stealing, pushing, and thread_fork. If a
+ * thread's mask is changed to exclude the cpu it's on, it gets moved
+ * when that cpu next takes it off the run queue (thread_pick_next);
+ * a thread can't be moved while it's running.
+ *
+ * The masks are read without locking; a word-sized store is atomic
+ * and a stale mask just means one more placement on the old cpus.
+ */
+
+/*
+ * Return the mask of cpus that exist.
+ */
+static
+cpumask_t
+thread_cpumask_online(void)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus >= 32) {
+		return CPUMASK_ALL;
+	}
+	return CPUMASK_CPU(numcpus) - 1;
+}
+
+/*
+ * Check whether thread T may run on cpu C.
+ */
+static
+bool
+thread_allowed(struct thread *t, struct cpu *c)
+{
+	return (t->t_affinity & CPUMASK_CPU(c->c_number)) != 0;
+}
+
+/*
+ * Choose a cpu in MASK for a thread to go to: the one with the
+ * shortest run queue, going by unlocked peeks. MASK must include at
+ * least one cpu that exists.
+ */
+static
+struct cpu *
+thread_pick_cpu(cpumask_t mask)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus;
+
+	best = NULL;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if ((mask & CPUMASK_CPU(c->c_number)) == 0) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Hand a ready thread, just taken off the current cpu's run queue,
+ * to a cpu it's allowed on. This goes through the other cpu's inbox
+ * whether or not sched_inbox is set, because we're holding our own
+ * run queue lock and mustn't take another.
+ */
+static
+void
+thread_rehome(struct thread *t)
+{
+	struct cpu *c;
+
+	KASSERT(t->t_state == S_READY);
+
+	c = thread_pick_cpu(t->t_affinity);
+	thread_migrate(t, c);
+	curcpu->c_pushes++;
+	thread_inbox_post(c, t);
+}
+
+/*
+ * Wakeup placement.
+ *
+ * When a thread wakes up another, the two are usually sharing data
+ * (think of the two ends of a pipe), so if the sleeper's own cpu has
+ * other work to do it may as well run on the waker's cpu instead,
+ * where that data is in cache. Don't do it if the waker's cpu has
+ * more queued than the sleeper's, from interrupt handlers (there is
+ * no waker then), when the sleeper isn't allowed on the waker's cpu,
+ * or when thread_can_migrate says not to.
+ *
+ * A sleeper whose affinity no longer includes its own cpu is moved
+ * regardless, preferably to the waker's cpu.
+ *
+ * Returns the cpu whose run queue TARGET should go on, with that run
+ * queue locked.
+ */
+static
+struct cpu *
+thread_wake_placement(struct thread *target)
+{
+	struct cpu *oldcpu, *mycpu, *newcpu;
+	bool move;
+
+	oldcpu = target->t_cpu;
+	mycpu = curcpu->c_self;
+
+	/*
+	 * Always lock the thread's own cpu first even if we end up
+	 * moving it: if it only just went to sleep, that cpu may still
+	 * be in the middle of switching away from it, and holds this
+	 * lock until it's done.
+	 */
+	runqueue_lock(oldcpu);
+
+	if (!thread_allowed(target, oldcpu) &&
+	    target != oldcpu->c_curthread) {
+		/* Its affinity changed while it slept; it has to move. */
+		newcpu = thread_allowed(target, mycpu) ? mycpu :
+			thread_pick_cpu(target->t_affinity);
+		runqueue_unlock(oldcpu);
+		thread_migrate(target, newcpu);
+		runqueue_lock(newcpu);
+		return newcpu;
+	}
+
+	if (!sched_wakeaffine || oldcpu == mycpu ||
+	    target->t_state != S_SLEEP || curthread->t_in_interrupt ||
+	    oldcpu->c_isidle || !thread_allowed(target, mycpu)) {
+		return oldcpu;
+	}
+
+	/* Peek at our own queue length without locking; it's a hint. */
+	move = mycpu->c_runqueue.tl_count <= oldcpu->c_runqueue.tl_count &&
+		thread_can_migrate(oldcpu, target);
+	if (!move) {
+		return oldcpu;
+	}
+
+	runqueue_unlock(oldcpu);
+	thread_migrate(target, mycpu);
+	runqueue_lock(mycpu);
+	return mycpu;
+}
+
+/*
+ * Decide whether a wakeup should go through the target cpu's inbox.
+ * That's any wakeup for another cpu, unless thread_wake_placement is
+ * likely to move the thread over to us; that needs the other cpu's
+ * run queue lock anyway. The checks are unlocked peeks, so this is
+ * only a guess; thread_wake_placement checks again properly.
+ */
+static
+bool
+thread_wake_remote(struct thread *target)
+{
+	struct cpu *oldcpu, *mycpu;
+
+	oldcpu = target->t_cpu;
+	mycpu = curcpu->c_self;
+
+	if (!sched_inbox || oldcpu == mycpu) {
+		return false;
+	}
+	if (!thread_allowed(target, oldcpu)) {
+		/* It has to move; thread_wake_placement does that. */
+		return false;
+	}
+	if (sched_wakeaffine && target->t_state == S_SLEEP &&
+	    !curthread->t_in_interrupt && !oldcpu->c_isidle &&
+	    thread_allowed(target, mycpu) &&
+	    mycpu->c_runqueue.tl_count <= oldcpu->c_runqueue.tl_count) {
+		return false;
+	}
+	return true;
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too.
+ * targetcpu might be curcpu; it might not be, too. If we don't
+ * already have the lock, it may be posted to the other cpu's inbox
+ * (see thread_wake_remote) or moved to curcpu (see
+ * thread_wake_placement).
  */
 static
 void
@@ -454,20 +1036,39 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
 
-	/* Lock the run queue of the target thread's cpu. */
-	targetcpu = target->t_cpu;
+	/*
+	 * A thread coming back from sleep gave up the cpu before its
+	 * slice ran out; move it up a level and give it a fresh slice.
+	 * This is what keeps interactive threads ahead of cpu hogs.
+	 * (Nobody else looks at a sleeping thread's scheduler fields,
+	 * so this doesn't need the run queue lock.)
+	 */
+	if (target->t_state == S_SLEEP) {
+		if (target->t_priority > 0) {
+			target->t_priority--;
+		}
+		target->t_ticks = 0;
+	}
 
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
+		targetcpu = target->t_cpu;
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
 	}
+	else if (thread_wake_remote(target)) {
+		/* Leave it to the other cpu; see thread_inbox_post. */
+		target->t_state = S_READY;
+		thread_inbox_post(target->t_cpu, target);
+		return;
+	}
 	else {
-		spinlock_acquire(&targetcpu->c_runqueue_lock);
+		/* Choose a cpu and lock its run queue. */
+		targetcpu = thread_wake_placement(target);
 	}
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_runqueue_add(targetcpu, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -478,7 +1079,7 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 	}
 
 	if (!already_have_lock) {
-		spinlock_release(&targetcpu->c_runqueue_lock);
+		runqueue_unlock(targetcpu);
 	}
 }
 
@@ -490,62 +1091,206 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
  *
  * The new thread is created in the process P. If P is null, the
  * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * as the caller, unless the scheduler intervenes first. It inherits
+ * the caller's cpu affinity.
  */
 int
 thread_fork(const char *name,
 	    struct proc *proc,
 	    void (*entrypoint)(void *data1, unsigned long data2),
 	    void *data1, unsigned long data2)
+{
+	return thread_fork_affinity(name, proc, curthread->t_affinity,
+				    entrypoint, data1, data2);
+}
+
+/*
+ * Create a new thread that may only run on the cpus in AFFINITY. If
+ * the caller's cpu is one of them, it starts there; otherwise it
+ * starts on the least busy of them.
+ */
+int
+thread_fork_affinity(const char *name,
+		     struct proc *proc,
+		     cpumask_t affinity,
+		     void (*entrypoint)(void *data1, unsigned long data2),
+		     void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
-	if (newthread == NULL) {
-		return ENOMEM;
+	if ((affinity & thread_cpumask_online()) == 0) {
+		return EINVAL;
 	}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+	newthread = thread_cache_get(name);
+	if (newthread == NULL) {
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
+
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = affinity;
+	if (thread_allowed(newthread, curthread->t_cpu)) {
+		newthread->t_cpu = curthread->t_cpu;
+	}
+	else {
+		newthread->t_cpu = thread_pick_cpu(affinity);
+	}
+
+	/* A new thread has no cache footprint to lose; let it move at once. */
+	newthread->t_migrated = newthread->t_cpu->c_hardclocks - sched_holdoff;
+
+	/* Attach the new thread to its process */
+	if (proc == NULL) {
+		proc = curthread->t_proc;
+	}
+	result = proc_addthread(proc, newthread);
+	if (result) {
+		/* thread_destroy will clean up the stack */
+		thread_destroy(newthread);
+		return result;
+	}
+
+	/*
+	 * Because new threads come out holding the cpu runqueue lock
+	 * (see notes at bottom of thread_switch), we need to account
+	 * for the spllower() that will be done releasing it.
+	 */
+	newthread->t_iplhigh_count++;
+
+	/* Set up the switchframe so entrypoint() gets called */
+	switchframe_init(newthread, entrypoint, data1, data2);
+
+	/* Lock its cpu's run queue and make the new thread runnable */
+	thread_make_runnable(newthread, false);
+
+	return 0;
+}
+
+/*
+ * Work stealing.
+ *
+ * This is called by a cpu that is about to go idle. Rather than
+ * waiting for some busy cpu's thread_consider_migration() to push
+ * work over (which only happens every MIGRATE_HARDCLOCKS ticks of the
+ * busy cpu) find the cpu with the longest run queue and pull one
+ * thread off the tail of it, that being the lowest-priority one.
+ * Returns the thread, now belonging to the current cpu, or NULL if
+ * there was nothing worth taking.
+ *
+ * Must be called with no run queue locks held; we only ever hold one
+ * at a time here.
+ */
+static
+struct thread *
+thread_steal(void)
+{
+	struct cpu *c, *victim;
+	struct thread *t;
+	unsigned i, numcpus, count, best;
+
+	/*
+	 * Pick the victim by peeking at the queue lengths without
+	 * locking anything; it's only a hint, and locking every run
+	 * queue on every idle would just make the busy cpus slower.
+	 */
+	victim = NULL;
+	best = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c == curcpu->c_self) {
+			continue;
+		}
+		count = c->c_runqueue.tl_count;
+		if (count > best) {
+			best = count;
+			victim = c;
+		}
+	}
+	if (victim == NULL) {
+		return NULL;
+	}
 
-	/* Attach the new thread to its process */
-	if (proc == NULL) {
-		proc = curthread->t_proc;
+	runqueue_lock(victim);
+	if (victim->c_isidle) {
+		/* It's about to run its own queue; leave it be. */
+		runqueue_unlock(victim);
+		return NULL;
 	}
-	result = proc_addthread(proc, newthread);
-	if (result) {
-		/* thread_destroy will clean up the stack */
-		thread_destroy(newthread);
-		return result;
+	THREADLIST_FORALL_REV(t, victim->c_runqueue) {
+		if (thread_can_migrate(victim, t) &&
+		    thread_allowed(t, curcpu->c_self)) {
+			break;
+		}
+	}
+	if (t != NULL) {
+		threadlist_remove(&victim->c_runqueue, t);
+		thread_migrate(t, curcpu->c_self);
+		curcpu->c_steals++;
 	}
+	runqueue_unlock(victim);
 
-	/*
-	 * Because new threads come out holding the cpu runqueue lock
-	 * (see notes at bottom of thread_switch), we need to account
-	 * for the spllower() that will be done releasing it.
-	 */
-	newthread->t_iplhigh_count++;
+	return t;
+}
 
-	/* Set up the switchframe so entrypoint() gets called */
-	switchframe_init(newthread, entrypoint, data1, data2);
+/*
+ * Take the next thread to run off the current cpu's run queue,
+ * handing any that aren't allowed here to a cpu where they are.
+ *
+ * CUR, the thread being switched away from, can't be handed off
+ * since we're still on its stack. If it isn't allowed here, run
+ * something else if there's anything else, and leave it queued; the
+ * next switch will move it. (thread_affinity_enforce arranges for
+ * there to be something else.)
+ *
+ * The run queue lock must be held. Returns NULL if the queue is
+ * empty.
+ */
+static
+struct thread *
+thread_pick_next(struct thread *cur)
+{
+	struct cpu *c;
+	struct thread *t, *stuck;
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
-	thread_make_runnable(newthread, false);
+	c = curcpu->c_self;
+	stuck = NULL;
+	while ((t = threadlist_remhead(&c->c_runqueue)) != NULL) {
+		if (thread_allowed(t, c)) {
+			break;
+		}
+		if (t == cur) {
+			stuck = t;
+			continue;
+		}
+		thread_rehome(t);
+	}
 
-	return 0;
+	if (stuck != NULL) {
+		if (t == NULL) {
+			t = stuck;
+		}
+		else {
+			thread_runqueue_add(c, stuck);
+		}
+	}
+	return t;
 }
 
 /*
@@ -563,6 +1308,8 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	struct timespec now, ran;
+	bool accounting, idled;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -585,16 +1332,40 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
-	/* Lock the run queue. */
-	spinlock_acquire(&curcpu->c_runqueue_lock);
+	/* Lock the run queue, and pick up any remote wakeups. */
+	runqueue_lock(curcpu->c_self);
+	thread_inbox_drain(curcpu->c_self);
 
 	/* Micro-optimization: if nothing to do, just return */
 	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
-		spinlock_release(&curcpu->c_runqueue_lock);
+		runqueue_unlock(curcpu->c_self);
 		splx(spl);
 		return;
 	}
 
+	/* Remember where and when it last ran, for thread_can_migrate. */
+	cur->t_lastcpu = curcpu->c_self;
+	cur->t_lastran = curcpu->c_hardclocks;
+
+	/*
+	 * Charge it for its time on the cpu, and count the switch:
+	 * being preempted from the timer interrupt is involuntary;
+	 * sleeping or yielding is voluntary.
+	 */
+	accounting = thread_accounting;
+	if (accounting) {
+		gettime(&now);
+		timespec_sub(&now, &cur->t_runstamp, &ran);
+		timespec_add(&cur->t_usage.tu_runtime, &ran,
+			     &cur->t_usage.tu_runtime);
+	}
+	if (newstate == S_READY && cur->t_in_interrupt) {
+		cur->t_usage.tu_nivcsw++;
+	}
+	else if (newstate != S_ZOMBIE) {
+		cur->t_usage.tu_nvcsw++;
+	}
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -604,6 +1375,12 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		/*
+		 * Set the state before the thread becomes visible on
+		 * the wait channel, so a wakeup on another cpu sees
+		 * that it slept (thread_make_runnable checks this).
+		 */
+		cur->t_state = S_SLEEP;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -617,10 +1394,16 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	    case S_ZOMBIE:
 		cur->t_wchan_name = "ZOMBIE";
+		cur->t_state = S_ZOMBIE;
 		threadlist_addtail(&curcpu->c_zombies, cur);
 		break;
 	}
-	cur->t_state = newstate;
+
+	/*
+	 * Note that cur->t_state must not be touched from here on: once
+	 * the wchan lock is released, a sleeping thread may already
+	 * have been woken and posted back to our inbox as S_READY.
+	 */
 
 	/*
 	 * Get the next thread. While there isn't one, call md_idle().
@@ -639,18 +1422,50 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
-	/* The current cpu is now idle. */
+	/*
+	 * Before actually idling, try to steal a thread from another
+	 * cpu's run queue (see thread_steal). This has to be done
+	 * without our own run queue lock held, since it takes the
+	 * other cpu's. If it works, we run the stolen thread directly;
+	 * anything that shows up on our own queue meanwhile waits its
+	 * turn.
+	 */
+
+	/*
+	 * The current cpu is now idle. Make sure that's visible before
+	 * the inbox is checked; see thread_inbox_post.
+	 */
 	curcpu->c_isidle = true;
+	membar_any_any();
+	idled = false;
 	do {
-		next = threadlist_remhead(&curcpu->c_runqueue);
+		thread_inbox_drain(curcpu->c_self);
+		next = thread_pick_next(cur);
 		if (next == NULL) {
-			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
-			spinlock_acquire(&curcpu->c_runqueue_lock);
+			runqueue_unlock(curcpu->c_self);
+			next = thread_steal();
+			if (next == NULL) {
+				hardclock_idle_begin();
+				cpu_idle();
+				hardclock_idle_end();
+				idled = true;
+			}
+			runqueue_lock(curcpu->c_self);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* It's no longer waiting, so it no longer ages. */
+	next->t_age = 0;
+
+	/* Start its clock; idle time isn't charged to anyone. */
+	if (accounting) {
+		if (idled) {
+			gettime(&now);
+		}
+		next->t_runstamp = now;
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -716,7 +1531,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_state = S_RUN;
 
 	/* Unlock the run queue. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	runqueue_unlock(curcpu->c_self);
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -749,7 +1564,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	cur->t_state = S_RUN;
 
 	/* Release the runqueue lock acquired in thread_switch. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	runqueue_unlock(curcpu->c_self);
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -814,22 +1629,185 @@ thread_yield(void)
 	thread_switch(S_READY, NULL, NULL);
 }
 
+/*
+ * Set thread T's cpu affinity.
+ */
+int
+thread_setaffinity(struct thread *t, cpumask_t affinity)
+{
+	if ((affinity & thread_cpumask_online()) == 0) {
+		return EINVAL;
+	}
+	t->t_affinity = affinity;
+	return 0;
+}
+
+/*
+ * Get thread T's cpu affinity.
+ */
+cpumask_t
+thread_getaffinity(struct thread *t)
+{
+	return t->t_affinity & thread_cpumask_online();
+}
+
+/*
+ * Work function for thread_affinity_kick; the point is just to have
+ * the worker run.
+ */
+static
+void
+thread_affinity_nothing(void *arg)
+{
+	(void)arg;
+}
+
+/*
+ * Make sure the current cpu has something to run besides the current
+ * thread, so thread_pick_next can move the current thread off it.
+ * The worker is pinned to this cpu, so waking it does that. May be
+ * called from interrupt handlers.
+ */
+static
+void
+thread_affinity_kick(void)
+{
+	if (curcpu->c_workqueue == NULL) {
+		/* Too early; it'll get moved once something else runs. */
+		return;
+	}
+	/* If this fails, likewise. */
+	(void)work_enqueue(thread_affinity_nothing, NULL);
+}
+
+/*
+ * Get the current thread off the current cpu if it isn't allowed
+ * there.
+ */
+void
+thread_affinity_enforce(void)
+{
+	if (thread_allowed(curthread, curcpu->c_self)) {
+		return;
+	}
+	thread_affinity_kick();
+	thread_yield();
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multi-level feedback queue. Each thread has a priority
+ * level, t_priority, with 0 the best; the run queue is kept sorted by
+ * level (see thread_runqueue_add) and is round-robin within a level.
+ *
+ *    - A thread that uses up its whole time slice is moved down a
+ *      level, where the slices are longer (thread_tick).
+ *    - A thread that is woken up after sleeping on a wait channel is
+ *      moved up a level (thread_make_runnable).
+ *    - A thread that sits on a run queue for long enough is moved up
+ *      a level so that nothing starves (schedule).
+ *
+ * So threads that compute continuously sink to the bottom, and
+ * threads that mostly wait for I/O, like the shell and anything
+ * reading from the console, float to the top and get the cpu as soon
+ * as they wake up.
  */
 
+/*
+ * Charge the current thread for a hardclock. This is called from
+ * hardclock() on every tick in place of an unconditional yield.
+ */
+void
+thread_tick(void)
+{
+	struct thread *cur, *next;
+	bool preempt;
+
+	cur = curthread;
+
+	/* If we're idle, there's nobody to charge. */
+	if (curcpu->c_isidle) {
+		return;
+	}
+
+	/* Note where the tick found it, for the user/system split. */
+	if (cur->t_intr_user) {
+		cur->t_usage.tu_uticks++;
+	}
+	else {
+		cur->t_usage.tu_sticks++;
+	}
+
+	cur->t_ticks++;
+	if (cur->t_ticks >= SCHED_QUANTUM(cur->t_priority)) {
+		/* Slice used up: demote and go to the back of the line. */
+		cur->t_ticks = 0;
+		if (cur->t_priority < SCHED_NPRIO - 1) {
+			cur->t_priority++;
+		}
+		preempt = true;
+	}
+	else {
+		/* Otherwise, give way only to a better-priority thread. */
+		runqueue_lock(curcpu->c_self);
+		thread_inbox_drain(curcpu->c_self);
+		next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+		preempt = (next != NULL && next->t_priority < cur->t_priority);
+		runqueue_unlock(curcpu->c_self);
+	}
+
+	/* If it isn't allowed here any more, get it moved. */
+	if (!thread_allowed(cur, curcpu->c_self)) {
+		thread_affinity_kick();
+		preempt = true;
+	}
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * This is called periodically from hardclock(). It ages the threads
+ * waiting on the current CPU's run queue, and reshuffles the queue if
+ * any of them moved up.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlist resort;
+	struct thread *t;
+	bool changed;
+
+	changed = false;
+	runqueue_lock(curcpu->c_self);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		t->t_age++;
+		if (t->t_age >= SCHED_AGE_LIMIT && t->t_priority > 0) {
+			t->t_priority--;
+			t->t_age = 0;
+			changed = true;
+		}
+	}
+
+	if (changed) {
+		/*
+		 * Pull everything off and put it back. Since the list
+		 * is still nearly sorted, each insertion is quick.
+		 */
+		threadlist_init(&resort);
+		while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+			threadlist_addtail(&resort, t);
+		}
+		while ((t = threadlist_remhead(&resort)) != NULL) {
+			thread_runqueue_add(curcpu->c_self, t);
+		}
+		threadlist_cleanup(&resort);
+	}
+	runqueue_unlock(curcpu->c_self);
 }
 
 /*
@@ -856,18 +1834,19 @@ thread_consider_migration(void)
 	unsigned i, numcpus;
 	struct cpu *c;
 	struct threadlist victims;
-	struct thread *t;
+	struct thread *t, *prev, *next;
+	cpumask_t elsewhere;
 
 	my_count = total_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
+		runqueue_lock(c);
 		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
 			my_count = c->c_runqueue.tl_count;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		runqueue_unlock(c);
 	}
 
 	one_share = DIVROUNDUP(total_count, numcpus);
@@ -875,56 +1854,47 @@ thread_consider_migration(void)
 		return;
 	}
 
+	/*
+	 * Pick victims from the tail (the lowest priority), skipping
+	 * any that aren't allowed to move yet or that can't run
+	 * anywhere else.
+	 */
+	elsewhere = thread_cpumask_online() &
+		~CPUMASK_CPU(curcpu->c_number);
 	to_send = my_count - one_share;
 	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	runqueue_lock(curcpu->c_self);
+	t = curcpu->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (t != NULL && victims.tl_count < to_send) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if (thread_can_migrate(curcpu->c_self, t) &&
+		    (t->t_affinity & elsewhere) != 0) {
+			threadlist_remove(&curcpu->c_runqueue, t);
+			threadlist_addhead(&victims, t);
+		}
+		t = prev;
 	}
-	spinlock_release(&curcpu->c_runqueue_lock);
+	to_send = victims.tl_count;
+	runqueue_unlock(curcpu->c_self);
 
 	for (i=0; i < numcpus && to_send > 0; i++) {
 		c = cpuarray_get(&allcpus, i);
 		if (c == curcpu->c_self) {
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
+		runqueue_lock(c);
+		t = victims.tl_head.tln_next->tln_self;
+		while (t != NULL &&
+		       c->c_runqueue.tl_count < one_share && to_send > 0) {
+			next = t->t_listnode.tln_next->tln_self;
+			if (!thread_allowed(t, c)) {
+				t = next;
 				continue;
 			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
+			threadlist_remove(&victims, t);
+			thread_migrate(t, c);
+			thread_runqueue_add(c, t);
+			curcpu->c_pushes++;
 			to_send--;
 			if (c->c_isidle) {
 				/*
@@ -933,27 +1903,113 @@ thread_consider_migration(void)
 				 */
 				ipi_send(c, IPI_UNIDLE);
 			}
+			t = next;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		runqueue_unlock(c);
 	}
 
 	/*
 	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
+	 * changed while we were working, and victims whose affinity
+	 * didn't match any cpu with room are left over too, so we may
+	 * end up with leftovers.
 	 * Don't panic; just put them back on our own run queue.
 	 */
 	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
+		runqueue_lock(curcpu->c_self);
 		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+			thread_runqueue_add(curcpu->c_self, t);
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+		runqueue_unlock(curcpu->c_self);
 	}
 
 	KASSERT(threadlist_isempty(&victims));
 	threadlist_cleanup(&victims);
 }
 
+/*
+ * Return the number of timer interrupts taken by all cpus.
+ */
+unsigned
+thread_timerints(void)
+{
+	unsigned i, numcpus, total;
+
+	total = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		total += cpuarray_get(&allcpus, i)->c_timerints;
+	}
+	return total;
+}
+
+/*
+ * Print scheduler statistics for each cpu.
+ */
+void
+thread_printstats(void)
+{
+	unsigned i, numcpus, queued;
+	struct cpu *c;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		runqueue_lock(c);
+		queued = c->c_runqueue.tl_count;
+		runqueue_unlock(c);
+
+		kprintf("cpu%u: %u hardclocks (%u skipped idle), "
+			"%u timer interrupts\n",
+			c->c_number, c->c_hardclocks, c->c_skippedticks,
+			c->c_timerints);
+		kprintf("      %u queued, %u stolen, %u pushed, %u cached\n",
+			queued, c->c_steals, c->c_pushes,
+			c->c_threadcache.tl_count);
+		kprintf("      run queue locked %u times (%u contended), "
+			"%u inbox wakeups\n",
+			c->c_rqlocks, c->c_rqcontended, c->c_inboxwakes);
+		kprintf("      lock waits: %u spun, %u spun then slept, "
+			"%u slept\n",
+			c->c_lockspins, c->c_lockspinfails, c->c_locksleeps);
+	}
+}
+
+/*
+ * Return the resources thread T has used. If it's running, add in
+ * the time since it last got the cpu. (It may be running elsewhere,
+ * so this is a snapshot; that's fine for statistics.)
+ */
+void
+thread_getusage(struct thread *t, struct threadusage *ret)
+{
+	struct timespec now, ran;
+
+	*ret = t->t_usage;
+	if (thread_accounting && t->t_state == S_RUN) {
+		gettime(&now);
+		timespec_sub(&now, &t->t_runstamp, &ran);
+		timespec_add(&ret->tu_runtime, &ran, &ret->tu_runtime);
+	}
+}
+
+/*
+ * Add the usage in FROM to TO.
+ */
+void
+threadusage_add(struct threadusage *to, const struct threadusage *from)
+{
+	timespec_add(&to->tu_runtime, &from->tu_runtime, &to->tu_runtime);
+	to->tu_uticks += from->tu_uticks;
+	to->tu_sticks += from->tu_sticks;
+	to->tu_nvcsw += from->tu_nvcsw;
+	to->tu_nivcsw += from->tu_nivcsw;
+	to->tu_minflt += from->tu_minflt;
+	to->tu_majflt += from->tu_majflt;
+	to->tu_inblock += from->tu_inblock;
+	to->tu_oublock += from->tu_oublock;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -1045,6 +2101,180 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Timed sleep. This is wchan_sleep with a callout that, if it fires
+ * first, pulls the thread back off the wait channel.
+ *
+ * The callout function can tell whether the thread is still asleep
+ * by looking at t_state: with LK held, a thread is in S_SLEEP
+ * exactly when it is on the channel's list. (thread_switch sets the
+ * state and adds it to the list before releasing LK; wakeups take it
+ * off the list and make it runnable before releasing LK.)
+ */
+struct wchan_timeout {
+	struct wchan *wt_wchan;
+	struct spinlock *wt_lock;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+static
+void
+wchan_timeout(void *data)
+{
+	struct wchan_timeout *wt = data;
+
+	spinlock_acquire(wt->wt_lock);
+	if (wt->wt_thread->t_state == S_SLEEP) {
+		threadlist_remove(&wt->wt_wchan->wc_threads, wt->wt_thread);
+		wt->wt_expired = true;
+		thread_make_runnable(wt->wt_thread, false);
+	}
+	spinlock_release(wt->wt_lock);
+}
+
+int
+timed_wchan_sleep(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timeout wt;
+	struct callout co;
+
+	wt.wt_wchan = wc;
+	wt.wt_lock = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	callout_init(&co, wchan_timeout, &wt);
+
+	/*
+	 * Schedule with LK held, so the callout can't look for us
+	 * before we're on the channel.
+	 */
+	callout_schedule(&co, ticks);
+	wchan_sleep(wc, lk);
+
+	/*
+	 * The callout function takes LK, so we can't wait for it to
+	 * finish while holding LK. Dropping LK here is no different
+	 * from dropping it while asleep as far as the caller is
+	 * concerned.
+	 */
+	spinlock_release(lk);
+	callout_cancel(&co);
+	spinlock_acquire(lk);
+
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
+/*
+ * Interruptible sleeps. These are for sleeps on behalf of a user
+ * process that could go on indefinitely, so that when the process
+ * exits, proc_exit can wake them (with wchan_interrupt) instead of
+ * waiting for them to end on their own. They fail with EINTR if so,
+ * or at once if the process is already exiting.
+ *
+ * While asleep, the thread keeps the channel and its spinlock in
+ * t_intrchan and t_intrlock, set and cleared under p_lock, which is
+ * taken with LK held. The interrupter takes them the other way
+ * around: it marks the thread t_intrbusy under p_lock, drops p_lock,
+ * and then takes LK. The sleeper waits for t_intrbusy to clear
+ * before it forgets the channel (giving up LK meanwhile), so the
+ * channel and LK stay valid while the interrupter uses them.
+ *
+ * The interrupter knows the thread is still asleep on the channel
+ * the same way wchan_timeout does, by its state.
+ */
+
+static
+bool
+wchan_intr_begin(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *cur = curthread;
+	struct proc *proc = cur->t_proc;
+
+	if (proc == kproc) {
+		/* kernel threads never exit this way */
+		return true;
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_exiting) {
+		spinlock_release(&proc->p_lock);
+		return false;
+	}
+	cur->t_intrchan = wc;
+	cur->t_intrlock = lk;
+	cur->t_interrupted = false;
+	spinlock_release(&proc->p_lock);
+	return true;
+}
+
+static
+bool
+wchan_intr_end(struct spinlock *lk)
+{
+	struct thread *cur = curthread;
+	struct proc *proc = cur->t_proc;
+	bool ret;
+
+	if (proc == kproc) {
+		return false;
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	while (cur->t_intrbusy) {
+		/* let the interrupter have LK */
+		spinlock_release(&proc->p_lock);
+		spinlock_release(lk);
+		thread_yield();
+		spinlock_acquire(lk);
+		spinlock_acquire(&proc->p_lock);
+	}
+	cur->t_intrchan = NULL;
+	cur->t_intrlock = NULL;
+	ret = cur->t_interrupted;
+	spinlock_release(&proc->p_lock);
+	return ret;
+}
+
+int
+wchan_sleep_intr(struct wchan *wc, struct spinlock *lk)
+{
+	if (!wchan_intr_begin(wc, lk)) {
+		return EINTR;
+	}
+	wchan_sleep(wc, lk);
+	return wchan_intr_end(lk) ? EINTR : 0;
+}
+
+int
+timed_wchan_sleep_intr(struct wchan *wc, struct spinlock *lk,
+		       unsigned ticks)
+{
+	int result;
+
+	if (!wchan_intr_begin(wc, lk)) {
+		return EINTR;
+	}
+	result = timed_wchan_sleep(wc, lk, ticks);
+	return wchan_intr_end(lk) ? EINTR : result;
+}
+
+/*
+ * Wake thread T, if it's still asleep on WC. T's process's exit code
+ * calls this with T marked t_intrbusy, with WC and LK taken from
+ * t_intrchan and t_intrlock.
+ */
+void
+wchan_interrupt(struct thread *t, struct wchan *wc, struct spinlock *lk)
+{
+	spinlock_acquire(lk);
+	if (t->t_state == S_SLEEP) {
+		threadlist_remove(&wc->wc_threads, t);
+		thread_make_runnable(t, false);
+	}
+	spinlock_release(lk);
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1195,12 +2425,12 @@ interprocessor_interrupt(void)
 	if (bits & (1U << IPI_OFFLINE)) {
 		/* offline request */
 		spinlock_release(&curcpu->c_ipi_lock);
-		spinlock_acquire(&curcpu->c_runqueue_lock);
+		runqueue_lock(curcpu->c_self);
 		if (!curcpu->c_isidle) {
 			kprintf("cpu%d: offline: warning: not idle\n",
 				curcpu->c_number);
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+		runqueue_unlock(curcpu->c_self);
 		kprintf("cpu%d: offline.\n", curcpu->c_number);
 		cpu_halt();
 	}
@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Work queues.
+ *
+ * There is one queue per cpu, each with its own worker thread and
+ * lock, so queueing work from different cpus doesn't contend. Each
+ * queue counts the work items queued and run; flushing a queue is
+ * waiting for the run count to catch up to what the queued count was
+ * when we started.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <callout.h>
+#include <workqueue.h>
+
+struct workqueue;
+
+/*
+ * A queued function call.
+ */
+struct work {
+	void (*w_func)(void *);
+	void *w_arg;
+	struct work *w_next;		/* next on queue */
+	struct workqueue *w_queue;	/* queue it goes on */
+	struct callout w_callout;	/* for delayed work */
+};
+
+/*
+ * A per-cpu queue.
+ */
+struct workqueue {
+	struct spinlock wq_lock;
+	struct wchan *wq_wchan;		/* worker sleeps here */
+	struct wchan *wq_donechan;	/* flushers sleep here */
+	struct work *wq_head;		/* first item */
+	struct work **wq_tailp;		/* where to put the next item */
+	unsigned wq_queued;		/* number of items ever queued */
+	unsigned wq_done;		/* number of items ever run */
+	struct thread *wq_worker;	/* the worker thread */
+	struct workqueue *wq_next;	/* next in workqueues list */
+};
+
+/*
+ * All the queues, in cpu order, and the count of delayed work not
+ * yet queued. Queues are only ever added.
+ */
+static struct spinlock workqueues_lock;
+static struct workqueue *workqueues;
+static struct workqueue **workqueues_tailp;
+static unsigned work_delayed_count;
+static struct wchan *work_delayed_chan;
+
+/*
+ * Choose a queue: the current cpu's, or before that has one, the
+ * first.
+ */
+static
+struct workqueue *
+workqueue_pick(void)
+{
+	struct workqueue *wq;
+
+	wq = curcpu->c_workqueue;
+	if (wq == NULL) {
+		spinlock_acquire(&workqueues_lock);
+		wq = workqueues;
+		spinlock_release(&workqueues_lock);
+		KASSERT(wq != NULL);
+	}
+	return wq;
+}
+
+static
+struct work *
+work_create(void (*func)(void *), void *arg)
+{
+	struct work *w;
+
+	w = kmalloc(sizeof(*w));
+	if (w == NULL) {
+		return NULL;
+	}
+	w->w_func = func;
+	w->w_arg = arg;
+	w->w_next = NULL;
+	w->w_queue = workqueue_pick();
+	return w;
+}
+
+/*
+ * Put work on its queue and wake the worker.
+ */
+static
+void
+workqueue_add(struct work *w)
+{
+	struct workqueue *wq = w->w_queue;
+
+	spinlock_acquire(&wq->wq_lock);
+	*wq->wq_tailp = w;
+	wq->wq_tailp = &w->w_next;
+	wq->wq_queued++;
+	wchan_wakeone(wq->wq_wchan, &wq->wq_lock);
+	spinlock_release(&wq->wq_lock);
+}
+
+/*
+ * Worker thread.
+ */
+static
+void
+workqueue_worker(void *data, unsigned long junk)
+{
+	struct workqueue *wq = data;
+	struct work *w;
+
+	(void)junk;
+
+	spinlock_acquire(&wq->wq_lock);
+	wq->wq_worker = curthread;
+	while (1) {
+		while (wq->wq_head == NULL) {
+			wchan_sleep(wq->wq_wchan, &wq->wq_lock);
+		}
+		w = wq->wq_head;
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tailp = &wq->wq_head;
+		}
+		spinlock_release(&wq->wq_lock);
+
+		w->w_func(w->w_arg);
+		kfree(w);
+
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_done++;
+		wchan_wakeall(wq->wq_donechan, &wq->wq_lock);
+	}
+}
+
+int
+work_enqueue(void (*func)(void *), void *arg)
+{
+	struct work *w;
+
+	w = work_create(func, arg);
+	if (w == NULL) {
+		return ENOMEM;
+	}
+	workqueue_add(w);
+	return 0;
+}
+
+/*
+ * Callout function for delayed work.
+ */
+static
+void
+work_delayed(void *data)
+{
+	struct work *w = data;
+
+	workqueue_add(w);
+
+	spinlock_acquire(&workqueues_lock);
+	KASSERT(work_delayed_count > 0);
+	work_delayed_count--;
+	if (work_delayed_count == 0) {
+		wchan_wakeall(work_delayed_chan, &workqueues_lock);
+	}
+	spinlock_release(&workqueues_lock);
+}
+
+int
+work_enqueue_delayed(void (*func)(void *), void *arg, unsigned ticks)
+{
+	struct work *w;
+
+	if (ticks == 0) {
+		return work_enqueue(func, arg);
+	}
+
+	w = work_create(func, arg);
+	if (w == NULL) {
+		return ENOMEM;
+	}
+
+	spinlock_acquire(&workqueues_lock);
+	work_delayed_count++;
+	spinlock_release(&workqueues_lock);
+
+	callout_init(&w->w_callout, work_delayed, w);
+	callout_schedule(&w->w_callout, ticks);
+	return 0;
+}
+
+void
+workqueue_flush(void)
+{
+	struct workqueue *wq;
+	unsigned target;
+
+	spinlock_acquire(&workqueues_lock);
+	wq = workqueues;
+	spinlock_release(&workqueues_lock);
+
+	for (; wq != NULL; wq = wq->wq_next) {
+		/* a worker can't wait for itself */
+		KASSERT(curthread != wq->wq_worker);
+
+		spinlock_acquire(&wq->wq_lock);
+		target = wq->wq_queued;
+		while ((int)(target - wq->wq_done) > 0) {
+			wchan_sleep(wq->wq_donechan, &wq->wq_lock);
+		}
+		spinlock_release(&wq->wq_lock);
+	}
+}
+
+void
+workqueue_drain(void)
+{
+	struct workqueue *wq;
+	bool idle;
+
+	do {
+		spinlock_acquire(&workqueues_lock);
+		while (work_delayed_count > 0) {
+			wchan_sleep(work_delayed_chan, &workqueues_lock);
+		}
+		wq = workqueues;
+		spinlock_release(&workqueues_lock);
+
+		workqueue_flush();
+
+		/* Work may have queued more work meanwhile. */
+		idle = true;
+		for (; wq != NULL; wq = wq->wq_next) {
+			spinlock_acquire(&wq->wq_lock);
+			if (wq->wq_queued != wq->wq_done) {
+				idle = false;
+			}
+			spinlock_release(&wq->wq_lock);
+		}
+		spinlock_acquire(&workqueues_lock);
+		if (work_delayed_count > 0) {
+			idle = false;
+		}
+		spinlock_release(&workqueues_lock);
+	} while (!idle);
+}
+
+/*
+ * Setup.
+ */
+void
+workqueue_bootstrap(void)
+{
+	spinlock_init(&workqueues_lock);
+	workqueues = NULL;
+	workqueues_tailp = &workqueues;
+	work_delayed_count = 0;
+	work_delayed_chan = wchan_create("work_delayed");
+	if (work_delayed_chan == NULL) {
+		panic("workqueue_bootstrap: Out of memory\n");
+	}
+
+	/* The boot cpu's queue */
+	workqueue_startcpu();
+}
+
+/*
+ * Create the queue and worker for the current cpu. The worker is
+ * pinned to this cpu, so work always runs where it was queued.
+ */
+void
+workqueue_startcpu(void)
+{
+	struct workqueue *wq;
+	char name[16];
+	int result;
+
+	KASSERT(curcpu->c_workqueue == NULL);
+
+	wq = kmalloc(sizeof(*wq));
+	if (wq == NULL) {
+		panic("workqueue_startcpu: Out of memory\n");
+	}
+	spinlock_init(&wq->wq_lock);
+	wq->wq_wchan = wchan_create("workqueue");
+	wq->wq_donechan = wchan_create("workqueue_done");
+	if (wq->wq_wchan == NULL || wq->wq_donechan == NULL) {
+		panic("workqueue_startcpu: Out of memory\n");
+	}
+	wq->wq_head = NULL;
+	wq->wq_tailp = &wq->wq_head;
+	wq->wq_queued = 0;
+	wq->wq_done = 0;
+	wq->wq_worker = NULL;
+	wq->wq_next = NULL;
+
+	snprintf(name, sizeof(name), "worker%u", curcpu->c_number);
+	result = thread_fork_affinity(name, NULL,
+				      CPUMASK_CPU(curcpu->c_number),
+				      workqueue_worker, wq, 0);
+	if (result) {
+		panic("workqueue_startcpu: thread_fork: %s\n",
+		      strerror(result));
+	}
+
+	spinlock_acquire(&workqueues_lock);
+	*workqueues_tailp = wq;
+	workqueues_tailp = &wq->wq_next;
+	spinlock_release(&workqueues_lock);
+
+	curcpu->c_workqueue = wq;
+}
@@ -41,6 +41,7 @@
 #include <uio.h>
 #include <synch.h>
 #include <vnode.h>
+#include <poll.h>
 #include <device.h>
 
 /*
@@ -150,6 +151,22 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll(). Pass through if the device waits for anything;
+ * if not, it's always ready.
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct pollwaiter *pw, int *revents)
+{
+	struct device *d = v->vn_data;
+
+	if (d->d_ops->devop_poll == NULL) {
+		return vopready_poll(v, events, pw, revents);
+	}
+	return DEVOP_POLL(d, events, pw, revents);
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -332,6 +349,7 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_getdirentry = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
+	.vop_poll = dev_poll,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Anonymous pipes.
+ *
+ * The data lives in a ring buffer of PIPE_SIZE bytes; each end of the
+ * pipe is a vnode, so the file table and read/write/close need no
+ * special cases for pipes. Both vnodes are part of the pipe object,
+ * and the pipe is freed when the second of them is reclaimed.
+ *
+ * Readers and writers copy straight between their own buffers and
+ * the ring (there is no other intermediate copy), and sleep on the
+ * pipe's condition variables when it's empty or full. Since a read
+ * returns as soon as there is any data, and a write starts copying as
+ * soon as there is any room (or room for the whole write, if it's
+ * small enough to be atomic), a reader blocked on an empty pipe gets
+ * a writer's data as soon as it's in the ring, at most PIPE_SIZE
+ * bytes at a time.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <limits.h>
+#include <stat.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <vm.h>
+#include <vnode.h>
+#include <poll.h>
+#include <pipe.h>
+
+struct pipe {
+	struct vnode pp_readvn;		/* the read end */
+	struct vnode pp_writevn;	/* the write end */
+
+	struct lock *pp_lock;		/* protects everything below */
+	struct cv *pp_datacv;		/* readers wait here for data */
+	struct cv *pp_spacecv;		/* writers wait here for space */
+	unsigned pp_readwaiters;	/* number sleeping on pp_datacv */
+	unsigned pp_writewaiters;	/* number sleeping on pp_spacecv */
+	struct pollqueue pp_readpq;	/* poll() waiting for data */
+	struct pollqueue pp_writepq;	/* poll() waiting for space */
+
+	char *pp_buf;			/* the ring, PIPE_SIZE bytes */
+	unsigned pp_head;		/* position of the first byte */
+	unsigned pp_count;		/* number of bytes in the ring */
+
+	bool pp_readopen;		/* read end not yet reclaimed */
+	bool pp_writeopen;		/* write end not yet reclaimed */
+};
+
+/*
+ * Destructor for struct pipe; called when both ends are gone.
+ */
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	pollqueue_cleanup(&pp->pp_writepq);
+	pollqueue_cleanup(&pp->pp_readpq);
+	kfree(pp->pp_buf);
+	cv_destroy(pp->pp_spacecv);
+	cv_destroy(pp->pp_datacv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Move LEN bytes between the ring, starting at position POS, and the
+ * uio, in whichever direction the uio says. Wraps around the end of
+ * the ring if needed.
+ */
+static
+int
+pipe_uiomove(struct pipe *pp, unsigned pos, size_t len, struct uio *uio)
+{
+	size_t first;
+	int result;
+
+	KASSERT(pos < PIPE_SIZE);
+	KASSERT(len <= PIPE_SIZE);
+
+	first = PIPE_SIZE - pos;
+	if (first > len) {
+		first = len;
+	}
+	result = uiomove(pp->pp_buf + pos, first, uio);
+	if (result) {
+		return result;
+	}
+	if (len > first) {
+		result = uiomove(pp->pp_buf, len - first, uio);
+	}
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// vnode ops
+
+/*
+ * Pipes don't have names, so they can't be opened by name either.
+ */
+static
+int
+pipe_eachopen(struct vnode *vn, int openflags)
+{
+	(void)vn;
+	(void)openflags;
+	return EINVAL;
+}
+
+/*
+ * Called when the last reference to one end goes away. Wake up anyone
+ * waiting on the other end, as they'll now get EOF or EPIPE; if the
+ * other end is gone too, destroy the pipe.
+ */
+static
+int
+pipe_reclaim(struct vnode *vn)
+{
+	struct pipe *pp = vn->vn_data;
+	bool gone;
+
+	lock_acquire(pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		KASSERT(pp->pp_readopen);
+		pp->pp_readopen = false;
+		cv_broadcast(pp->pp_spacecv, pp->pp_lock);
+		pollqueue_wakeup(&pp->pp_writepq);
+	}
+	else {
+		KASSERT(vn == &pp->pp_writevn);
+		KASSERT(pp->pp_writeopen);
+		pp->pp_writeopen = false;
+		cv_broadcast(pp->pp_datacv, pp->pp_lock);
+		pollqueue_wakeup(&pp->pp_readpq);
+	}
+	vnode_cleanup(vn);
+	gone = !pp->pp_readopen && !pp->pp_writeopen;
+	lock_release(pp->pp_lock);
+
+	if (gone) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read. Wait until there's some data, or until the write end is
+ * closed (which is EOF), then take as much as fits in the uio. The
+ * wait fails with EINTR if our process starts exiting.
+ */
+static
+int
+pipe_read(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t len;
+	int result;
+
+	if (vn != &pp->pp_readvn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	if (uio->uio_resid == 0) {
+		return 0;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_count == 0) {
+		if (!pp->pp_writeopen) {
+			/* EOF */
+			lock_release(pp->pp_lock);
+			return 0;
+		}
+		pp->pp_readwaiters++;
+		result = cv_wait_intr(pp->pp_datacv, pp->pp_lock);
+		pp->pp_readwaiters--;
+		if (result) {
+			lock_release(pp->pp_lock);
+			return result;
+		}
+	}
+
+	len = pp->pp_count;
+	if (len > uio->uio_resid) {
+		len = uio->uio_resid;
+	}
+	result = pipe_uiomove(pp, pp->pp_head, len, uio);
+	if (result) {
+		lock_release(pp->pp_lock);
+		return result;
+	}
+	pp->pp_head = (pp->pp_head + len) % PIPE_SIZE;
+	pp->pp_count -= len;
+
+	if (pp->pp_writewaiters > 0) {
+		/* wake all; they may be waiting for different amounts */
+		cv_broadcast(pp->pp_spacecv, pp->pp_lock);
+	}
+	if (PIPE_SIZE - pp->pp_count >= PIPE_BUF) {
+		pollqueue_wakeup(&pp->pp_writepq);
+	}
+	if (pp->pp_count > 0 && pp->pp_readwaiters > 0) {
+		/* there's some left; pass it on */
+		cv_signal(pp->pp_datacv, pp->pp_lock);
+	}
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+/*
+ * Write. Copy into the ring as room becomes available, until the uio
+ * is empty. A write of at most PIPE_BUF bytes waits for room for all
+ * of it, so it won't be interleaved with other writes. Writing when
+ * the read end is closed gives EPIPE, unless some of the data has
+ * already gone in, in which case that much is reported as written.
+ * Waiting for room is cut short the same way, with EINTR, if our
+ * process starts exiting.
+ */
+static
+int
+pipe_write(struct vnode *vn, struct uio *uio)
+{
+	struct pipe *pp = vn->vn_data;
+	size_t size, need, room, len;
+	int result;
+
+	if (vn != &pp->pp_writevn) {
+		return EBADF;
+	}
+	KASSERT(uio->uio_rw == UIO_WRITE);
+
+	size = uio->uio_resid;
+	need = size <= PIPE_BUF ? size : 1;
+
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_readopen) {
+			result = (uio->uio_resid == size) ? EPIPE : 0;
+			lock_release(pp->pp_lock);
+			return result;
+		}
+
+		room = PIPE_SIZE - pp->pp_count;
+		if (room < need) {
+			pp->pp_writewaiters++;
+			result = cv_wait_intr(pp->pp_spacecv, pp->pp_lock);
+			pp->pp_writewaiters--;
+			if (result) {
+				/* as with EPIPE, report what went in */
+				if (uio->uio_resid < size) {
+					result = 0;
+				}
+				lock_release(pp->pp_lock);
+				return result;
+			}
+			continue;
+		}
+
+		len = uio->uio_resid;
+		if (len > room) {
+			len = room;
+		}
+		result = pipe_uiomove(pp,
+				      (pp->pp_head + pp->pp_count) % PIPE_SIZE,
+				      len, uio);
+		if (result) {
+			lock_release(pp->pp_lock);
+			return result;
+		}
+		pp->pp_count += len;
+
+		if (pp->pp_readwaiters > 0) {
+			cv_signal(pp->pp_datacv, pp->pp_lock);
+		}
+		pollqueue_wakeup(&pp->pp_readpq);
+	}
+	lock_release(pp->pp_lock);
+	return 0;
+}
+
+/*
+ * Pipes have no ioctls.
+ */
+static
+int
+pipe_ioctl(struct vnode *vn, int op, userptr_t data)
+{
+	(void)vn;
+	(void)op;
+	(void)data;
+	return EINVAL;
+}
+
+/*
+ * poll. The read end is readable when there's data, and hung up when
+ * the write end is closed; the write end is writable when there's
+ * room for an atomic write, and in error when the read end is closed.
+ * Wakeups are done with the pipe locked, so we register under the
+ * lock too.
+ */
+static
+int
+pipe_poll(struct vnode *vn, int events, struct pollwaiter *pw, int *revents)
+{
+	struct pipe *pp = vn->vn_data;
+	int ready = 0;
+
+	lock_acquire(pp->pp_lock);
+	if (vn == &pp->pp_readvn) {
+		if (pp->pp_count > 0) {
+			ready |= POLLIN;
+		}
+		if (!pp->pp_writeopen) {
+			ready |= POLLHUP;
+		}
+		ready &= events | POLLERR | POLLHUP;
+		if (ready == 0) {
+			pollwaiter_add(pw, &pp->pp_readpq);
+		}
+	}
+	else {
+		if (PIPE_SIZE - pp->pp_count >= PIPE_BUF) {
+			ready |= POLLOUT;
+		}
+		if (!pp->pp_readopen) {
+			ready |= POLLERR;
+		}
+		ready &= events | POLLERR | POLLHUP;
+		if (ready == 0) {
+			pollwaiter_add(pw, &pp->pp_writepq);
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	*revents = ready;
+	return 0;
+}
+
+/*
+ * stat. The size is the amount of data waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *vn, struct stat *statbuf)
+{
+	struct pipe *pp = vn->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_SIZE;
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	lock_release(pp->pp_lock);
+
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *vn, mode_t *ret)
+{
+	(void)vn;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *vn)
+{
+	(void)vn;
+	return false;
+}
+
+/*
+ * There's nothing to sync, and POSIX says to fail.
+ */
+static
+int
+pipe_fsync(struct vnode *vn)
+{
+	(void)vn;
+	return EINVAL;
+}
+
+static
+int
+pipe_truncate(struct vnode *vn, off_t len)
+{
+	(void)vn;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * This should never be reached, as it's not possible to chdir to a
+ * pipe.
+ */
+static
+int
+pipe_namefile(struct vnode *vn, struct uio *uio)
+{
+	(void)vn;
+	(void)uio;
+	return ENOTDIR;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_poll = pipe_poll,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_perm,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = pipe_namefile,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
+
+////////////////////////////////////////////////////////////
+// constructor
+
+/*
+ * Create a pipe and hand back its two ends.
+ */
+int
+pipe_create(struct vnode **readvn_ret, struct vnode **writevn_ret)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+
+	pp->pp_buf = kmalloc(PIPE_SIZE);
+	if (pp->pp_buf == NULL) {
+		goto fail_pp;
+	}
+	pp->pp_lock = lock_create("pipe");
+	if (pp->pp_lock == NULL) {
+		goto fail_buf;
+	}
+	pp->pp_datacv = cv_create("pipe data");
+	if (pp->pp_datacv == NULL) {
+		goto fail_lock;
+	}
+	pp->pp_spacecv = cv_create("pipe space");
+	if (pp->pp_spacecv == NULL) {
+		goto fail_datacv;
+	}
+
+	pp->pp_readwaiters = 0;
+	pp->pp_writewaiters = 0;
+	pollqueue_init(&pp->pp_readpq);
+	pollqueue_init(&pp->pp_writepq);
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_readopen = true;
+	pp->pp_writeopen = true;
+
+	result = vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	KASSERT(result == 0);
+	result = vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	KASSERT(result == 0);
+
+	*readvn_ret = &pp->pp_readvn;
+	*writevn_ret = &pp->pp_writevn;
+	return 0;
+
+ fail_datacv:
+	cv_destroy(pp->pp_datacv);
+ fail_lock:
+	lock_destroy(pp->pp_lock);
+ fail_buf:
+	kfree(pp->pp_buf);
+ fail_pp:
+	kfree(pp);
+	return ENOMEM;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Support for poll(): pollqueues, which objects keep, and pollwaiters,
+ * which poll() registers on them. See poll.h.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <wchan.h>
+#include <poll.h>
+
+/*
+ * Registration of one pollwaiter on one pollqueue. Linked into the
+ * queue's list; the storage belongs to the waiter.
+ */
+struct pollentry {
+	struct pollqueue *pe_queue;
+	struct pollwaiter *pe_waiter;
+	struct pollentry *pe_next;
+};
+
+////////////////////////////////////////////////////////////
+// pollqueue
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_entries = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	KASSERT(pq->pq_entries == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake everything registered. The entries stay registered; each
+ * waiter removes its own when it's done.
+ */
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+	struct pollwaiter *pw;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_entries; pe != NULL; pe = pe->pe_next) {
+		pw = pe->pe_waiter;
+		spinlock_acquire(&pw->pw_lock);
+		pw->pw_woken = true;
+		wchan_wakeall(pw->pw_wchan, &pw->pw_lock);
+		spinlock_release(&pw->pw_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+////////////////////////////////////////////////////////////
+// pollwaiter
+
+struct pollwaiter *
+pollwaiter_create(unsigned maxqueues)
+{
+	struct pollwaiter *pw;
+
+	pw = kmalloc(sizeof(*pw));
+	if (pw == NULL) {
+		return NULL;
+	}
+	pw->pw_entries = kmalloc(maxqueues * sizeof(struct pollentry));
+	if (pw->pw_entries == NULL && maxqueues > 0) {
+		kfree(pw);
+		return NULL;
+	}
+	pw->pw_wchan = wchan_create("poll");
+	if (pw->pw_wchan == NULL) {
+		kfree(pw->pw_entries);
+		kfree(pw);
+		return NULL;
+	}
+	spinlock_init(&pw->pw_lock);
+	pw->pw_woken = false;
+	pw->pw_nentries = 0;
+	pw->pw_maxentries = maxqueues;
+	return pw;
+}
+
+void
+pollwaiter_destroy(struct pollwaiter *pw)
+{
+	KASSERT(pw->pw_nentries == 0);
+
+	spinlock_cleanup(&pw->pw_lock);
+	wchan_destroy(pw->pw_wchan);
+	kfree(pw->pw_entries);
+	kfree(pw);
+}
+
+void
+pollwaiter_add(struct pollwaiter *pw, struct pollqueue *pq)
+{
+	struct pollentry *pe;
+
+	if (pw == NULL) {
+		return;
+	}
+	KASSERT(pw->pw_nentries < pw->pw_maxentries);
+
+	pe = &pw->pw_entries[pw->pw_nentries++];
+	pe->pe_queue = pq;
+	pe->pe_waiter = pw;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_entries;
+	pq->pq_entries = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+void
+pollwaiter_clear(struct pollwaiter *pw)
+{
+	struct pollentry *pe, **pep;
+	struct pollqueue *pq;
+	unsigned i;
+
+	for (i=0; i<pw->pw_nentries; i++) {
+		pe = &pw->pw_entries[i];
+		pq = pe->pe_queue;
+
+		spinlock_acquire(&pq->pq_lock);
+		pep = &pq->pq_entries;
+		while (*pep != pe) {
+			KASSERT(*pep != NULL);
+			pep = &(*pep)->pe_next;
+		}
+		*pep = pe->pe_next;
+		spinlock_release(&pq->pq_lock);
+	}
+	pw->pw_nentries = 0;
+
+	/* nothing can wake us now */
+	spinlock_acquire(&pw->pw_lock);
+	pw->pw_woken = false;
+	spinlock_release(&pw->pw_lock);
+}
+
+int
+pollwaiter_sleep(struct pollwaiter *pw, unsigned ticks)
+{
+	int result = 0;
+
+	spinlock_acquire(&pw->pw_lock);
+	if (!pw->pw_woken) {
+		if (ticks > 0) {
+			result = timed_wchan_sleep_intr(pw->pw_wchan,
+							&pw->pw_lock, ticks);
+		}
+		else {
+			result = wchan_sleep_intr(pw->pw_wchan, &pw->pw_lock);
+		}
+	}
+	spinlock_release(&pw->pw_lock);
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+// common vnode op
+
+/*
+ * For objects whose reads and writes never wait: always ready.
+ */
+int
+vopready_poll(struct vnode *vn, int events, struct pollwaiter *pw,
+	      int *revents)
+{
+	(void)vn;
+	(void)pw;
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
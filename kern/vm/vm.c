@@ -59,12 +59,13 @@
  * it's cutting (there are many) and why, and more importantly, how.
  */
 
-// using a fixed size stack page for now
-#define VM_STACKPAGES    18
+// the stack sizes are fixed for now; see addrspace.h
 
 static bool BOOT = false;
 static int NUM_PAGES;
 
+static void as_zero_region(paddr_t paddr, unsigned npages);
+
 /*
  * Wrap ram_stealmem in a spinlock.
  */
@@ -83,7 +84,8 @@ static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
  * Lock for coremap
  */
 struct cm_entry *coremap;
-static struct spinlock cm_spinlock = SPINLOCK_INITIALIZER;
+static struct spinlock cm_spinlock =
+	SPINLOCK_NAMED_INITIALIZER("cm_spinlock");
 
 #define CM_PID   0x3
 #define CM_VADDR  0xfffff
@@ -224,6 +226,26 @@ free_kpages(vaddr_t addr)
 	spinlock_release(&cm_spinlock);
 }
 
+// Make a block from alloc_kpages into npages single pages, so that
+// each can be freed (or handed to an address space) on its own
+void
+vm_splitkpages(vaddr_t addr, unsigned npages)
+{
+	paddr_t paddr = KVADDR_TO_PADDR(addr);
+
+	spinlock_acquire(&cm_spinlock);
+	for (int i = 0; i < NUM_PAGES; i++) {
+		if (coremap[i].cm_paddr == paddr) {
+			KASSERT(i + npages <= (unsigned)NUM_PAGES);
+			for (int j = i; j < i + (int)npages; j++) {
+				coremap[j].cm_npages = 1;
+			}
+			break;
+		}
+	}
+	spinlock_release(&cm_spinlock);
+}
+
 void
 vm_tlbshootdown_all(void)
 {
@@ -241,7 +263,9 @@ int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t codebase, codetop, database, datatop, heapbase, heaptop, stackbase, stacktop;
+	vaddr_t tstackbase;
 	paddr_t paddr;
+	unsigned slotpage;
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
@@ -292,8 +316,6 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	KASSERT(as->as_heapbase != 0);
 	KASSERT(as->as_heaptop != 0);
 	
-	KASSERT(as->as_stackbase != NULL);
-	
 	KASSERT((as->as_vcodebase & PAGE_FRAME) == as->as_vcodebase);
 	
 	KASSERT((as->as_vdatabase & PAGE_FRAME) == as->as_vdatabase);
@@ -304,12 +326,17 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 	database = as->as_vdatabase;
 	datatop = database + as->as_datapages * PAGE_SIZE;
 
-	heapbase = as->as_heapbase;
-	heaptop = as->as_heaptop;
-
 	stackbase = USERSTACK - VM_STACKPAGES * PAGE_SIZE;
 	stacktop = USERSTACK;
 
+	tstackbase = AS_TSTACKBASE;
+
+	// other threads may be faulting or calling sbrk at the same time
+	spinlock_acquire(&as->as_lock);
+
+	heapbase = as->as_heapbase;
+	heaptop = as->as_heaptop;
+
 	bool codesegment = false;               // indicate whether it is text-segment
 	bool elf_loaded = as->elf_loaded;       // has ELF loaded yet
 
@@ -350,17 +377,49 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 			}
 		}
 	}
-	else if (faultaddress >= stackbase && faultaddress < stacktop) {
+	else if (faultaddress >= stackbase && faultaddress < stacktop &&
+		 as->as_stackbase != NULL) {
 		int stackpage = (faultaddress - stackbase) / PAGE_SIZE;
 		paddr = as->as_stackbase[stackpage];
 	}
+	else if (faultaddress >= tstackbase && faultaddress < stackbase &&
+		 as->as_tstacks != NULL) {
+
+		// for thread stacks
+		// count pages down from the main stack; every
+		// (AS_TSTACKPAGES + 1)th one is a guard page
+		//
+		slotpage = (stackbase - faultaddress) / PAGE_SIZE - 1;
+		if (slotpage % (AS_TSTACKPAGES + 1) == AS_TSTACKPAGES) {
+			spinlock_release(&as->as_lock);
+			return EFAULT;
+		}
+		slotpage -= slotpage / (AS_TSTACKPAGES + 1);
+		if (as->as_tstacks[slotpage] == 0) {
+			paddr = getppages(1);
+			if (paddr == 0) {
+				spinlock_release(&as->as_lock);
+				return ENOMEM;
+			}
+			as_zero_region(paddr, 1);
+			as->as_tstacks[slotpage] = paddr;
+		}
+		paddr = as->as_tstacks[slotpage];
+	}
 	else {
+		spinlock_release(&as->as_lock);
 		return EFAULT;
 	}
 
+	spinlock_release(&as->as_lock);
+
 	// make sure it's page-aligned
 	KASSERT((paddr & PAGE_FRAME) == paddr);
 
+	// nothing here ever has to wait for disk, so every fault
+	// we can resolve counts as a minor one
+	curthread->t_usage.tu_minflt++;
+
 	// Disable interrupts on this CPU while frobbing the TLB
 	spl = splhigh();
 
@@ -410,12 +469,15 @@ as_create(void)
 	as->as_datapages = 0;
 	
 	as->as_stackbase = NULL;
+	as->as_tstacks = NULL;
 
 	as->as_heapbase = 0;
 	as->as_heaptop = 0;
 
 	as->elf_loaded = false;
 
+	spinlock_init(&as->as_lock);
+
 	return as;
 }
 
@@ -434,10 +496,25 @@ as_destroy(struct addrspace *as)
 		free_kpages(PADDR_TO_KVADDR(as->as_pdatabase[i]));
 	}
 
-	for (size_t i = 0; i < VM_STACKPAGES; i++) {
-		free_kpages(PADDR_TO_KVADDR(as->as_stackbase[i]));
+	if (as->as_stackbase != NULL) {
+		for (size_t i = 0; i < VM_STACKPAGES; i++) {
+			if (as->as_stackbase[i] != 0) {
+				free_kpages(PADDR_TO_KVADDR(as->as_stackbase[i]));
+			}
+		}
+		kfree(as->as_stackbase);
+	}
+
+	if (as->as_tstacks != NULL) {
+		for (size_t i = 0; i < AS_TSTACKSLOTS * AS_TSTACKPAGES; i++) {
+			if (as->as_tstacks[i] != 0) {
+				free_kpages(PADDR_TO_KVADDR(as->as_tstacks[i]));
+			}
+		}
+		kfree(as->as_tstacks);
 	}
 
+	spinlock_cleanup(&as->as_lock);
 	kfree(as);
 }
 
@@ -556,15 +633,45 @@ as_prepare_load(struct addrspace *as)
 		}
 	}
 
+	return 0;
+}
+
+/*
+ * Make the main stack. The top nargpages pages are the ones at
+ * argpages, which the caller got from alloc_kpages and split with
+ * vm_splitkpages; they become ours only if we succeed. The rest are
+ * fresh zeroed pages.
+ */
+static
+int
+as_alloc_stack(struct addrspace *as, vaddr_t argpages, unsigned nargpages)
+{
+	unsigned nfresh;
+
+	KASSERT(as->as_stackbase == NULL);
+	KASSERT(nargpages < VM_STACKPAGES);
+
 	as->as_stackbase = kmalloc(sizeof(paddr_t) * VM_STACKPAGES);
 	if (as->as_stackbase == NULL) {
 		return ENOMEM;
 	}
-	for (size_t i = 0; i < VM_STACKPAGES; i++) {
+	bzero(as->as_stackbase, sizeof(paddr_t) * VM_STACKPAGES);
+
+	// as_destroy frees whatever we got if we fail partway
+	nfresh = VM_STACKPAGES - nargpages;
+	for (size_t i = 0; i < nfresh; i++) {
 		as->as_stackbase[i] = getppages(1);
+		if (as->as_stackbase[i] == 0) {
+			return ENOMEM;
+		}
 		as_zero_region(as->as_stackbase[i], 1);
 	}
 
+	for (size_t i = 0; i < nargpages; i++) {
+		as->as_stackbase[nfresh + i] =
+			KVADDR_TO_PADDR(argpages + i * PAGE_SIZE);
+	}
+
 	return 0;
 }
 
@@ -576,11 +683,67 @@ as_complete_load(struct addrspace *as)
 }
 
 int
-as_define_stack(struct addrspace *as, vaddr_t *stackptr)
+as_define_stack(struct addrspace *as, vaddr_t argpages, unsigned nargpages,
+		vaddr_t *stackptr)
+{
+	int result;
+
+	result = as_alloc_stack(as, argpages, nargpages);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = USERSTACK - nargpages * PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Stack for thread TID. The table of thread stack pages is made the
+ * first time; the pages themselves come from vm_fault.
+ */
+static
+int
+as_alloc_tstacks(struct addrspace *as)
+{
+	paddr_t *tstacks;
+
+	if (as->as_tstacks != NULL) {
+		return 0;
+	}
+
+	tstacks = kmalloc(sizeof(paddr_t) * AS_TSTACKSLOTS * AS_TSTACKPAGES);
+	if (tstacks == NULL) {
+		return ENOMEM;
+	}
+	bzero(tstacks, sizeof(paddr_t) * AS_TSTACKSLOTS * AS_TSTACKPAGES);
+
+	// two threads may be creating threads at once
+	spinlock_acquire(&as->as_lock);
+	if (as->as_tstacks == NULL) {
+		as->as_tstacks = tstacks;
+		tstacks = NULL;
+	}
+	spinlock_release(&as->as_lock);
+
+	if (tstacks != NULL) {
+		kfree(tstacks);
+	}
+	return 0;
+}
+
+int
+as_define_tstack(struct addrspace *as, int tid, vaddr_t *stackptr)
 {
-	KASSERT(as->as_stackbase != 0);
+	int result;
 
-	*stackptr = USERSTACK;
+	KASSERT(tid >= 1 && tid <= AS_TSTACKSLOTS);
+
+	result = as_alloc_tstacks(as);
+	if (result) {
+		return result;
+	}
+
+	*stackptr = AS_TSTACKTOP(tid);
 	return 0;
 }
 
@@ -605,10 +768,9 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 
 	new->as_pcodebase = kmalloc(sizeof(paddr_t) * old->as_codepages);
 	new->as_pdatabase = kmalloc(sizeof(paddr_t) * old->as_datapages);
-	new->as_stackbase = kmalloc(sizeof(paddr_t) * VM_STACKPAGES);
 
 	// (Mis)use as_prepare_load to allocate some physical memory
-	if (as_prepare_load(new)) {
+	if (as_prepare_load(new) || as_alloc_stack(new, 0, 0)) {
 		as_destroy(new);
 		return ENOMEM;
 	}
@@ -638,6 +800,29 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 				PAGE_SIZE);
 	}
 
+	// the thread stacks too, since the thread calling fork might be
+	// running on one; only the pages that have been touched exist
+	//
+	if (old->as_tstacks != NULL) {
+		if (as_alloc_tstacks(new)) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		for (size_t i = 0; i < AS_TSTACKSLOTS * AS_TSTACKPAGES; i++) {
+			if (old->as_tstacks[i] == 0) {
+				continue;
+			}
+			new->as_tstacks[i] = getppages(1);
+			if (new->as_tstacks[i] == 0) {
+				as_destroy(new);
+				return ENOMEM;
+			}
+			memmove((void *)PADDR_TO_KVADDR(new->as_tstacks[i]),
+				(const void *)PADDR_TO_KVADDR(old->as_tstacks[i]),
+				PAGE_SIZE);
+		}
+	}
+
 	*ret = new;
 	return 0;
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -58,6 +59,9 @@
 /* avoid making this unreasonably large; causes problems under dumbvm */
 #define CMDLINE_MAX 4096
 
+/* most commands in one pipeline */
+#define MAXPIPE 16
+
 /* struct to (portably) hold exit info */
 struct exitinfo {
 	unsigned val:8,
@@ -69,22 +73,25 @@ struct exitinfo {
 /* set to nonzero if __time syscall seems to work */
 static int timing = 0;
 
+/* set to nonzero if getrusage syscall seems to work too */
+static int showusage = 0;
+
 /* array of backgrounded jobs (allows "foregrounding") */
 #define MAXBG 128
 static pid_t bgpids[MAXBG];
 
 /*
  * can_bg
- * just checks for an open slot.
+ * just checks for enough open slots (one per command in the pipeline).
  */
 static
 int
-can_bg(void)
+can_bg(int n)
 {
 	int i;
 
 	for (i = 0; i < MAXBG; i++) {
-		if (bgpids[i] == 0) {
+		if (bgpids[i] == 0 && --n == 0) {
 			return 1;
 		}
 	}
@@ -188,6 +195,21 @@ printstatus(const struct exitinfo *ei, int printexitzero)
 	}
 }
 
+/*
+ * showwait
+ * prints what happened to a process we waited for.
+ */
+static
+void
+showwait(pid_t pid, int status)
+{
+	struct exitinfo ei;
+
+	printf("pid %d: ", pid);
+	readstatus(status, &ei);
+	printstatus(&ei, 1);
+}
+
 /*
  * dowait
  * just does a waitpid.
@@ -196,60 +218,58 @@ static
 void
 dowait(pid_t pid)
 {
-	struct exitinfo ei;
 	int status;
 
 	if (waitpid(pid, &status, 0) < 0) {
 		warn("pid %d", pid);
 	}
 	else {
-		printf("pid %d: ", pid);
-		readstatus(status, &ei);
-		printstatus(&ei, 1);
+		showwait(pid, status);
 	}
 }
 
-#ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * dowaitany
+ * waits for whichever background job finishes first and forgets it.
+ * returns its pid; or 0 if flags has WNOHANG and none has finished
+ * yet; or -1 if there are none left (or waitpid failed).
  */
 static
-int
-dowaitpoll(pid_t pid)
+pid_t
+dowaitany(int flags)
 {
-	struct exitinfo ei;
-	pid_t foundpid;
-	int status;
+	pid_t pid;
+	int status, i;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
-	if (foundpid < 0) {
-		warn("pid %d", pid);
+	pid = waitpid(WAIT_ANY, &status, flags);
+	if (pid < 0) {
+		if (errno != ECHILD) {
+			warn("waitpid");
+		}
+		return -1;
 	}
-	else if (foundpid != 0) {
-		printf("pid %d: ", pid);
-		readstatus(status, &ei);
-		printstatus(&ei, 1);
-		return 1;
+	if (pid > 0) {
+		showwait(pid, status);
+		for (i = 0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
+				bgpids[i] = 0;
+			}
+		}
 	}
-	return 0;
+	return pid;
 }
 
+#ifdef WNOHANG
 /*
  * waitpoll
- * poll all background jobs for having exited.
+ * collect any background jobs that have exited.
  */
 static
 void
 waitpoll(void)
 {
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
-				bgpids[i] = 0;
-			}
-		}
+	while (dowaitany(WNOHANG) > 0) {
+		/* nothing */
 	}
 }
 #endif /* WNOHANG */
@@ -258,7 +278,7 @@ waitpoll(void)
  * wait
  * allows the user to "foreground" a process by waiting on it.  without ps to
  * know the pids, this is a little tough to use with an arg, but without an
- * arg it will wait for all the background jobs.
+ * arg it will wait for all the background jobs, in the order they finish.
  */
 static
 void
@@ -279,11 +299,11 @@ cmd_wait(int ac, char *av[], struct exitinfo *ei)
 		return;
 	}
 	else if (ac == 1) {
+		while (dowaitany(0) > 0) {
+			/* nothing */
+		}
 		for (i=0; i < MAXBG; i++) {
-			if (bgpids[i] != 0) {
-				dowait(bgpids[i]);
-				bgpids[i] = 0;
-			}
+			bgpids[i] = 0;
 		}
 		exitinfo_exit(ei, 0);
 		return;
@@ -355,25 +375,149 @@ static struct {
 	{ NULL, NULL }
 };
 
+/*
+ * tvdiff
+ * subtract one timeval from another, for printrusage.
+ */
+static
+void
+tvdiff(const struct timeval *start, const struct timeval *end,
+       unsigned long *secs, unsigned long *usecs)
+{
+	*secs = end->tv_sec - start->tv_sec;
+	if (end->tv_usec < start->tv_usec) {
+		*usecs = end->tv_usec + 1000000 - start->tv_usec;
+		(*secs)--;
+	}
+	else {
+		*usecs = end->tv_usec - start->tv_usec;
+	}
+}
+
+/*
+ * printrusage
+ * report what the last subprocess used, as the difference in the
+ * totals for our children before and after it ran.
+ */
+static
+void
+printrusage(const struct rusage *start, const struct rusage *end)
+{
+	unsigned long usecs, ususecs, ssecs, susecs;
+
+	tvdiff(&start->ru_utime, &end->ru_utime, &usecs, &ususecs);
+	tvdiff(&start->ru_stime, &end->ru_stime, &ssecs, &susecs);
+	warnx("subprocess usage: %lu.%06lu user, %lu.%06lu system seconds",
+	      usecs, ususecs, ssecs, susecs);
+	warnx("    %lu+%lu context switches (voluntary+involuntary), "
+	      "%lu+%lu page faults (minor+major), %lu+%lu blocks in+out",
+	      (unsigned long)(end->ru_nvcsw - start->ru_nvcsw),
+	      (unsigned long)(end->ru_nivcsw - start->ru_nivcsw),
+	      (unsigned long)(end->ru_minflt - start->ru_minflt),
+	      (unsigned long)(end->ru_majflt - start->ru_majflt),
+	      (unsigned long)(end->ru_inblock - start->ru_inblock),
+	      (unsigned long)(end->ru_oublock - start->ru_oublock));
+}
+
+/*
+ * runstage
+ * starts one command of a pipeline with its standard input and output
+ * on the file handles infd and outfd. closefd, if not -1, is a handle
+ * the command must not inherit (the read end of the pipe it writes
+ * into; otherwise the command after it would never see EOF). returns
+ * the pid, or -1 after complaining.
+ */
+static
+pid_t
+runstage(char **args, int infd, int outfd, int closefd)
+{
+	pid_t pid;
+#ifdef HOST
+	pid = fork();
+	switch (pid) {
+		case -1:
+			/* error */
+			warn("fork");
+			return -1;
+		case 0:
+			/* child */
+			if (closefd >= 0) {
+				close(closefd);
+			}
+			if (infd != STDIN_FILENO) {
+				dup2(infd, STDIN_FILENO);
+				close(infd);
+			}
+			if (outfd != STDOUT_FILENO) {
+				dup2(outfd, STDOUT_FILENO);
+				close(outfd);
+			}
+			execvp(args[0], args);
+			warn("%s", args[0]);
+			/*
+			 * Use _exit() instead of exit() in the child
+			 * process to avoid calling atexit() functions,
+			 * which would cause hostcompat (if present) to
+			 * reset the tty state and mess up our input
+			 * handling.
+			 */
+			_exit(1);
+		default:
+			break;
+	}
+#else
+	int fds[3];
+
+	/*
+	 * spawnvp makes the new process without copying ours first,
+	 * and reports failure to load the program here, so there's no
+	 * child to clean up. A command that isn't part of a pipeline
+	 * gets all our file handles, as with fork; one that is gets
+	 * just its ends of the pipes, and stderr, so closefd is taken
+	 * care of already.
+	 */
+	(void)closefd;
+	if (infd == STDIN_FILENO && outfd == STDOUT_FILENO) {
+		pid = spawnvp(args[0], args, NULL, 0);
+	}
+	else {
+		fds[0] = infd;
+		fds[1] = outfd;
+		fds[2] = STDERR_FILENO;
+		pid = spawnvp(args[0], args, fds, 3);
+	}
+	if (pid < 0) {
+		warn("%s", args[0]);
+		return -1;
+	}
+#endif
+
+	return pid;
+}
+
 /*
  * docommand
  * tokenizes the command line using strtok.  if there aren't any commands,
  * simply returns.  checks to see if it's a builtin, running it if it is.
- * otherwise, it's a standard command.  check for the '&', try to background
- * the job if possible, otherwise just run it and wait on it.
+ * otherwise, it's a standard command, or a pipeline of them separated by
+ * '|'.  check for the '&', try to background the job if possible, otherwise
+ * just run it and wait on it.
  */
 static
 void
 docommand(char *buf, struct exitinfo *ei)
 {
 	char *args[NARG_MAX + 1];
-	int nargs, i;
+	char **cmds[MAXPIPE];
+	pid_t pids[MAXPIPE];
+	int nargs, ncmds, i;
 	char *s;
-	pid_t pid;
+	int infd, pipefds[2];
 	int status;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
+	struct rusage startru, endru;
 
 	nargs = 0;
 	for (s = strtok(buf, " \t\r\n"); s; s = strtok(NULL, " \t\r\n")) {
@@ -405,60 +549,108 @@ docommand(char *buf, struct exitinfo *ei)
 
 	if (nargs > 0 && !strcmp(args[nargs-1], "&")) {
 		/* background */
-		if (!can_bg()) {
-			printf("%s: Too many background jobs; wait for "
-			       "some to finish before starting more\n",
-			       args[0]);
-			exitinfo_exit(ei, 1);
-			return;
-		}
 		nargs--;
 		args[nargs] = NULL;
 		bg = 1;
 	}
 
+	/* split it into the commands of the pipeline */
+	ncmds = 0;
+	cmds[ncmds++] = args;
+	for (i=0; i<nargs; i++) {
+		if (strcmp(args[i], "|")) {
+			continue;
+		}
+		args[i] = NULL;
+		if (ncmds >= MAXPIPE) {
+			printf("Too many commands in pipeline\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+		cmds[ncmds++] = &args[i+1];
+	}
+	for (i=0; i<ncmds; i++) {
+		if (cmds[i][0] == NULL) {
+			printf("Invalid null command\n");
+			exitinfo_exit(ei, 1);
+			return;
+		}
+	}
+
+	if (bg && !can_bg(ncmds)) {
+		printf("%s: Too many background jobs; wait for "
+		       "some to finish before starting more\n",
+		       args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (timing) {
 		__time(&startsecs, &startnsecs);
 	}
+	if (showusage) {
+		getrusage(RUSAGE_CHILDREN, &startru);
+	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
+	/*
+	 * start each command, connected to the next by a pipe. if
+	 * one fails to start, don't start the rest; the ones already
+	 * going see EOF or EPIPE and finish by themselves.
+	 */
+	infd = STDIN_FILENO;
+	for (i=0; i<ncmds; i++) {
+		if (i == ncmds - 1) {
+			pipefds[0] = -1;
+			pipefds[1] = STDOUT_FILENO;
+		}
+		else if (pipe(pipefds) < 0) {
+			warn("pipe");
+			break;
+		}
+		pids[i] = runstage(cmds[i], infd, pipefds[1], pipefds[0]);
+		if (infd != STDIN_FILENO) {
+			close(infd);
+		}
+		if (pipefds[1] != STDOUT_FILENO) {
+			close(pipefds[1]);
+		}
+		infd = pipefds[0];
+		if (pids[i] < 0) {
 			break;
+		}
+	}
+	if (i < ncmds) {
+		if (infd >= 0 && infd != STDIN_FILENO) {
+			close(infd);
+		}
+		/* collect the ones that did start */
+		while (i-- > 0) {
+			waitpid(pids[i], &status, 0);
+		}
+		exitinfo_exit(ei, 1);
+		return;
 	}
 
 	/* parent */
 	if (bg) {
 		/* background this command */
-		remember_bg(pid);
-		printf("[%d] %s ... &\n", pid, args[0]);
+		for (i=0; i<ncmds; i++) {
+			remember_bg(pids[i]);
+			printf("[%d] %s ... &\n", pids[i], cmds[i][0]);
+		}
 		exitinfo_exit(ei, 0);
 		return;
 	}
 
-	if (waitpid(pid, &status, 0) < 0) {
-		warn("waitpid");
-		exitinfo_exit(ei, 255);
-	}
-	else {
-		readstatus(status, ei);
+	/* the pipeline's exit status is that of its last command */
+	for (i=0; i<ncmds; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			warn("waitpid");
+			exitinfo_exit(ei, 255);
+		}
+		else {
+			readstatus(status, ei);
+		}
 	}
 
 	if (timing) {
@@ -472,6 +664,10 @@ docommand(char *buf, struct exitinfo *ei)
 		warnx("subprocess time: %lu.%09lu seconds",
 		      (unsigned long) endsecs, (unsigned long) endnsecs);
 	}
+	if (showusage) {
+		getrusage(RUSAGE_CHILDREN, &endru);
+		printrusage(&startru, &endru);
+	}
 }
 
 /*
@@ -550,10 +746,15 @@ check_timing(void)
 {
 	time_t secs;
 	unsigned long nsecs;
+	struct rusage ru;
+
 	if (__time(&secs, &nsecs) != -1) {
 		timing = 1;
 		warnx("Timing enabled.");
 	}
+	if (getrusage(RUSAGE_CHILDREN, &ru) != -1) {
+		showusage = 1;
+	}
 }
 
 /*
@@ -35,19 +35,37 @@
 #include <limits.h>
 
 /*
- * POSIX C function: exec a program on the search path. Tries
- * execv() repeatedly until one of the choices works.
+ * Run a program with execv or spawnv, depending on SPAWN. Returns -1
+ * on failure (with errno set) or, for spawnv, the new pid.
  */
-int
-execvp(const char *prog, char *const *args)
+static
+pid_t
+run(const char *path, char *const *args, int spawn,
+    const int *fds, int nfds)
+{
+	if (spawn) {
+		return spawnv(path, args, fds, nfds);
+	}
+	execv(path, args);
+	return -1;
+}
+
+/*
+ * Common code for execvp and spawnvp: find the program on the search
+ * path, trying each place in turn until one of the choices works.
+ */
+static
+pid_t
+runvp(const char *prog, char *const *args, int spawn,
+      const int *fds, int nfds)
 {
 	const char *searchpath, *s, *t;
 	char progpath[PATH_MAX];
 	size_t len;
+	pid_t pid;
 
 	if (strchr(prog, '/') != NULL) {
-		execv(prog, args);
-		return -1;
+		return run(prog, args, spawn, fds, nfds);
 	}
 
 	searchpath = getenv("PATH");
@@ -74,7 +92,10 @@ execvp(const char *prog, char *const *args)
 		}
 		memcpy(progpath, s, len);
 		snprintf(progpath + len, sizeof(progpath) - len, "/%s", prog);
-		execv(progpath, args);
+		pid = run(progpath, args, spawn, fds, nfds);
+		if (pid >= 0) {
+			return pid;
+		}
 		switch (errno) {
 		    case ENOENT:
 		    case ENOTDIR:
@@ -89,3 +110,23 @@ execvp(const char *prog, char *const *args)
 	errno = ENOENT;
 	return -1;
 }
+
+/*
+ * POSIX C function: exec a program on the search path. Tries
+ * execv() repeatedly until one of the choices works.
+ */
+int
+execvp(const char *prog, char *const *args)
+{
+	runvp(prog, args, 0, NULL, 0);
+	return -1;
+}
+
+/*
+ * spawnv, but searching the path, like execvp.
+ */
+pid_t
+spawnvp(const char *prog, char *const *args, const int *fds, int nfds)
+{
+	return runvp(prog, args, 1, fds, nfds);
+}
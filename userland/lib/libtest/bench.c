@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * bench.c
+ *
+ * 	Timing support for the benchmark programs in testbin.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+void
+bench_now(struct benchtime *bt)
+{
+	if (__time(&bt->bt_sec, &bt->bt_nsec) < 0) {
+		err(1, "__time");
+	}
+}
+
+unsigned long long
+bench_usecs(const struct benchtime *start, const struct benchtime *end)
+{
+	unsigned long long ns;
+
+	ns = (unsigned long long)(end->bt_sec - start->bt_sec) * 1000000000ULL;
+	ns += end->bt_nsec;
+	ns -= start->bt_nsec;
+	return ns / 1000;
+}
+
+void
+bench_report(const char *label, unsigned long count, const char *what,
+	     unsigned long long usecs)
+{
+	unsigned long long rate;
+
+	/* avoid dividing by zero on very fast runs */
+	rate = usecs > 0 ? (count * 1000000ULL) / usecs : 0;
+	printf("%s: %lu %s in %llu usec (%llu per sec)\n",
+	       label, count, what, usecs, rate);
+}
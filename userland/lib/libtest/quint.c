@@ -40,34 +40,34 @@
 
 static
 pid_t
-spawnv(const char *prog, char **argv)
+start(const char *prog, char **argv)
 {
-	pid_t pid = fork();
-	switch (pid) {
-	    case -1:
-		err(1, "fork");
-	    case 0:
-		/* child */
-		execv(prog, argv);
-		err(1, "%s: execv", prog);
-	    default:
-		/* parent */
-		break;
+	pid_t pid = spawnv(prog, argv, NULL, 0);
+	if (pid < 0) {
+		err(1, "%s: spawnv", prog);
 	}
 	return pid;
 }
 
+/*
+ * Wait for whichever copy finishes first, and check how it did.
+ */
 static
 int
-dowait(int index, int pid)
+dowait(const pid_t *pids, int npids)
 {
-	int status;
+	int status, index;
+	pid_t pid;
 
-	if (waitpid(pid, &status, 0)<0) {
-		warn("waitpid for copy #%d (pid %d)", index, pid);
+	pid = waitpid(WAIT_ANY, &status, 0);
+	if (pid<0) {
+		warn("waitpid");
 		return 1;
 	}
-	else if (WIFSIGNALED(status)) {
+	for (index=0; index<npids && pids[index]!=pid; index++) {
+		/* nothing */
+	}
+	if (WIFSIGNALED(status)) {
 		warnx("copy #%d (pid %d): signal %d", index, pid,
 		      WTERMSIG(status));
 		return 1;
@@ -94,11 +94,11 @@ quint(const char *prog)
 	warnx("Starting: running five copies of %s...", prog);
 
 	for (i=0; i<5; i++) {
-		pids[i]=spawnv(args[0], args);
+		pids[i]=start(args[0], args);
 	}
 
 	for (i=0; i<5; i++) {
-		failures += dowait(i, pids[i]);
+		failures += dowait(pids, 5);
 	}
 
 	if (failures > 0) {
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * execbench.c
+ *
+ * 	Time execv against the size of the argument list passed.
+ *
+ * For each size, a child is started that execs itself NEXECS times
+ * in a chain, passing along a counter and the argument padding each
+ * time, and the time per exec is printed. The padding is made of
+ * PADLEN-byte strings, so the number of arguments grows too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define PROG      "/testbin/execbench"
+#define NEXECS    100
+#define PADLEN    64
+#define MAXPAD    (48*1024)
+
+static const unsigned sizes[] = { 0, 1024, 4096, 16384, MAXPAD };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+static char pad[PADLEN];
+static char *xargv[3 + MAXPAD/PADLEN + 1];
+
+/*
+ * In the chain: exec the next link, or stop.
+ */
+static
+void
+chain(int argc, char **argv)
+{
+	char count[16];
+	int n;
+
+	n = atoi(argv[2]);
+	if (n <= 0) {
+		exit(0);
+	}
+	snprintf(count, sizeof(count), "%d", n - 1);
+	argv[2] = count;
+	execv(PROG, argv);
+	err(1, "%s (with %d args)", PROG, argc);
+}
+
+static
+void
+timeit(unsigned size)
+{
+	struct benchtime start, end;
+	char count[16], label[32];
+	unsigned i, npad;
+	pid_t pid;
+	int status;
+
+	npad = size / PADLEN;
+	snprintf(count, sizeof(count), "%d", NEXECS - 1);
+	xargv[0] = (char *)PROG;
+	xargv[1] = (char *)"-r";
+	xargv[2] = count;
+	for (i=0; i<npad; i++) {
+		xargv[3 + i] = pad;
+	}
+	xargv[3 + npad] = NULL;
+
+	bench_now(&start);
+	pid = spawnv(PROG, xargv, NULL, 0);
+	if (pid < 0) {
+		err(1, "spawnv: %s", PROG);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	bench_now(&end);
+	if (status != 0) {
+		errx(1, "pid %d exited with status %d", pid, status);
+	}
+
+	snprintf(label, sizeof(label), "%uK of args", size / 1024);
+	bench_report(label, NEXECS, "execs", bench_usecs(&start, &end));
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned i;
+
+	if (argc >= 3 && !strcmp(argv[1], "-r")) {
+		chain(argc, argv);
+	}
+
+	memset(pad, 'x', PADLEN - 1);
+	pad[PADLEN - 1] = 0;
+
+	for (i=0; i<NSIZES; i++) {
+		timeit(sizes[i]);
+	}
+	return 0;
+}
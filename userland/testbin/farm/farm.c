@@ -48,21 +48,13 @@ static int pids[MAXPROCS], npids;
 
 static
 void
-spawnv(const char *prog, char **argv)
+start(const char *prog, char **argv)
 {
-	int pid = fork();
-	switch (pid) {
-	    case -1:
-		err(1, "fork");
-	    case 0:
-		/* child */
-		execv(prog, argv);
+	int pid = spawnv(prog, argv, NULL, 0);
+	if (pid < 0) {
 		err(1, "%s", prog);
-	    default:
-		/* parent */
-		pids[npids++] = pid;
-		break;
 	}
+	pids[npids++] = pid;
 }
 
 static
@@ -70,15 +62,19 @@ void
 waitall(void)
 {
 	int i, status;
+	pid_t pid;
+
+	/* Collect them in whatever order they finish. */
 	for (i=0; i<npids; i++) {
-		if (waitpid(pids[i], &status, 0)<0) {
-			warn("waitpid for %d", pids[i]);
+		pid = waitpid(WAIT_ANY, &status, 0);
+		if (pid<0) {
+			warn("waitpid");
 		}
 		else if (WIFSIGNALED(status)) {
-			warnx("pid %d: signal %d", pids[i], WTERMSIG(status));
+			warnx("pid %d: signal %d", pid, WTERMSIG(status));
 		}
 		else if (WEXITSTATUS(status) != 0) {
-			warnx("pid %d: exit %d", pids[i], WEXITSTATUS(status));
+			warnx("pid %d: exit %d", pid, WEXITSTATUS(status));
 		}
 	}
 }
@@ -87,14 +83,14 @@ static
 void
 hog(void)
 {
-	spawnv("/testbin/hog", hargv);
+	start("/testbin/hog", hargv);
 }
 
 static
 void
 cat(void)
 {
-	spawnv("/bin/cat", cargv);
+	start("/bin/cat", cargv);
 }
 
 int
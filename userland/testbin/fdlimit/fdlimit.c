@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * fdlimit.c
+ *
+ * 	Test the limit on open files (RLIMIT_NOFILE) and the file
+ * 	table growing to meet it.
+ *
+ * Opens files until the default limit is hit, raises the limit and
+ * opens many more, checks that a forked child sees them all, and
+ * checks that the hard limit can be lowered but not raised.
+ */
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#define FILE      "/testbin/fdlimit"
+#define MANY      500
+
+/*
+ * Open files until it fails; return how many were opened. The error
+ * should be EMFILE.
+ */
+static
+int
+fill(void)
+{
+	int fd, n;
+
+	n = 0;
+	while (1) {
+		fd = open(FILE, O_RDONLY);
+		if (fd < 0) {
+			break;
+		}
+		n++;
+	}
+	if (errno != EMFILE) {
+		err(1, "open: expected EMFILE");
+	}
+	return n;
+}
+
+static
+void
+closeall(int from, int to)
+{
+	int fd;
+
+	for (fd = from; fd < to; fd++) {
+		if (close(fd)) {
+			err(1, "close %d", fd);
+		}
+	}
+}
+
+static
+void
+setlim(rlim_t cur, rlim_t max)
+{
+	struct rlimit rl;
+
+	rl.rlim_cur = cur;
+	rl.rlim_max = max;
+	if (setrlimit(RLIMIT_NOFILE, &rl)) {
+		err(1, "setrlimit %llu %llu", cur, max);
+	}
+}
+
+int
+main(void)
+{
+	struct rlimit rl, orig;
+	int n, fd, status;
+	pid_t pid;
+
+	if (getrlimit(RLIMIT_NOFILE, &orig)) {
+		err(1, "getrlimit");
+	}
+	printf("Limits: soft %llu, hard %llu\n",
+	       orig.rlim_cur, orig.rlim_max);
+	if (orig.rlim_max < MANY + 3) {
+		errx(1, "Hard limit too low to test");
+	}
+
+	/* stdin, stdout, and stderr are 0-2 */
+	n = fill();
+	if (3 + n != (int)orig.rlim_cur) {
+		errx(1, "Opened %d files; expected %d", n,
+		     (int)orig.rlim_cur - 3);
+	}
+	printf("Opened %d files at the default limit\n", n);
+
+	setlim(MANY + 3, orig.rlim_max);
+	n += fill();
+	if (n != MANY) {
+		errx(1, "Opened %d files; expected %d", n, MANY);
+	}
+	printf("Opened %d files after raising the limit\n", n);
+
+	/*
+	 * The table has grown past the limit, but the empty slots past
+	 * it still can't be used.
+	 */
+	if (dup2(3, MANY + 3 + 1) >= 0 || errno != EBADF) {
+		errx(1, "dup2 to an empty slot past the limit "
+		     "didn't fail with EBADF");
+	}
+
+	/* the lowest free handle is used */
+	closeall(100, 101);
+	fd = open(FILE, O_RDONLY);
+	if (fd != 100) {
+		errx(1, "Reopen got handle %d; expected 100", fd);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		/* the child should have all of them */
+		closeall(3, MANY + 3);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "Child exited with status %d", status);
+	}
+
+	/* lowering the limit doesn't close anything */
+	setlim(10, orig.rlim_max);
+	if (dup2(3, 900) >= 0 || errno != EBADF) {
+		errx(1, "dup2 past the limit didn't fail with EBADF");
+	}
+	/* handles still open past the limit can be replaced... */
+	if (dup2(3, 10 + 1) != 10 + 1) {
+		err(1, "dup2 over an open handle past the limit");
+	}
+	/* ...but once closed, they can't be reopened */
+	closeall(20, 21);
+	if (dup2(3, 20) >= 0 || errno != EBADF) {
+		errx(1, "dup2 to a closed handle past the limit "
+		     "didn't fail with EBADF");
+	}
+	closeall(3, 20);
+	closeall(21, MANY + 3);
+
+	/* the hard limit can come down but not go back up */
+	setlim(10, 100);
+	rl.rlim_cur = 10;
+	rl.rlim_max = 200;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == 0 || errno != EPERM) {
+		errx(1, "Raising the hard limit didn't fail with EPERM");
+	}
+	rl.rlim_cur = 20;
+	rl.rlim_max = 10;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == 0 || errno != EINVAL) {
+		errx(1, "Soft limit over hard limit didn't fail with EINVAL");
+	}
+
+	printf("Passed.\n");
+	return 0;
+}
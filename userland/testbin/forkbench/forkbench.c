@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * forkbench.c
+ *
+ * 	Measure process creation and teardown: fork, _exit, and
+ * 	waitpid, in three patterns.
+ *
+ * serial:   fork a child that exits at once, wait for it, repeat.
+ * wide:     fork NWIDE children before waiting for any, so that many
+ *           pids are in use at once (more than the old limit of 128).
+ * parallel: NPAR processes each run the serial loop at the same time,
+ *           so the process table is hit from several cpus.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define NSERIAL   500
+#define NWIDE     500
+#define NPAR      4
+
+static pid_t pids[NWIDE];
+
+/*
+ * Fork a child that exits right away.
+ */
+static
+pid_t
+spawn(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		_exit(0);
+	}
+	return pid;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "pid %d exited with status %d", pid, status);
+	}
+}
+
+static
+void
+serial(unsigned n)
+{
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		reap(spawn());
+	}
+}
+
+static
+void
+wide(void)
+{
+	unsigned i;
+
+	for (i=0; i<NWIDE; i++) {
+		pids[i] = spawn();
+	}
+	for (i=0; i<NWIDE; i++) {
+		reap(pids[i]);
+	}
+}
+
+static
+void
+parallel(void)
+{
+	unsigned i;
+
+	for (i=0; i<NPAR; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			serial(NSERIAL);
+			_exit(0);
+		}
+	}
+	for (i=0; i<NPAR; i++) {
+		reap(pids[i]);
+	}
+}
+
+int
+main(void)
+{
+	struct benchtime start, end;
+
+	bench_now(&start);
+	serial(NSERIAL);
+	bench_now(&end);
+	bench_report("serial", NSERIAL, "forks",
+		     bench_usecs(&start, &end));
+
+	bench_now(&start);
+	wide();
+	bench_now(&end);
+	bench_report("wide", NWIDE, "forks",
+		     bench_usecs(&start, &end));
+
+	bench_now(&start);
+	parallel();
+	bench_now(&end);
+	bench_report("parallel", NPAR * NSERIAL, "forks",
+		     bench_usecs(&start, &end));
+
+	return 0;
+}
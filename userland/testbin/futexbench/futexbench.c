@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * futexbench.c
+ *
+ * 	Compare a mutex built on futex_wait/futex_wake with one built
+ * 	on a semfs semaphore.
+ *
+ * The futex mutex is the usual three-state one: 0 is unlocked, 1 is
+ * locked, and 2 is locked with (maybe) someone waiting. Locking and
+ * unlocking an uncontended mutex are a single atomic operation each,
+ * with no system call. A semfs semaphore costs a read or write on a
+ * "sem:" file for every P and V.
+ *
+ * Each kind of mutex is timed twice: once uncontended, locked and
+ * unlocked in a loop by one thread, and once contended, with
+ * NTHREADS threads all incrementing a shared counter under it.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define NTHREADS  4
+#define NITERS    20000
+#define SEMNAME   "sem:futexbench"
+
+////////////////////////////////////////////////////////////
+// atomic operations
+
+/*
+ * Compare-and-swap and swap using LL/SC, as in the kernel's
+ * <machine/atomic.h>.
+ */
+static
+inline
+int
+cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"sync;"
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"bne %0, %3, 2f;"	/*   if (x != old) fail */
+		" move %1, %4;"		/*   y = new (delay slot) */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		" nop;"
+		"2: sync;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (old), "r" (new)
+		: "memory");
+	return x;
+}
+
+static
+inline
+int
+swap(volatile int *p, int new)
+{
+	int x, y;
+
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 instructions */
+		".set noreorder;"	/* we fill the delay slots */
+		"sync;"
+		"1: ll %0, 0(%2);"	/*   x = *p */
+		"move %1, %3;"		/*   y = new */
+		"sc %1, 0(%2);"		/*   *p = y; y = success? */
+		"beqz %1, 1b;"		/*   retry if the store failed */
+		" nop;"
+		"sync;"
+		".set pop"		/* restore assembler mode */
+		: "=&r" (x), "=&r" (y)
+		: "r" (p), "r" (new)
+		: "memory");
+	return x;
+}
+
+////////////////////////////////////////////////////////////
+// mutexes
+
+static volatile int fmutex;
+static int semfd;
+static volatile unsigned long counter;
+static unsigned long nwaits[NTHREADS], nwakes[NTHREADS];
+
+static
+void
+futex_lock(unsigned me)
+{
+	int c;
+
+	c = cas(&fmutex, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	if (c != 2) {
+		c = swap(&fmutex, 2);
+	}
+	while (c != 0) {
+		if (futex_wait(&fmutex, 2) < 0 && errno != EAGAIN) {
+			err(1, "futex_wait");
+		}
+		nwaits[me]++;
+		c = swap(&fmutex, 2);
+	}
+}
+
+static
+void
+futex_unlock(unsigned me)
+{
+	if (swap(&fmutex, 0) == 2) {
+		if (futex_wake(&fmutex, 1) < 0) {
+			err(1, "futex_wake");
+		}
+		nwakes[me]++;
+	}
+}
+
+static
+void
+sem_lock(unsigned me)
+{
+	char c;
+
+	(void)me;
+	if (read(semfd, &c, 1) != 1) {
+		err(1, "%s: read", SEMNAME);
+	}
+}
+
+static
+void
+sem_unlock(unsigned me)
+{
+	char c = 0;
+
+	(void)me;
+	if (write(semfd, &c, 1) != 1) {
+		err(1, "%s: write", SEMNAME);
+	}
+}
+
+struct mutexops {
+	const char *name;
+	void (*lock)(unsigned me);
+	void (*unlock)(unsigned me);
+};
+
+static const struct mutexops futexops = { "futex", futex_lock, futex_unlock };
+static const struct mutexops semops = { "semfs", sem_lock, sem_unlock };
+
+////////////////////////////////////////////////////////////
+// benchmarks
+
+static const struct mutexops *ops;
+
+static
+void *
+worker(void *arg)
+{
+	unsigned me = (unsigned)arg;
+	unsigned i;
+
+	for (i=0; i<NITERS / NTHREADS; i++) {
+		ops->lock(me);
+		counter++;
+		ops->unlock(me);
+	}
+	return NULL;
+}
+
+static
+void
+uncontended(const struct mutexops *mops)
+{
+	struct benchtime before, after;
+	char label[64];
+	unsigned i;
+
+	bench_now(&before);
+	for (i=0; i<NITERS; i++) {
+		mops->lock(0);
+		mops->unlock(0);
+	}
+	bench_now(&after);
+
+	snprintf(label, sizeof(label), "futexbench: %s uncontended",
+		 mops->name);
+	bench_report(label, NITERS, "lock/unlock pairs",
+		     bench_usecs(&before, &after));
+}
+
+static
+void
+contended(const struct mutexops *mops)
+{
+	struct benchtime before, after;
+	char label[64];
+	int tids[NTHREADS];
+	unsigned long waits, wakes;
+	unsigned i;
+
+	ops = mops;
+	counter = 0;
+	for (i=0; i<NTHREADS; i++) {
+		nwaits[i] = nwakes[i] = 0;
+	}
+
+	bench_now(&before);
+	for (i=1; i<NTHREADS; i++) {
+		tids[i] = thread_create(worker, (void *)i);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	worker((void *)0);
+	for (i=1; i<NTHREADS; i++) {
+		if (thread_join(tids[i], NULL) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	bench_now(&after);
+
+	if (counter != NITERS / NTHREADS * NTHREADS) {
+		errx(1, "%s: counter is %lu, expected %u", mops->name,
+		     counter, NITERS / NTHREADS * NTHREADS);
+	}
+
+	snprintf(label, sizeof(label), "futexbench: %s contended (%u threads)",
+		 mops->name, NTHREADS);
+	bench_report(label, NITERS / NTHREADS * NTHREADS,
+		     "lock/unlock pairs", bench_usecs(&before, &after));
+
+	waits = wakes = 0;
+	for (i=0; i<NTHREADS; i++) {
+		waits += nwaits[i];
+		wakes += nwakes[i];
+	}
+	if (mops == &futexops) {
+		printf("futexbench: %s contended: %lu futex_wait, "
+		       "%lu futex_wake calls\n", mops->name, waits, wakes);
+	}
+}
+
+int
+main(void)
+{
+	char c = 0;
+
+	uncontended(&futexops);
+	contended(&futexops);
+
+	semfd = open(SEMNAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (semfd < 0) {
+		warn("%s: skipping semfs", SEMNAME);
+		return 0;
+	}
+	/* starts at 0; make it 1 so it works as a mutex */
+	if (write(semfd, &c, 1) != 1) {
+		err(1, "%s: write", SEMNAME);
+	}
+
+	uncontended(&semops);
+	contended(&semops);
+
+	close(semfd);
+	(void)remove(SEMNAME);
+	return 0;
+}
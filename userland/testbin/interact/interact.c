@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * interact.c
+ *
+ * 	Measure interactive response time in the presence of cpu hogs.
+ *
+ * Usage: interact [nhogs]
+ *
+ * Starts NHOGS (default 4) copies of /testbin/hog in the background,
+ * then repeatedly does what the shell does for a trivial command:
+ * fork, exec /bin/true, and wait. The time for each round trip is
+ * the response time a user would see. Prints the average and worst
+ * case; compare against a run with nhogs 0.
+ *
+ * With a plain round-robin scheduler the response time grows with
+ * the number of hogs; with a scheduler that favors threads that
+ * block, it should stay roughly flat.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define MAXHOGS    16
+#define NREQUESTS  20
+
+static pid_t hogpids[MAXHOGS];
+
+static
+pid_t
+spawn(const char *prog)
+{
+	char *args[2];
+	pid_t pid;
+
+	args[0] = (char *)prog;
+	args[1] = NULL;
+
+	pid = fork();
+	switch (pid) {
+	    case -1:
+		err(1, "fork");
+	    case 0:
+		/* child */
+		execv(prog, args);
+		err(1, "%s", prog);
+	    default:
+		/* parent */
+		break;
+	}
+	return pid;
+}
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid for %d", pid);
+	}
+	if (WIFSIGNALED(status)) {
+		warnx("pid %d: signal %d", pid, WTERMSIG(status));
+	}
+	else if (WEXITSTATUS(status) != 0) {
+		warnx("pid %d: exit %d", pid, WEXITSTATUS(status));
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct benchtime before, after;
+	unsigned long long usecs, total, worst;
+	int nhogs, i;
+
+	nhogs = 4;
+	if (argc > 1) {
+		nhogs = atoi(argv[1]);
+	}
+	if (nhogs < 0 || nhogs > MAXHOGS) {
+		errx(1, "Usage: interact [nhogs], at most %d hogs", MAXHOGS);
+	}
+
+	for (i=0; i<nhogs; i++) {
+		hogpids[i] = spawn("/testbin/hog");
+	}
+
+	total = worst = 0;
+	for (i=0; i<NREQUESTS; i++) {
+		bench_now(&before);
+		reap(spawn("/bin/true"));
+		bench_now(&after);
+
+		usecs = bench_usecs(&before, &after);
+		total += usecs;
+		if (usecs > worst) {
+			worst = usecs;
+		}
+	}
+
+	printf("interact: %d hogs: %d requests, average %llu usec, "
+	       "worst %llu usec\n", nhogs, NREQUESTS,
+	       total / NREQUESTS, worst);
+
+	for (i=0; i<nhogs; i++) {
+		reap(hogpids[i]);
+	}
+	return 0;
+}
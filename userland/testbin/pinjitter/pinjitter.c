@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+
+/*
+ * pinjitter.c
+ *
+ * 	Show that pinning a process to a cpu of its own shields it from
+ * 	cpu hogs.
+ *
+ * Starts two copies of hog per cpu, then does a series of short
+ * periodic sleeps and measures how late each wakeup actually gets to
+ * run. This is done twice: first with everything free to run
+ * anywhere, then with this process pinned to cpu 0 and the hogs kept
+ * off it with sched_setaffinity. Prints the mean and worst lateness
+ * and the jitter (mean absolute deviation from the mean) for each.
+ *
+ * Needs at least two cpus.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define MAXHOGS   16
+#define NSAMPLES  100
+#define PERIOD    10000		/* usec */
+
+static char *hargv[2] = { (char *)"hog", NULL };
+
+static int pids[MAXHOGS], npids;
+static unsigned long long late[NSAMPLES];
+
+static
+void
+hog(unsigned mask)
+{
+	int pid = fork();
+	switch (pid) {
+	    case -1:
+		err(1, "fork");
+	    case 0:
+		/* child */
+		if (sched_setaffinity(0, mask) < 0) {
+			err(1, "sched_setaffinity");
+		}
+		execv("/testbin/hog", hargv);
+		err(1, "/testbin/hog");
+	    default:
+		/* parent */
+		pids[npids++] = pid;
+		break;
+	}
+}
+
+static
+void
+waitall(void)
+{
+	int i, status;
+	for (i=0; i<npids; i++) {
+		if (waitpid(pids[i], &status, 0)<0) {
+			warn("waitpid for %d", pids[i]);
+		}
+		else if (WEXITSTATUS(status) != 0) {
+			warnx("pid %d: exit %d", pids[i], WEXITSTATUS(status));
+		}
+	}
+	npids = 0;
+}
+
+/*
+ * Sleep NSAMPLES times and record how far past PERIOD each sleep ran.
+ * Returns the jitter; the mean and maximum are returned via pointers.
+ */
+static
+unsigned long long
+measure(unsigned long long *meanret, unsigned long long *maxret)
+{
+	struct benchtime before, after;
+	struct timespec ts;
+	unsigned long long usecs, total, mean, max, dev;
+	unsigned i;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = PERIOD * 1000;
+
+	total = max = 0;
+	for (i=0; i<NSAMPLES; i++) {
+		bench_now(&before);
+		if (nanosleep(&ts, NULL) < 0) {
+			err(1, "nanosleep");
+		}
+		bench_now(&after);
+
+		usecs = bench_usecs(&before, &after);
+		late[i] = usecs > PERIOD ? usecs - PERIOD : 0;
+		total += late[i];
+		if (late[i] > max) {
+			max = late[i];
+		}
+	}
+	mean = total / NSAMPLES;
+
+	dev = 0;
+	for (i=0; i<NSAMPLES; i++) {
+		dev += late[i] > mean ? late[i] - mean : mean - late[i];
+	}
+
+	*meanret = mean;
+	*maxret = max;
+	return dev / NSAMPLES;
+}
+
+/*
+ * Start the hogs with affinity HOGMASK, move ourselves to SELFMASK,
+ * and measure.
+ */
+static
+unsigned long long
+run(const char *label, unsigned nhogs, unsigned hogmask, unsigned selfmask)
+{
+	unsigned long long mean, max, jitter;
+	unsigned i;
+
+	for (i=0; i<nhogs; i++) {
+		hog(hogmask);
+	}
+	if (sched_setaffinity(0, selfmask) < 0) {
+		err(1, "sched_setaffinity");
+	}
+
+	jitter = measure(&mean, &max);
+
+	printf("pinjitter: %s: %u sleeps of %u usec with %u hogs\n",
+	       label, NSAMPLES, PERIOD, nhogs);
+	printf("pinjitter: %s: late by %llu usec mean, %llu usec max, "
+	       "%llu usec jitter\n", label, mean, max, jitter);
+
+	waitall();
+	return jitter;
+}
+
+int
+main(void)
+{
+	unsigned all, ncpus, nhogs, bit;
+	unsigned long long unpinned, pinned;
+
+	if (sched_getaffinity(0, &all) < 0) {
+		err(1, "sched_getaffinity");
+	}
+	ncpus = 0;
+	for (bit = 1; bit != 0; bit <<= 1) {
+		if (all & bit) {
+			ncpus++;
+		}
+	}
+	if (ncpus < 2 || (all & 1) == 0) {
+		errx(1, "Needs at least two cpus, including cpu 0");
+	}
+
+	nhogs = 2 * ncpus;
+	if (nhogs > MAXHOGS) {
+		nhogs = MAXHOGS;
+	}
+
+	unpinned = run("unpinned", nhogs, all, all);
+	pinned = run("pinned", nhogs, all & ~1U, 1);
+
+	if (sched_setaffinity(0, all) < 0) {
+		err(1, "sched_setaffinity");
+	}
+
+	if (pinned >= unpinned) {
+		warnx("pinning did not reduce jitter");
+	}
+	printf("pinjitter: done\n");
+	return 0;
+}
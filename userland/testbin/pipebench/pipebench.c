@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * pipebench.c
+ *
+ * 	Measure the throughput of a pipe, and check that small writes
+ * 	are atomic.
+ *
+ * For each of several chunk sizes, a child process writes TOTAL
+ * bytes into a pipe CHUNK bytes at a time and the parent reads them
+ * out CHUNK bytes at a time, until EOF. The KB per second are
+ * printed. Chunks smaller than the pipe's buffer let reader and
+ * writer run in small steps; larger ones have each call wait for the
+ * other side several times.
+ *
+ * Then NWRITERS children each write NRECS records of PIPE_BUF bytes,
+ * all of one character, into one pipe at once, and the parent checks
+ * that no record has another's data in the middle of it.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define TOTAL     (256*1024)
+#define MAXCHUNK  16384
+#define NWRITERS  4
+#define NRECS     100
+
+static const unsigned chunks[] = { 64, 512, 4096, MAXCHUNK };
+#define NCHUNKS (sizeof(chunks) / sizeof(chunks[0]))
+
+static char buf[MAXCHUNK];
+
+static
+void
+makepipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+/*
+ * Fork a child that runs FUNC(writefd, ARG) on the pipe FDS and exits.
+ */
+static
+pid_t
+forkwriter(const int fds[2], void (*func)(int fd, unsigned arg),
+	   unsigned arg)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		func(fds[1], arg);
+		_exit(0);
+	}
+	return pid;
+}
+
+static
+void
+waitwriter(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "pid %d: writer failed", pid);
+	}
+}
+
+/*
+ * Throughput: write TOTAL bytes CHUNK at a time.
+ */
+static
+void
+writeall(int fd, unsigned chunk)
+{
+	unsigned done;
+	ssize_t r;
+
+	memset(buf, 'x', chunk);
+	for (done = 0; done < TOTAL; done += chunk) {
+		r = write(fd, buf, chunk);
+		if (r != (ssize_t)chunk) {
+			err(1, "write");
+		}
+	}
+}
+
+static
+void
+timeit(unsigned chunk)
+{
+	struct benchtime start, end;
+	char label[32];
+	unsigned long got;
+	ssize_t r;
+	pid_t pid;
+	int fds[2];
+
+	makepipe(fds);
+	pid = forkwriter(fds, writeall, chunk);
+	/* close our write end, so we see EOF when the child is done */
+	close(fds[1]);
+
+	bench_now(&start);
+	got = 0;
+	while ((r = read(fds[0], buf, chunk)) > 0) {
+		got += r;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	bench_now(&end);
+
+	close(fds[0]);
+	waitwriter(pid);
+
+	if (got != TOTAL) {
+		errx(1, "%u-byte chunks: got %lu bytes, expected %u",
+		     chunk, got, TOTAL);
+	}
+	snprintf(label, sizeof(label), "%u-byte chunks", chunk);
+	bench_report(label, TOTAL / 1024, "KB", bench_usecs(&start, &end));
+}
+
+/*
+ * Atomicity: write NRECS records of PIPE_BUF bytes of one character.
+ */
+static
+void
+writerecs(int fd, unsigned me)
+{
+	char rec[PIPE_BUF];
+	unsigned i;
+
+	memset(rec, 'a' + me, sizeof(rec));
+	for (i=0; i<NRECS; i++) {
+		if (write(fd, rec, sizeof(rec)) != sizeof(rec)) {
+			err(1, "writer %u: write", me);
+		}
+	}
+}
+
+static
+void
+atomic(void)
+{
+	pid_t pids[NWRITERS];
+	char rec[PIPE_BUF];
+	unsigned i, have, nrecs;
+	ssize_t r;
+	int fds[2];
+
+	makepipe(fds);
+	for (i=0; i<NWRITERS; i++) {
+		pids[i] = forkwriter(fds, writerecs, i);
+	}
+	close(fds[1]);
+
+	/* reads may split records, so put each one back together */
+	have = nrecs = 0;
+	while ((r = read(fds[0], rec + have, sizeof(rec) - have)) > 0) {
+		have += r;
+		if (have < sizeof(rec)) {
+			continue;
+		}
+		for (i=1; i<sizeof(rec); i++) {
+			if (rec[i] != rec[0]) {
+				errx(1, "Record %u: writers %c and %c "
+				     "interleaved", nrecs, rec[0], rec[i]);
+			}
+		}
+		nrecs++;
+		have = 0;
+	}
+	if (r < 0) {
+		err(1, "read");
+	}
+	close(fds[0]);
+
+	for (i=0; i<NWRITERS; i++) {
+		waitwriter(pids[i]);
+	}
+	if (have != 0 || nrecs != NWRITERS * NRECS) {
+		errx(1, "Got %u records and %u bytes, expected %u records",
+		     nrecs, have, NWRITERS * NRECS);
+	}
+	printf("%u writers, %u records of %u bytes: none interleaved\n",
+	       NWRITERS, nrecs, (unsigned)PIPE_BUF);
+}
+
+int
+main(void)
+{
+	unsigned i;
+
+	for (i=0; i<NCHUNKS; i++) {
+		timeit(chunks[i]);
+	}
+	atomic();
+	return 0;
+}
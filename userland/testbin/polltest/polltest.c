@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest.c
+ *
+ * 	Test poll() on pipes and files, as an event-driven server
+ * 	would use it.
+ *
+ * First some simple cases: a poll with nothing ready times out after
+ * about the right time; a closed fd gets POLLNVAL; a file is always
+ * ready; an empty pipe is writable but not readable; a pipe with data
+ * is readable; and a pipe whose write end is closed is hung up.
+ *
+ * Then NCHILDREN children each send NMSGS messages, a little while
+ * apart, each down its own pipe. The parent waits for all the pipes
+ * at once with poll, reads whatever is ready, and checks that every
+ * message arrives in order and every pipe reports hangup at the end.
+ * It also counts how many times poll returned, which should be about
+ * one per message; a busy-polling loop would go round far more often.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define TESTFILE   "polltestfile"
+#define NCHILDREN  4
+#define NMSGS      20
+#define TIMEOUT    500	/* ms */
+
+static
+void
+makepipe(int fds[2])
+{
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+}
+
+/*
+ * Poll one fd for EVENTS with no waiting, and check what comes back.
+ */
+static
+void
+check1(const char *what, int fd, short events, short expect)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = 0;
+	r = poll(&pfd, 1, 0);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (r != (expect != 0) || pfd.revents != expect) {
+		errx(1, "%s: poll returned %d, revents 0x%x, expected 0x%x",
+		     what, r, pfd.revents, expect);
+	}
+	printf("%s: ok\n", what);
+}
+
+static
+void
+simple(void)
+{
+	struct benchtime start, end;
+	struct pollfd pfd;
+	unsigned long long usecs;
+	int fds[2], fd, r;
+
+	/* timeout */
+	makepipe(fds);
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	bench_now(&start);
+	r = poll(&pfd, 1, TIMEOUT);
+	bench_now(&end);
+	if (r != 0) {
+		errx(1, "timeout: poll returned %d", r);
+	}
+	usecs = bench_usecs(&start, &end);
+	if (usecs < TIMEOUT * 1000ULL || usecs > 2 * TIMEOUT * 1000ULL) {
+		errx(1, "timeout: %d ms poll took %llu usec", TIMEOUT, usecs);
+	}
+	printf("timeout: ok (%llu usec)\n", usecs);
+
+	check1("empty pipe, read end", fds[0], POLLIN, 0);
+	check1("empty pipe, write end", fds[1], POLLOUT, POLLOUT);
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "pipe write");
+	}
+	check1("pipe with data", fds[0], POLLIN, POLLIN);
+	close(fds[1]);
+	check1("pipe with data, hung up", fds[0], POLLIN, POLLIN|POLLHUP);
+	close(fds[0]);
+	check1("closed fd", fds[0], POLLIN, POLLNVAL);
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	check1("file", fd, POLLIN|POLLOUT, POLLIN|POLLOUT);
+	close(fd);
+	remove(TESTFILE);
+}
+
+/*
+ * Child: send messages "child.seq\n", a tick or so apart.
+ */
+static
+void
+sender(int fd, unsigned me)
+{
+	struct timespec ts;
+	char msg[16];
+	unsigned i;
+	size_t len;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 10000000 * (me + 1);
+	for (i=0; i<NMSGS; i++) {
+		nanosleep(&ts, NULL);
+		snprintf(msg, sizeof(msg), "%u.%u\n", me, i);
+		len = strlen(msg);
+		if (write(fd, msg, len) != (ssize_t)len) {
+			err(1, "child %u: write", me);
+		}
+	}
+}
+
+static
+void
+server(void)
+{
+	struct pollfd pfds[NCHILDREN];
+	unsigned nextseq[NCHILDREN];
+	char buf[128], expect[16], *s, *t;
+	pid_t pids[NCHILDREN];
+	unsigned i, nopen, npolls, nmsgs;
+	int fds[2], r, status;
+	ssize_t len;
+
+	for (i=0; i<NCHILDREN; i++) {
+		makepipe(fds);
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			close(fds[0]);
+			sender(fds[1], i);
+			_exit(0);
+		}
+		close(fds[1]);
+		pfds[i].fd = fds[0];
+		pfds[i].events = POLLIN;
+		nextseq[i] = 0;
+	}
+
+	nopen = NCHILDREN;
+	npolls = nmsgs = 0;
+	while (nopen > 0) {
+		r = poll(pfds, NCHILDREN, -1);
+		if (r <= 0) {
+			err(1, "poll returned %d", r);
+		}
+		npolls++;
+		for (i=0; i<NCHILDREN; i++) {
+			if (pfds[i].revents == 0) {
+				continue;
+			}
+			if (pfds[i].revents & ~(POLLIN|POLLHUP)) {
+				errx(1, "pipe %u: revents 0x%x", i,
+				     pfds[i].revents);
+			}
+			/* messages are short, so a read gets whole ones */
+			len = read(pfds[i].fd, buf, sizeof(buf) - 1);
+			if (len < 0) {
+				err(1, "pipe %u: read", i);
+			}
+			if (len == 0) {
+				/* EOF; stop polling it */
+				close(pfds[i].fd);
+				pfds[i].fd = -1;
+				nopen--;
+				continue;
+			}
+			buf[len] = 0;
+			for (s = buf; (t = strchr(s, '\n')) != NULL; s = t+1) {
+				*t = 0;
+				snprintf(expect, sizeof(expect), "%u.%u",
+					 i, nextseq[i]);
+				if (strcmp(s, expect) != 0) {
+					errx(1, "pipe %u: got \"%s\", "
+					     "expected \"%s\"", i, s, expect);
+				}
+				nextseq[i]++;
+				nmsgs++;
+			}
+			if (*s != 0) {
+				errx(1, "pipe %u: partial message", i);
+			}
+		}
+	}
+
+	for (i=0; i<NCHILDREN; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			errx(1, "child %u failed", i);
+		}
+		if (nextseq[i] != NMSGS) {
+			errx(1, "pipe %u: got %u messages, expected %u",
+			     i, nextseq[i], NMSGS);
+		}
+	}
+	printf("%u messages from %u pipes in %u polls: ok\n",
+	       nmsgs, NCHILDREN, npolls);
+}
+
+int
+main(void)
+{
+	simple();
+	server();
+	return 0;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * preadbench.c
+ *
+ * 	Measure several processes reading one shared open file at once,
+ * 	with read and with pread.
+ *
+ * A file of FILESIZE bytes is made and opened, and then NPROCS
+ * processes are forked that all use that one open file, so they
+ * share its seek position.
+ *
+ * read:  each process reads CHUNK bytes at a time from wherever the
+ *        shared seek position is, rewinding at the end of the file;
+ *        the offset lock lets only one read run at a time.
+ * pread: each process reads its own 1/NPROCS of the file with pread,
+ *        which doesn't use the seek position at all, and checks what
+ *        it got.
+ *
+ * Either way the processes read the whole file NPASSES times between
+ * them. This is timed for 1, 2, and 4 processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define TESTFILE  "preadbenchfile"
+#define FILESIZE  (256*1024)
+#define CHUNK     4096
+#define NPASSES   20
+#define MAXPROCS  4
+
+static int buf[CHUNK / sizeof(int)];
+
+/*
+ * Make the file; word i holds i.
+ */
+static
+void
+makefile(void)
+{
+	unsigned i, j;
+	int fd;
+
+	fd = open(TESTFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	for (i=0; i<FILESIZE / CHUNK; i++) {
+		for (j=0; j<CHUNK / sizeof(int); j++) {
+			buf[j] = i * (CHUNK / sizeof(int)) + j;
+		}
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			err(1, "%s: write", TESTFILE);
+		}
+	}
+	close(fd);
+}
+
+static
+void
+readall(int fd, unsigned me, unsigned nprocs)
+{
+	unsigned count;
+	ssize_t r;
+
+	(void)me;
+
+	/* our share of the chunks, wherever the seek position is */
+	count = NPASSES * (FILESIZE / CHUNK) / nprocs;
+	while (count > 0) {
+		r = read(fd, buf, CHUNK);
+		if (r < 0) {
+			err(1, "%s: read", TESTFILE);
+		}
+		if (r == 0) {
+			/* at the end; go around again */
+			lseek(fd, 0, SEEK_SET);
+			continue;
+		}
+		count--;
+	}
+}
+
+static
+void
+preadall(int fd, unsigned me, unsigned nprocs)
+{
+	unsigned pass, i, span;
+	off_t pos;
+	ssize_t r;
+
+	span = FILESIZE / nprocs;
+	for (pass=0; pass<NPASSES; pass++) {
+		for (i=0; i<span; i += CHUNK) {
+			pos = me * span + i;
+			r = pread(fd, buf, CHUNK, pos);
+			if (r != CHUNK) {
+				err(1, "%s: pread", TESTFILE);
+			}
+			if (buf[0] != (int)(pos / sizeof(int))) {
+				errx(1, "%s: wrong data at %lld", TESTFILE,
+				     pos);
+			}
+		}
+	}
+}
+
+static
+void
+timeit(const char *what, unsigned nprocs,
+       void (*func)(int fd, unsigned me, unsigned nprocs))
+{
+	struct benchtime start, end;
+	pid_t pids[MAXPROCS];
+	char label[32];
+	unsigned i;
+	int fd, status, bad;
+
+	fd = open(TESTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+
+	bench_now(&start);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			func(fd, i, nprocs);
+			_exit(0);
+		}
+	}
+	bad = 0;
+	for (i=0; i<nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			bad = 1;
+		}
+	}
+	bench_now(&end);
+	close(fd);
+
+	if (bad) {
+		errx(1, "%s, %u procs: a child failed", what, nprocs);
+	}
+	snprintf(label, sizeof(label), "%s, %u procs", what, nprocs);
+	bench_report(label, NPASSES * (FILESIZE / 1024), "KB",
+		     bench_usecs(&start, &end));
+}
+
+int
+main(void)
+{
+	unsigned n;
+
+	makefile();
+	for (n=1; n<=MAXPROCS; n *= 2) {
+		timeit("read", n, readall);
+		timeit("pread", n, preadall);
+	}
+	remove(TESTFILE);
+	return 0;
+}
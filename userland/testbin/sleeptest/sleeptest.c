@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * sleeptest.c
+ *
+ * 	Check the accuracy of nanosleep.
+ *
+ * Sleeps for a range of times from one clock tick to a second and
+ * prints how long each sleep actually took, as measured by __time.
+ * A sleep that is shorter than requested is an error; one that is
+ * more than a couple of clock ticks longer is suspicious. Also checks
+ * that invalid times are rejected.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+static const unsigned long sleeptimes[] = {	/* in usec */
+	1, 10000, 25000, 100000, 333333, 1000000,
+};
+#define NSLEEPTIMES (sizeof(sleeptimes) / sizeof(sleeptimes[0]))
+
+static
+void
+badsleep(time_t sec, long nsec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = sec;
+	ts.tv_nsec = nsec;
+	if (nanosleep(&ts, NULL) != -1) {
+		errx(1, "nanosleep %lld sec %ld nsec: succeeded",
+		     (long long)sec, nsec);
+	}
+	if (errno != EINVAL) {
+		err(1, "nanosleep %lld sec %ld nsec: wrong error",
+		    (long long)sec, nsec);
+	}
+}
+
+int
+main(void)
+{
+	struct benchtime before, after;
+	struct timespec ts;
+	unsigned long long usecs;
+	unsigned i;
+	int failed = 0;
+
+	for (i=0; i<NSLEEPTIMES; i++) {
+		ts.tv_sec = sleeptimes[i] / 1000000;
+		ts.tv_nsec = (sleeptimes[i] % 1000000) * 1000;
+
+		bench_now(&before);
+		if (nanosleep(&ts, NULL) < 0) {
+			err(1, "nanosleep %lu usec", sleeptimes[i]);
+		}
+		bench_now(&after);
+
+		usecs = bench_usecs(&before, &after);
+		printf("sleeptest: asked for %lu usec, slept %llu usec\n",
+		       sleeptimes[i], usecs);
+		if (usecs < sleeptimes[i]) {
+			warnx("sleep was too short");
+			failed = 1;
+		}
+	}
+
+	badsleep(-1, 0);
+	badsleep(0, -1);
+	badsleep(0, 1000000000);
+
+	if (failed) {
+		errx(1, "FAILED");
+	}
+	printf("sleeptest: passed\n");
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawnbench.c
+ *
+ * 	Compare the time to run a program in a new process with fork
+ * 	and execv against doing it with spawnv, which doesn't copy the
+ * 	parent's address space first.
+ *
+ * Each way runs /bin/true NRUNS times, waiting for it each time.
+ * Then both are timed again after growing our heap by BIGHEAP bytes,
+ * which fork has to copy and spawnv doesn't.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define NRUNS     200
+#define BIGHEAP   (512*1024)
+
+static char *targv[2] = { (char *)"/bin/true", NULL };
+
+static
+void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "pid %d exited with status %d", pid, status);
+	}
+}
+
+static
+void
+forkexec(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(targv[0], targv);
+		warn("%s", targv[0]);
+		_exit(1);
+	}
+	reap(pid);
+}
+
+static
+void
+spawn(void)
+{
+	pid_t pid;
+
+	pid = spawnv(targv[0], targv, NULL, 0);
+	if (pid < 0) {
+		err(1, "spawnv: %s", targv[0]);
+	}
+	reap(pid);
+}
+
+static
+void
+timeit(const char *label, void (*func)(void))
+{
+	struct benchtime start, end;
+	unsigned i;
+
+	bench_now(&start);
+	for (i=0; i<NRUNS; i++) {
+		func();
+	}
+	bench_now(&end);
+	bench_report(label, NRUNS, "runs", bench_usecs(&start, &end));
+}
+
+int
+main(void)
+{
+	char *heap;
+
+	timeit("fork+execv", forkexec);
+	timeit("spawnv", spawn);
+
+	heap = malloc(BIGHEAP);
+	if (heap == NULL) {
+		warnx("Cannot allocate %d bytes; skipping big heap runs",
+		      BIGHEAP);
+		return 0;
+	}
+	memset(heap, 1, BIGHEAP);
+
+	timeit("fork+execv, big heap", forkexec);
+	timeit("spawnv, big heap", spawn);
+
+	free(heap);
+	return 0;
+}
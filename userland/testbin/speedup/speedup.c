@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * speedup.c
+ *
+ * 	Measure parallel speedup of psort and parallelvm.
+ *
+ * Usage: speedup [maxprocs]
+ *
+ * Runs /testbin/psort with 1, 2, 4, ... up to MAXPROCS (default 4)
+ * worker processes and prints the wall-clock time of each run and its
+ * speedup over the one-process run. Then runs /testbin/parallelvm
+ * (which always has 24 jobs) and prints its time; compare that across
+ * machines with different numbers of cpus in sys161.conf.
+ *
+ * How close the psort speedup gets to the number of cpus depends
+ * mostly on how quickly an idle cpu finds work to do.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define MAXPROCS 32
+
+static
+unsigned long long
+timerun(char **args)
+{
+	struct benchtime before, after;
+	pid_t pid;
+	int status;
+
+	bench_now(&before);
+
+	pid = fork();
+	switch (pid) {
+	    case -1:
+		err(1, "fork");
+	    case 0:
+		/* child */
+		execv(args[0], args);
+		err(1, "%s", args[0]);
+	    default:
+		/* parent */
+		break;
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid for %d", pid);
+	}
+
+	bench_now(&after);
+
+	if (WIFSIGNALED(status)) {
+		errx(1, "%s: signal %d", args[0], WTERMSIG(status));
+	}
+	if (WEXITSTATUS(status) != 0) {
+		errx(1, "%s: exit %d", args[0], WEXITSTATUS(status));
+	}
+	return bench_usecs(&before, &after);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char *args[4];
+	char procs[16];
+	unsigned long long usecs, base;
+	int maxprocs, n;
+
+	maxprocs = 4;
+	if (argc > 1) {
+		maxprocs = atoi(argv[1]);
+	}
+	if (maxprocs < 1 || maxprocs > MAXPROCS) {
+		errx(1, "Usage: speedup [maxprocs], at most %d", MAXPROCS);
+	}
+
+	base = 0;
+	for (n=1; n<=maxprocs; n*=2) {
+		snprintf(procs, sizeof(procs), "%d", n);
+		args[0] = (char *)"/testbin/psort";
+		args[1] = (char *)"-p";
+		args[2] = procs;
+		args[3] = NULL;
+
+		usecs = timerun(args);
+		if (usecs == 0) {
+			/* clock too coarse; avoid dividing by zero */
+			usecs = 1;
+		}
+		if (n == 1) {
+			base = usecs;
+		}
+		printf("speedup: psort -p %d: %llu usec, speedup %llu.%02llu\n",
+		       n, usecs, base / usecs, (base * 100 / usecs) % 100);
+	}
+
+	args[0] = (char *)"/testbin/parallelvm";
+	args[1] = NULL;
+	usecs = timerun(args);
+	printf("speedup: parallelvm: %llu usec\n", usecs);
+
+	return 0;
+}
@@ -28,82 +28,230 @@
  */
 
 /*
- * Test multiple user level threads inside a process. The program
- * forks 3 threads off 2 to functions, each of which displays a string
- * every once in a while.
+ * userthreads.c
  *
- * This won't do much of anything unless you implement user-level
- * threads.
+ * 	Test and benchmark multiple user-level threads in one process.
  *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * First checks the basics of the thread API: that thread_create
+ * starts a thread, that thread_join hands back what the thread
+ * returned (or passed to thread_exit), and that a thread can't be
+ * joined twice.
  *
- * This is also a rather basic test and you'll probably want to write
- * some more of your own.
+ * Then splits a fixed amount of compute-bound work across 1, 2, 4,
+ * ... threads, up to the number of cpus, and reports how long each
+ * run takes and the speedup over a single thread. On a machine with
+ * N cpus the speedup with N threads should approach N.
+ *
+ * Note that malloc and stdio are not thread-safe, so the threads
+ * here use neither.
  */
 
-
-#include <unistd.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
 
-#define NTHREADS  3
-#define MAX       1<<25
+#define WORK      (1UL << 22)	/* iterations, split among the threads */
+#define MAXRUN    THREADS_MAX	/* most threads in one run */
 
-/* counter for the loop in the threads:
-   This variable is shared and incremented by each
-   thread during his computation */
-volatile int count = 0;
+/*
+ * Per-thread work: sum a hash of each number in [lo, hi). The
+ * result goes in the thread's own slot, which is also what the
+ * thread returns.
+ */
+struct slice {
+	unsigned long lo, hi;
+	unsigned long sum;
+};
 
-/* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+static struct slice slices[MAXRUN];
 
-int
-main(int argc, char *argv[])
+static
+unsigned long
+hash(unsigned long x)
+{
+	unsigned i;
+
+	for (i=0; i<4; i++) {
+		x = x * 1103515245 + 12345;
+		x ^= x >> 13;
+	}
+	return x;
+}
+
+static
+void *
+worker(void *arg)
 {
-    int i;
+	struct slice *s = arg;
+	unsigned long i, sum;
 
-    (void)argc;
-    (void)argv;
+	sum = 0;
+	for (i = s->lo; i < s->hi; i++) {
+		sum += hash(i);
+	}
+	s->sum = sum;
+	return s;
+}
 
-    for (i=0; i<NTHREADS; i++) {
-	if (i)
-	    threadfork(ThreadRunner);
-        else
-	    threadfork(BladeRunner);
-    }
+////////////////////////////////////////////////////////////
+// basics
 
-    printf("Parent has left.\n");
-    return 0;
+static
+void *
+plusone(void *arg)
+{
+	return (char *)arg + 1;
 }
 
-/* multiple threads will simply print out the global variable.
-   Even though there is no synchronization, we should get some
-   random results.
-*/
+static
+void *
+exiter(void *arg)
+{
+	thread_exit((char *)arg + 2);
+}
 
+static
 void
-BladeRunner()
+basics(void)
 {
-    while (count < MAX) {
-	if (count % 500 == 0)
-	    printf("Blade ");
-	count++;
-    }
+	char token;
+	void *ret;
+	int tid;
+
+	tid = thread_create(plusone, &token);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	if (thread_join(tid, &ret) < 0) {
+		err(1, "thread_join");
+	}
+	if (ret != &token + 1) {
+		errx(1, "thread_join returned %p, expected %p", ret, &token + 1);
+	}
+	if (thread_join(tid, &ret) == 0) {
+		errx(1, "joined thread %d twice", tid);
+	}
+	else if (errno != ESRCH) {
+		err(1, "second thread_join: expected ESRCH, got");
+	}
+
+	tid = thread_create(exiter, &token);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	if (thread_join(tid, &ret) < 0) {
+		err(1, "thread_join");
+	}
+	if (ret != &token + 2) {
+		errx(1, "thread_exit passed %p, expected %p", ret, &token + 2);
+	}
+
+	printf("userthreads: create, exit, and join work\n");
 }
 
+////////////////////////////////////////////////////////////
+// speedup
+
+/*
+ * Do all the work with NTHREADS threads; the main thread takes the
+ * first slice itself. Returns the elapsed time and the total.
+ */
+static
+unsigned long long
+run(unsigned nthreads, unsigned long *total)
+{
+	struct benchtime before, after;
+	int tids[MAXRUN];
+	unsigned i;
+	void *ret;
+
+	for (i=0; i<nthreads; i++) {
+		slices[i].lo = WORK / nthreads * i;
+		slices[i].hi = (i == nthreads - 1) ?
+			WORK : WORK / nthreads * (i + 1);
+		slices[i].sum = 0;
+	}
+
+	bench_now(&before);
+	for (i=1; i<nthreads; i++) {
+		tids[i] = thread_create(worker, &slices[i]);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	worker(&slices[0]);
+	*total = slices[0].sum;
+	for (i=1; i<nthreads; i++) {
+		if (thread_join(tids[i], &ret) < 0) {
+			err(1, "thread_join");
+		}
+		if (ret != &slices[i]) {
+			errx(1, "thread %d returned the wrong value", tids[i]);
+		}
+		*total += slices[i].sum;
+	}
+	bench_now(&after);
+
+	return bench_usecs(&before, &after);
+}
+
+static
 void
-ThreadRunner()
+speedup(unsigned ncpus)
 {
-    while (count < MAX) {
-	if (count % 513 == 0)
-	    printf(" Runner\n");
-	count++;
-    }
+	unsigned long long base, usecs, x100;
+	unsigned long total, expected;
+	unsigned n;
+
+	printf("userthreads: %lu iterations on %u cpus\n", WORK, ncpus);
+
+	base = 0;
+	expected = 0;
+	n = 1;
+	while (1) {
+		usecs = run(n, &total);
+		if (n == 1) {
+			base = usecs;
+			expected = total;
+		}
+		else if (total != expected) {
+			errx(1, "%u threads got the wrong answer", n);
+		}
+		if (usecs == 0) {
+			usecs = 1;
+		}
+		x100 = base * 100 / usecs;
+		printf("userthreads: %2u threads: %llu usec, speedup %llu.%02llu\n",
+		       n, usecs, x100 / 100, x100 % 100);
+		if (n >= ncpus) {
+			break;
+		}
+		n = n * 2 > ncpus ? ncpus : n * 2;
+	}
+}
+
+int
+main(void)
+{
+	unsigned all, ncpus, bit;
+
+	if (sched_getaffinity(0, &all) < 0) {
+		err(1, "sched_getaffinity");
+	}
+	ncpus = 0;
+	for (bit = 1; bit != 0; bit <<= 1) {
+		if (all & bit) {
+			ncpus++;
+		}
+	}
+	if (ncpus > MAXRUN) {
+		ncpus = MAXRUN;
+	}
+
+	basics();
+	speedup(ncpus);
+	return 0;
 }
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * writevbench.c
+ *
+ * 	Measure writing records made of a header and a payload, with
+ * 	one write per buffer against one writev per record, and read
+ * 	them back with readv.
+ *
+ * NRECS records are written to a file, for each of several payload
+ * sizes, three ways:
+ *
+ * write:  write the header, then write the payload (two syscalls).
+ * copy:   copy both into one buffer and write that (one syscall, but
+ *         the payload is copied an extra time).
+ * writev: hand both buffers to writev (one syscall, no copy).
+ *
+ * The number of syscalls and the records per second are printed.
+ * Then the file is read back with readv into separate header and
+ * payload buffers, with preadv at a given record, and checked.
+ */
+
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define TESTFILE  "writevbenchfile"
+#define NRECS     500
+#define MAXPAY    4096
+
+struct header {
+	unsigned h_recno;
+	unsigned h_len;
+	unsigned h_sum;
+	unsigned h_magic;
+};
+#define MAGIC     0x5ca77e2
+
+static const unsigned paysizes[] = { 16, 256, MAXPAY };
+#define NPAYSIZES (sizeof(paysizes) / sizeof(paysizes[0]))
+
+static char payload[MAXPAY];
+static char joined[sizeof(struct header) + MAXPAY];
+
+/*
+ * Fill in the header and payload for record RECNO.
+ */
+static
+void
+makerec(struct header *h, unsigned recno, unsigned len)
+{
+	unsigned i;
+
+	h->h_recno = recno;
+	h->h_len = len;
+	h->h_sum = 0;
+	h->h_magic = MAGIC;
+	for (i=0; i<len; i++) {
+		payload[i] = (char)(recno + i);
+		h->h_sum += (unsigned char)payload[i];
+	}
+}
+
+static
+int
+openfile(int flags)
+{
+	int fd;
+
+	fd = open(TESTFILE, flags, 0664);
+	if (fd < 0) {
+		err(1, "%s", TESTFILE);
+	}
+	return fd;
+}
+
+static
+void
+checkwrite(ssize_t r, size_t len)
+{
+	if (r < 0) {
+		err(1, "%s: write", TESTFILE);
+	}
+	if ((size_t)r != len) {
+		errx(1, "%s: short write (%zd of %zu)", TESTFILE, r, len);
+	}
+}
+
+/*
+ * Write the records one of the three ways; return the syscall count.
+ */
+static
+unsigned
+writerecs(const char *how, unsigned len)
+{
+	struct header h;
+	struct iovec iov[2];
+	unsigned i, nsys;
+	int fd;
+
+	fd = openfile(O_WRONLY|O_CREAT|O_TRUNC);
+	nsys = 0;
+	for (i=0; i<NRECS; i++) {
+		makerec(&h, i, len);
+		if (!strcmp(how, "write")) {
+			checkwrite(write(fd, &h, sizeof(h)), sizeof(h));
+			checkwrite(write(fd, payload, len), len);
+			nsys += 2;
+		}
+		else if (!strcmp(how, "copy")) {
+			memcpy(joined, &h, sizeof(h));
+			memcpy(joined + sizeof(h), payload, len);
+			checkwrite(write(fd, joined, sizeof(h) + len),
+				   sizeof(h) + len);
+			nsys++;
+		}
+		else {
+			iov[0].iov_base = &h;
+			iov[0].iov_len = sizeof(h);
+			iov[1].iov_base = payload;
+			iov[1].iov_len = len;
+			checkwrite(writev(fd, iov, 2), sizeof(h) + len);
+			nsys++;
+		}
+	}
+	close(fd);
+	return nsys;
+}
+
+static
+void
+checkrec(struct header *h, unsigned recno, unsigned len)
+{
+	unsigned i, sum;
+
+	if (h->h_magic != MAGIC || h->h_recno != recno || h->h_len != len) {
+		errx(1, "Record %u: bad header", recno);
+	}
+	sum = 0;
+	for (i=0; i<len; i++) {
+		sum += (unsigned char)payload[i];
+	}
+	if (sum != h->h_sum) {
+		errx(1, "Record %u: bad payload", recno);
+	}
+}
+
+/*
+ * Read the file back with readv, and one record with preadv.
+ */
+static
+void
+readrecs(unsigned len)
+{
+	struct header h;
+	struct iovec iov[2];
+	unsigned i, recno;
+	ssize_t r;
+	int fd;
+
+	fd = openfile(O_RDONLY);
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = len;
+	for (i=0; i<NRECS; i++) {
+		r = readv(fd, iov, 2);
+		if (r != (ssize_t)(sizeof(h) + len)) {
+			err(1, "%s: readv", TESTFILE);
+		}
+		checkrec(&h, i, len);
+	}
+
+	recno = NRECS / 2;
+	r = preadv(fd, iov, 2, (off_t)recno * (sizeof(h) + len));
+	if (r != (ssize_t)(sizeof(h) + len)) {
+		err(1, "%s: preadv", TESTFILE);
+	}
+	checkrec(&h, recno, len);
+	close(fd);
+}
+
+static
+void
+timeit(const char *how, unsigned len)
+{
+	struct benchtime start, end;
+	char label[48];
+	unsigned nsys;
+
+	bench_now(&start);
+	nsys = writerecs(how, len);
+	bench_now(&end);
+
+	snprintf(label, sizeof(label), "%s, %u-byte payload, %u syscalls",
+		 how, len, nsys);
+	bench_report(label, NRECS, "records", bench_usecs(&start, &end));
+}
+
+int
+main(void)
+{
+	unsigned i;
+
+	for (i=0; i<NPAYSIZES; i++) {
+		timeit("write", paysizes[i]);
+		timeit("copy", paysizes[i]);
+		timeit("writev", paysizes[i]);
+		readrecs(paysizes[i]);
+	}
+	printf("Read back with readv and preadv: ok\n");
+	remove(TESTFILE);
+	return 0;
+}